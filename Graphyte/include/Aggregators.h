@@ -0,0 +1,193 @@
+#ifndef AGGREGATORS_H
+#define AGGREGATORS_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "Quantize.h"
+#include "ThreadPool.h"
+#include "Random.h"
+using namespace std;
+
+// Neighbor aggregators for SAGE layers. Each one is a small policy type with
+// begin/add/finish steps over contiguous rows; the drivers below are templates
+// on the policy, so the per-neighbor loop is inlined with no virtual calls.
+// AggregatorType picks the policy once per layer, outside the hot loop.
+
+enum AggregatorType
+{
+    AGGREGATE_MEAN,
+    AGGREGATE_SUM,
+    AGGREGATE_MAX,  // element-wise max over the neighbors
+    AGGREGATE_POOL, // mean of a one-layer ReLU MLP applied to every neighbor
+};
+
+const char *aggregatorName(AggregatorType type)
+{
+    switch (type)
+    {
+    case AGGREGATE_SUM:
+        return "sum";
+    case AGGREGATE_MAX:
+        return "max";
+    case AGGREGATE_POOL:
+        return "pool-mlp";
+    default:
+        return "mean";
+    }
+}
+
+// dst = max(dst, src)
+void maxFloat(float *dst, const float *src, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        dst[i] = max(dst[i], src[i]);
+    }
+}
+
+struct SumAggregator
+{
+    static const bool transforms = false;
+
+    void begin(float *acc, int dim) const { fill(acc, acc + dim, 0.0f); }
+
+    void add(float *acc, const float *x, int dim) const { accumulateFloat(acc, x, 1.0f, dim); }
+
+    void finish(float *, int, int) const {}
+};
+
+// Isolated nodes aggregate to zeros
+struct MeanAggregator : SumAggregator
+{
+    void finish(float *acc, int dim, int degree) const
+    {
+        if (degree == 0)
+        {
+            return;
+        }
+        float scale = 1.0f / degree;
+        for (int i = 0; i < dim; i++)
+        {
+            acc[i] *= scale;
+        }
+    }
+};
+
+struct MaxAggregator
+{
+    static const bool transforms = false;
+
+    void begin(float *acc, int dim) const { fill(acc, acc + dim, -numeric_limits<float>::infinity()); }
+
+    void add(float *acc, const float *x, int dim) const { maxFloat(acc, x, dim); }
+
+    void finish(float *acc, int dim, int degree) const
+    {
+        if (degree == 0)
+        {
+            fill(acc, acc + dim, 0.0f);
+        }
+    }
+};
+
+// relu(W x + b) per neighbor, then the mean. The MLP only sees the neighbor's
+// own row, so the CSR driver transforms every row once (O(N * D^2)) instead of
+// once per edge.
+struct PoolAggregator : MeanAggregator
+{
+    static const bool transforms = true;
+    int dim = 0;
+    vector<float> weights; // dim x dim, row-major
+    vector<float> bias;
+
+    PoolAggregator() {}
+
+    // Xavier-uniform weights from stream `stream` of `seed`, zero bias
+    PoolAggregator(int dim, uint64_t seed, uint64_t stream = 0) : dim(dim), weights((size_t)dim * dim), bias(dim, 0.0f)
+    {
+        float bound = sqrt(6.0f / (dim + dim));
+        CounterRandom(seed, stream).fillUniform(weights.data(), weights.size(), -bound, bound);
+    }
+
+    void transformRow(const float *x, float *y) const
+    {
+        for (int o = 0; o < dim; o++)
+        {
+            y[o] = max(0.0f, dotFloat(&weights[(size_t)o * dim], x, dim) + bias[o]);
+        }
+    }
+
+    FeatureMatrix transform(const FeatureMatrix &in, ThreadPool &pool) const
+    {
+        FeatureMatrix out(in.rows, dim);
+        pool.parallelFor(0, in.rows, [&](int64_t first, int64_t last)
+                         {
+                             for (int64_t r = first; r < last; r++)
+                                 transformRow(in.row(r), out.row(r)); },
+                         64);
+        return out;
+    }
+};
+
+// out[r] = aggregate of in[neighbors of r], rows in parallel
+template <class Aggregator>
+void aggregateNeighbors(const CSRGraph &g, const FeatureMatrix &in, FeatureMatrix &out, const Aggregator &aggregator,
+                        ThreadPool &pool = defaultThreadPool())
+{
+    FeatureMatrix transformed;
+    if constexpr (Aggregator::transforms)
+    {
+        transformed = aggregator.transform(in, pool);
+    }
+    const FeatureMatrix &src = Aggregator::transforms ? transformed : in;
+    const int dim = src.dim;
+    if (out.rows != g.numNodes() || out.dim != dim)
+    {
+        out = FeatureMatrix(g.numNodes(), dim);
+    }
+    pool.parallelFor(0, g.numNodes(), [&](int64_t first, int64_t last)
+                     {
+                         for (int64_t r = first; r < last; r++)
+                         {
+                             float *acc = out.row(r);
+                             aggregator.begin(acc, dim);
+                             for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                                 aggregator.add(acc, src.row(*it), dim);
+                             aggregator.finish(acc, dim, g.degree(r));
+                         } },
+                     256);
+}
+
+// Runtime selection; `pool_aggregator` is only read for AGGREGATE_POOL
+void aggregateNeighbors(AggregatorType type, const CSRGraph &g, const FeatureMatrix &in, FeatureMatrix &out,
+                        const PoolAggregator &pool_aggregator, ThreadPool &pool = defaultThreadPool())
+{
+    switch (type)
+    {
+    case AGGREGATE_SUM:
+        aggregateNeighbors(g, in, out, SumAggregator(), pool);
+        break;
+    case AGGREGATE_MAX:
+        aggregateNeighbors(g, in, out, MaxAggregator(), pool);
+        break;
+    case AGGREGATE_POOL:
+        aggregateNeighbors(g, in, out, pool_aggregator, pool);
+        break;
+    default:
+        aggregateNeighbors(g, in, out, MeanAggregator(), pool);
+        break;
+    }
+}
+
+#endif
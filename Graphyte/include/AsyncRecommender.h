@@ -0,0 +1,135 @@
+#ifndef ASYNC_RECOMMENDER_H
+#define ASYNC_RECOMMENDER_H
+
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <memory>
+#include "Model.h"
+using namespace std;
+
+typedef vector<pair<int, float>> Recommendations;
+
+// Computes recommendations on demand on a background thread, so the UI never
+// blocks on the model. Results are kept in an LRU cache, and repeated requests
+// for a node that is still being computed share the same future.
+class AsyncRecommender
+{
+public:
+    AsyncRecommender(SAGEModel &model, size_t cache_capacity = 64, size_t top_k = 10)
+        : model(model), cache_capacity(cache_capacity), top_k(top_k)
+    {
+        worker = thread(&AsyncRecommender::run, this);
+    }
+
+    AsyncRecommender(const AsyncRecommender &) = delete;
+    AsyncRecommender &operator=(const AsyncRecommender &) = delete;
+
+    ~AsyncRecommender()
+    {
+        {
+            lock_guard<mutex> lock(jobs_mutex);
+            running = false;
+        }
+        jobs_cv.notify_all();
+        worker.join();
+    }
+
+    shared_future<Recommendations> request(int node_id)
+    {
+        lock_guard<mutex> lock(jobs_mutex);
+        auto cached = cache_index.find(node_id);
+        if (cached != cache_index.end())
+        {
+            // Move to the front of the LRU list
+            cache.splice(cache.begin(), cache, cached->second);
+            promise<Recommendations> ready;
+            ready.set_value(cached->second->second);
+            hits++;
+            return ready.get_future().share();
+        }
+        misses++;
+
+        auto pending = in_flight.find(node_id);
+        if (pending != in_flight.end())
+        {
+            return pending->second;
+        }
+
+        auto job = make_shared<promise<Recommendations>>();
+        shared_future<Recommendations> result = job->get_future().share();
+        in_flight[node_id] = result;
+        jobs.push_back({node_id, job});
+        jobs_cv.notify_one();
+        return result;
+    }
+
+    size_t cacheHits() const { return hits; }
+
+    size_t cacheMisses() const { return misses; }
+
+private:
+    typedef pair<int, shared_ptr<promise<Recommendations>>> Job;
+
+    SAGEModel &model; // only touched by the worker thread
+    size_t cache_capacity;
+    size_t top_k;
+
+    mutex jobs_mutex;
+    condition_variable jobs_cv;
+    deque<Job> jobs;
+    unordered_map<int, shared_future<Recommendations>> in_flight;
+    list<pair<int, Recommendations>> cache; // most recently used first
+    unordered_map<int, list<pair<int, Recommendations>>::iterator> cache_index;
+    atomic<size_t> hits{0};
+    atomic<size_t> misses{0};
+    bool running = true;
+    thread worker;
+
+    void run()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                unique_lock<mutex> lock(jobs_mutex);
+                jobs_cv.wait(lock, [&]
+                             { return !jobs.empty() || !running; });
+                if (!running)
+                {
+                    for (auto &[node_id, pending] : jobs)
+                    {
+                        pending->set_value(Recommendations());
+                    }
+                    return;
+                }
+                // Newest request first: it is the one the user is looking at
+                job = jobs.back();
+                jobs.pop_back();
+            }
+
+            Recommendations result = model.getPrediction(job.first, top_k);
+
+            {
+                lock_guard<mutex> lock(jobs_mutex);
+                cache.emplace_front(job.first, result);
+                cache_index[job.first] = cache.begin();
+                if (cache.size() > cache_capacity)
+                {
+                    cache_index.erase(cache.back().first);
+                    cache.pop_back();
+                }
+                in_flight.erase(job.first);
+            }
+            job.second->set_value(move(result));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,1136 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <functional>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "Reorder.h"
+#include "Aggregators.h"
+#include "GraphLayers.h"
+#include "Metrics.h"
+#include "Layer.h"
+#include "Inference.h"
+#include "Model.h"
+#include "Partition.h"
+#include "Numa.h"
+#include "Quantize.h"
+#include "EmbeddingStore.h"
+#include "Utility.h"
+#include "OutOfCore.h"
+#include "Pipeline.h"
+#include "FeatureCache.h"
+#include "Random.h"
+using namespace std;
+
+// Best wall time of `repeats` runs, in milliseconds
+double timeMs(const function<void()> &fn, int repeats = 1)
+{
+    double best = 1e300;
+    for (int i = 0; i < repeats; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        fn();
+        auto end = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double, milli>(end - start).count());
+    }
+    return best;
+}
+
+// Synthetic social-style graph: dense communities plus a few random long-range
+// edges, with rows shuffled so the input order carries no locality, like the
+// ids in 0.edges
+CSRGraph generateCommunityGraph(int num_nodes, int avg_degree, int community_size, uint64_t seed)
+{
+    mt19937_64 gen(seed);
+    vector<int> shuffled(num_nodes);
+    iota(shuffled.begin(), shuffled.end(), 0);
+    shuffle(shuffled.begin(), shuffled.end(), gen);
+
+    uniform_real_distribution<double> coin(0.0, 1.0);
+    uniform_int_distribution<int> any_node(0, num_nodes - 1);
+    vector<pair<int, int>> edges;
+    edges.reserve((size_t)num_nodes * avg_degree / 2);
+    for (int u = 0; u < num_nodes; u++)
+    {
+        int community_start = u / community_size * community_size;
+        int community_end = min(num_nodes, community_start + community_size);
+        uniform_int_distribution<int> in_community(community_start, community_end - 1);
+        for (int e = 0; e < avg_degree / 2; e++)
+        {
+            int v = coin(gen) < 0.9 ? in_community(gen) : any_node(gen);
+            if (v != u)
+            {
+                edges.push_back({min(shuffled[u], shuffled[v]), max(shuffled[u], shuffled[v])});
+            }
+        }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+    vector<int> node_ids(num_nodes);
+    iota(node_ids.begin(), node_ids.end(), 0);
+    return CSRGraph::fromRowEdges(node_ids, edges);
+}
+
+// Chung-Lu graph with expected degrees following a power law of the given
+// exponent, so a few hubs take a large share of the edges, as in social
+// graphs. Rows are in random order.
+CSRGraph generatePowerLawGraph(int num_nodes, int avg_degree, double exponent, uint64_t seed)
+{
+    mt19937_64 gen(seed);
+    vector<double> weights(num_nodes);
+    for (int i = 0; i < num_nodes; i++)
+    {
+        weights[i] = pow(i + 1.0, -1.0 / (exponent - 1.0));
+    }
+    shuffle(weights.begin(), weights.end(), gen);
+    discrete_distribution<int> endpoint(weights.begin(), weights.end());
+    vector<pair<int, int>> edges;
+    edges.reserve((size_t)num_nodes * avg_degree / 2);
+    for (size_t e = 0; e < (size_t)num_nodes * avg_degree / 2; e++)
+    {
+        int u = endpoint(gen), v = endpoint(gen);
+        if (u != v)
+        {
+            edges.push_back({min(u, v), max(u, v)});
+        }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+    vector<int> node_ids(num_nodes);
+    iota(node_ids.begin(), node_ids.end(), 0);
+    return CSRGraph::fromRowEdges(node_ids, edges);
+}
+
+FeatureMatrix randomFeatures(int rows, int dim, uint64_t seed)
+{
+    mt19937_64 gen(seed);
+    uniform_real_distribution<float> value(-1.0f, 1.0f);
+    FeatureMatrix m(rows, dim);
+    for (float &x : m.data)
+    {
+        x = value(gen);
+    }
+    return m;
+}
+
+// Mean aggregation time under each node ordering, relative to the input order
+void benchmarkOrderings(const string &name, const CSRGraph &g, const FeatureMatrix &features, int repeats = 5)
+{
+    cout << "\n--- Aggregation by node ordering: " << name << " (" << g.numNodes() << " nodes, "
+         << g.numEdges() / 2 << " edges, dim " << features.dim << ") ---" << endl;
+    cout << left << setw(12) << "ordering" << right << setw(14) << "reorder ms" << setw(16) << "aggregate ms" << setw(10) << "speedup" << endl;
+
+    vector<pair<string, function<vector<int>(const CSRGraph &)>>> orderings = {
+        {"original", identityOrder},
+        {"degree", degreeOrder},
+        {"rcm", rcmOrder},
+        {"community", [](const CSRGraph &graph)
+         { return communityOrder(graph); }},
+    };
+
+    double baseline = 0.0;
+    for (auto &[label, ordering] : orderings)
+    {
+        vector<int> order;
+        CSRGraph permuted;
+        FeatureMatrix permuted_features;
+        double reorder_ms = timeMs([&]
+                                   {
+                                       order = ordering(g);
+                                       permuted = permuteGraph(g, order);
+                                       permuted_features = permuteFeatures(features, order); });
+
+        FeatureMatrix out;
+        double aggregate_ms = timeMs([&]
+                                     { aggregateMean(permuted, permuted_features, out); },
+                                     repeats);
+        if (baseline == 0.0)
+        {
+            baseline = aggregate_ms;
+        }
+        cout << left << setw(12) << label << right << fixed << setprecision(2) << setw(14) << reorder_ms
+             << setw(16) << aggregate_ms << setw(9) << baseline / aggregate_ms << "x" << endl;
+    }
+    cout.unsetf(ios::fixed);
+}
+
+// Exact, parallel and histogram AUC over synthetic scores where positives
+// score higher on average, with many exact ties as in sparse cosine scores
+void benchmarkAUC(size_t num_scores, uint64_t seed)
+{
+    mt19937_64 gen(seed);
+    normal_distribution<float> noise(0.0f, 0.3f);
+    bernoulli_distribution is_positive(0.2), tied(0.1);
+    vector<pair<float, bool>> scores(num_scores);
+    for (auto &score : scores)
+    {
+        score.second = is_positive(gen);
+        score.first = tied(gen) ? 0.0f : min(1.0f, max(-1.0f, noise(gen) + (score.second ? 0.3f : 0.0f)));
+    }
+
+    cout << "\n--- AUC over " << num_scores << " scores (" << defaultThreadPool().size() << " threads) ---" << endl;
+    cout << left << setw(12) << "mode" << right << setw(12) << "time ms" << setw(12) << "AUC" << endl;
+    float auc = 0.0f;
+    double ms = timeMs([&]
+                       { auc = exactAUC(scores); });
+    cout << left << setw(12) << "exact" << right << fixed << setprecision(2) << setw(12) << ms << setprecision(6) << setw(12) << auc << endl;
+
+    vector<pair<float, bool>> copy_of_scores;
+    ms = timeMs([&]
+                {
+                    copy_of_scores = scores;
+                    auc = parallelAUC(copy_of_scores); });
+    cout << left << setw(12) << "parallel" << right << setprecision(2) << setw(12) << ms << setprecision(6) << setw(12) << auc << endl;
+
+    ms = timeMs([&]
+                {
+                    AUCHistogram histogram;
+                    for (auto &[score, positive] : scores)
+                        histogram.add(score, positive);
+                    auc = histogram.auc(); });
+    cout << left << setw(12) << "histogram" << right << setprecision(2) << setw(12) << ms << setprecision(6) << setw(12) << auc << endl;
+    cout.unsetf(ios::fixed);
+}
+
+// Filling a large weight tensor with uniform values: the sequential
+// mt19937_64 baseline against the counter-based generator one value at a
+// time, in AVX2 blocks and in parallel. Counter-based fills are checked to
+// give the same values on one thread and on the default pool.
+void benchmarkRandom(size_t num_values, uint64_t seed)
+{
+    vector<float> reference(num_values), out(num_values);
+    CounterRandom random(seed);
+    random.fillUniform(reference.data(), num_values, -1.0f, 1.0f);
+    ThreadPool single(1);
+
+    cout << "\n--- Uniform fill of " << num_values << " floats (" << defaultThreadPool().size() << " threads) ---" << endl;
+    cout << left << setw(16) << "mode" << right << setw(12) << "time ms" << setw(14) << "Mvalues/s" << setw(12) << "identical" << endl;
+    auto report = [&](const char *mode, const function<void()> &fill, bool counter_based)
+    {
+        fill(); // warm up, and fault the pages in
+        double ms = timeMs(fill);
+        cout << left << setw(16) << mode << right << fixed << setprecision(2) << setw(12) << ms << setw(14)
+             << num_values / (ms * 1000.0) << setw(12)
+             << (counter_based ? (memcmp(out.data(), reference.data(), num_values * sizeof(float)) == 0 ? "yes" : "NO") : "-") << endl;
+    };
+    report("mt19937_64", [&]
+           {
+               mt19937_64 gen(seed);
+               uniform_real_distribution<float> value(-1.0f, 1.0f);
+               for (float &x : out)
+                   x = value(gen); },
+           false);
+    report("philox scalar", [&]
+           {
+               for (size_t i = 0; i < num_values; i++)
+                   out[i] = random.uniform(i, -1.0f, 1.0f); },
+           true);
+    report("philox block", [&]
+           { random.fillUniform(out.data(), num_values, -1.0f, 1.0f); },
+           true);
+    report("parallel x1", [&]
+           { parallelFillUniform(out.data(), num_values, -1.0f, 1.0f, random, single); },
+           true);
+    report("parallel", [&]
+           { parallelFillUniform(out.data(), num_values, -1.0f, 1.0f, random); },
+           true);
+    cout.unsetf(ios::fixed);
+}
+
+// Ranking metrics over a synthetic graph: every node is a query with sampled
+// negatives, then a subset of queries against the full candidate set
+void benchmarkRanking(int num_nodes, int dim, uint64_t seed)
+{
+    CSRGraph g = generateCommunityGraph(num_nodes, 8, 100, seed);
+    // Hold out every fourth edge of each node as the test edges
+    vector<pair<int, int>> train_edges, test_edges;
+    for (int u = 0; u < g.numNodes(); u++)
+    {
+        int i = 0;
+        for (const int *v = g.neighborsBegin(u); v != g.neighborsEnd(u); v++)
+        {
+            if (u < *v)
+                (i++ % 4 == 0 ? test_edges : train_edges).push_back({u, *v});
+        }
+    }
+    CSRGraph train = CSRGraph::fromRowEdges(g.node_ids, train_edges);
+    CSRGraph test = CSRGraph::fromRowEdges(g.node_ids, test_edges);
+    // One aggregation so embeddings carry some neighborhood signal
+    FeatureMatrix embeddings;
+    aggregateMean(train, randomFeatures(num_nodes, dim, seed + 1), embeddings);
+
+    cout << "\n--- Ranking metrics (" << num_nodes << " nodes, dim " << dim << ", "
+         << defaultThreadPool().size() << " threads) ---" << endl;
+    cout << left << setw(22) << "candidates" << right << setw(10) << "queries" << setw(12) << "time ms"
+         << setw(10) << "Hits@10" << setw(10) << "MRR" << setw(10) << "NDCG@10" << endl;
+    auto run = [&](const string &label, RankingOptions options)
+    {
+        RankingMetrics m;
+        double ms = timeMs([&]
+                           { m = evaluateRanking(embeddings, test, &train, options); });
+        cout << left << setw(22) << label << right << setw(10) << m.num_queries << fixed << setprecision(2)
+             << setw(12) << ms << setprecision(4) << setw(10) << m.hits_at_k << setw(10) << m.mrr
+             << setw(10) << m.ndcg_at_k << endl;
+        cout.unsetf(ios::fixed);
+    };
+
+    RankingOptions sampled;
+    sampled.num_sampled_negatives = 100;
+    run("100 sampled", sampled);
+
+    RankingOptions full;
+    full.max_queries = 2000;
+    run("all nodes", full);
+}
+
+// Two SAGE layers at each precision over the same graph and weights: time,
+// memory of weights and input activations, error against fp32 and the ranking
+// quality of the output embeddings on held-out edges
+void benchmarkQuantization(const string &name, const CSRGraph &g, const FeatureMatrix &features,
+                           const vector<vector<vector<float>>> &layer_weights, int repeats = 3)
+{
+    EdgeSplit split = splitEdgesCSR(g, 0.0f, 0.3f, 42);
+    cout << "\n--- Quantized inference: " << name << " (" << g.numNodes() << " nodes, dim " << features.dim
+         << ", " << defaultThreadPool().size() << " threads) ---" << endl;
+    cout << left << setw(8) << "format" << right << setw(12) << "time ms" << setw(12) << "weights KB"
+         << setw(12) << "inputs KB" << setw(12) << "max error" << setw(12) << "Hits@10" << setw(10) << "MRR" << endl;
+
+    FeatureMatrix reference;
+    double baseline = 0.0;
+    for (Precision precision : {PRECISION_FP32, PRECISION_BF16, PRECISION_INT8})
+    {
+        vector<QuantizedSAGELayer> layers;
+        size_t weight_bytes = 0;
+        for (const auto &weights : layer_weights)
+        {
+            layers.emplace_back(weights, precision);
+            weight_bytes += layers.back().weights.bytes();
+        }
+        FeatureMatrix out;
+        double ms = timeMs([&]
+                           { out = quantizedInference(split.train, features, layers); },
+                           repeats);
+        if (precision == PRECISION_FP32)
+        {
+            reference = out;
+            baseline = ms;
+        }
+        float max_error = 0.0f;
+        for (size_t i = 0; i < out.data.size(); i++)
+        {
+            max_error = max(max_error, fabs(out.data[i] - reference.data[i]));
+        }
+        RankingMetrics ranking = evaluateRanking(out, split.test, &split.train);
+        cout << left << setw(8) << precisionName(precision) << right << fixed << setprecision(2) << setw(12) << ms
+             << setw(12) << weight_bytes / 1024.0 << setw(12) << QuantizedMatrix(features, precision).bytes() / 1024.0
+             << scientific << setprecision(2) << setw(12) << max_error << fixed << setprecision(4)
+             << setw(12) << ranking.hits_at_k << setw(10) << ranking.mrr << "   " << setprecision(2) << baseline / ms << "x" << endl;
+    }
+    cout.unsetf(ios::fixed | ios::scientific);
+}
+
+// Embedding table formats: bytes per node, time to score every node against
+// `num_queries` others, and how far scores and top-10 lists drift from fp32
+void benchmarkEmbeddingStore(const string &name, const unordered_map<int, vector<vector<float>>> &features, int dim, int num_queries)
+{
+    cout << "\n--- Embedding store: " << name << " (" << features.size() << " nodes, dim " << dim << ") ---" << endl;
+    cout << left << setw(8) << "format" << right << setw(14) << "bytes/node" << setw(12) << "score ms" << setw(14) << "max error"
+         << setw(14) << "top-10 kept" << endl;
+
+    EmbeddingStore reference(features, EMBEDDING_FP32, dim);
+    int num_rows = reference.size();
+    num_queries = min(num_queries, num_rows);
+    auto topTen = [&](const EmbeddingStore &store, int query)
+    {
+        vector<pair<float, int>> scores(num_rows);
+        for (int r = 0; r < num_rows; r++)
+            scores[r] = {store.cosineRows(query, r), r};
+        partial_sort(scores.begin(), scores.begin() + min(10, num_rows), scores.end(), greater<pair<float, int>>());
+        vector<int> top;
+        for (int i = 0; i < min(10, num_rows); i++)
+            top.push_back(scores[i].second);
+        sort(top.begin(), top.end());
+        return top;
+    };
+
+    for (EmbeddingFormat format : {EMBEDDING_FP32, EMBEDDING_FP16, EMBEDDING_INT8})
+    {
+        EmbeddingStore store(features, format, dim);
+        volatile float sink = 0.0f;
+        double ms = timeMs([&]
+                           {
+                               float total = 0.0f;
+                               for (int q = 0; q < num_queries; q++)
+                                   for (int r = 0; r < num_rows; r++)
+                                       total += store.cosineRows(q, r);
+                               sink = total; },
+                           3);
+        (void)sink;
+
+        float max_error = 0.0f;
+        size_t kept = 0, total = 0;
+        for (int q = 0; q < num_queries; q++)
+        {
+            for (int r = 0; r < num_rows; r++)
+                max_error = max(max_error, fabs(store.cosineRows(q, r) - reference.cosineRows(q, r)));
+            vector<int> expected = topTen(reference, q), actual = topTen(store, q), common;
+            set_intersection(expected.begin(), expected.end(), actual.begin(), actual.end(), back_inserter(common));
+            kept += common.size();
+            total += expected.size();
+        }
+        cout << left << setw(8) << embeddingFormatName(format) << right << fixed << setprecision(1) << setw(14)
+             << (double)store.bytes() / max(1, num_rows) << setprecision(2) << setw(12) << ms << scientific << setw(14) << max_error
+             << fixed << setw(13) << 100.0 * kept / max<size_t>(1, total) << "%" << endl;
+    }
+    cout.unsetf(ios::fixed | ios::scientific);
+}
+
+// Cost of each aggregator over the training edges, and the ranking quality of
+// [self | aggregated neighbors] as untrained embeddings on the held-out edges
+void benchmarkAggregators(const string &name, const CSRGraph &g, const FeatureMatrix &features,
+                          RankingOptions ranking_options, int repeats = 3)
+{
+    EdgeSplit split = splitEdgesCSR(g, 0.0f, 0.3f, 42);
+    PoolAggregator pool_aggregator(features.dim, 1);
+    cout << "\n--- Aggregators: " << name << " (" << g.numNodes() << " nodes, dim " << features.dim << ", "
+         << defaultThreadPool().size() << " threads) ---" << endl;
+    cout << left << setw(10) << "type" << right << setw(16) << "aggregate ms" << setw(10) << "Hits@10" << setw(10) << "MRR" << endl;
+    for (AggregatorType type : {AGGREGATE_MEAN, AGGREGATE_SUM, AGGREGATE_MAX, AGGREGATE_POOL})
+    {
+        FeatureMatrix aggregated;
+        double ms = timeMs([&]
+                           { aggregateNeighbors(type, split.train, features, aggregated, pool_aggregator); },
+                           repeats);
+        FeatureMatrix embeddings(features.rows, features.dim + aggregated.dim);
+        for (int r = 0; r < features.rows; r++)
+        {
+            copy(features.row(r), features.row(r) + features.dim, embeddings.row(r));
+            copy(aggregated.row(r), aggregated.row(r) + aggregated.dim, embeddings.row(r) + features.dim);
+        }
+        RankingMetrics ranking = evaluateRanking(embeddings, split.test, &split.train, ranking_options);
+        cout << left << setw(10) << aggregatorName(type) << right << fixed << setprecision(2) << setw(16) << ms
+             << setprecision(4) << setw(10) << ranking.hits_at_k << setw(10) << ranking.mrr << endl;
+    }
+    cout.unsetf(ios::fixed);
+}
+
+// Two layers each of SAGE, GCN and GAT (4 heads) with fresh weights over the
+// training edges: forward time and edge throughput. None of the layers is
+// trained, so the ranking columns only show how much of the features' signal
+// a random projection keeps; they do not compare the architectures' quality.
+void benchmarkArchitectures(const string &name, const CSRGraph &g, const FeatureMatrix &features, int hidden,
+                            RankingOptions ranking_options, int repeats = 3)
+{
+    EdgeSplit split = splitEdgesCSR(g, 0.0f, 0.3f, 42);
+    cout << "\n--- Architectures, untrained throughput: " << name << " (" << g.numNodes() << " nodes, dim " << features.dim
+         << " -> " << hidden << ", " << defaultThreadPool().size() << " threads) ---" << endl;
+    cout << "Random weights: Hits@10 and MRR are not a quality comparison" << endl;
+    cout << left << setw(8) << "layer" << right << setw(12) << "time ms" << setw(14) << "M edges/s" << setw(10) << "Hits@10"
+         << setw(10) << "MRR" << endl;
+
+    auto sageWeights = [](int outputs, int inputs, uint64_t seed)
+    {
+        vector<float> flat = xavierWeights(outputs, 2 * inputs, seed);
+        vector<vector<float>> weights(outputs);
+        for (int o = 0; o < outputs; o++)
+            weights[o].assign(flat.begin() + (size_t)o * 2 * inputs, flat.begin() + (size_t)(o + 1) * 2 * inputs);
+        return weights;
+    };
+    vector<QuantizedSAGELayer> sage = {QuantizedSAGELayer(sageWeights(hidden, features.dim, 1), PRECISION_FP32),
+                                       QuantizedSAGELayer(sageWeights(hidden, hidden, 2), PRECISION_FP32)};
+    GCNLayer gcn1(features.dim, hidden, 3), gcn2(hidden, hidden, 4);
+    gcn2.activation = false;
+    GATLayer gat1(features.dim, hidden / 4, 4, 5), gat2(hidden, hidden / 4, 4, 8);
+    gat2.activation = false;
+
+    auto report = [&](const char *layer, const function<void(FeatureMatrix &)> &forward)
+    {
+        FeatureMatrix out;
+        double ms = timeMs([&]
+                           { forward(out); },
+                           repeats);
+        RankingMetrics ranking = evaluateRanking(out, split.test, &split.train, ranking_options);
+        cout << left << setw(8) << layer << right << fixed << setprecision(2) << setw(12) << ms
+             << setw(14) << 2.0 * split.train.numEdges() / (ms * 1000.0) << setprecision(4) << setw(10) << ranking.hits_at_k
+             << setw(10) << ranking.mrr << endl;
+    };
+    report("sage", [&](FeatureMatrix &out)
+           { out = quantizedInference(split.train, features, sage); });
+    report("gcn", [&](FeatureMatrix &out)
+           {
+               FeatureMatrix hidden_rows;
+               gcn1.forward(split.train, features, hidden_rows);
+               gcn2.forward(split.train, hidden_rows, out); });
+    report("gat", [&](FeatureMatrix &out)
+           {
+               FeatureMatrix hidden_rows;
+               gat1.forward(split.train, features, hidden_rows);
+               gat2.forward(split.train, hidden_rows, out); });
+    cout.unsetf(ios::fixed);
+}
+
+// Final embeddings of two SAGE layers: computeNode() over the per-node maps,
+// one layer at a time as IncrementalSAGE::recomputeAll does, against the
+// layer-wise CSR engine on one thread and on the default pool
+void benchmarkInference(unordered_map<int, vector<int>> &edges, unordered_map<int, vector<vector<float>>> &features,
+                        vector<SAGELayer> &layers, int repeats = 3)
+{
+    Graph graph(edges);
+    CSRGraph g = CSRGraph::fromGraph(graph);
+    FeatureMatrix input = FeatureMatrix::fromFeatureMap(g, features);
+    vector<SAGELayer *> layer_pointers;
+    for (SAGELayer &layer : layers)
+        layer_pointers.push_back(&layer);
+    cout << "\n--- Layer-wise inference: 0.edges (" << g.numNodes() << " nodes, " << layers.size() << " layers) ---" << endl;
+    cout << left << setw(18) << "engine" << right << setw(12) << "time ms" << setw(14) << "buffers KB" << setw(12) << "max diff" << endl;
+
+    unordered_map<int, vector<vector<float>>> reference;
+    double baseline = timeMs([&]
+                             {
+                                 unordered_map<int, vector<vector<float>>> activations = features;
+                                 for (SAGELayer *layer : layer_pointers)
+                                 {
+                                     unordered_map<int, vector<vector<float>>> output = activations;
+                                     for (auto &[node_id, neighbors] : graph.adjList)
+                                         output[node_id] = layer->computeNode(node_id, neighbors, activations);
+                                     activations.swap(output);
+                                 }
+                                 reference.swap(activations); },
+                             repeats);
+    FeatureMatrix expected = FeatureMatrix::fromFeatureMap(g, reference);
+    cout << left << setw(18) << "per-node maps" << right << fixed << setprecision(2) << setw(12) << baseline << setw(14) << "-"
+         << setw(12) << "-" << endl;
+
+    ThreadPool single(1);
+    for (ThreadPool *pool : {&single, &defaultThreadPool()})
+    {
+        LayerwiseInference inference;
+        const FeatureMatrix *out = nullptr;
+        double ms = timeMs([&]
+                           { out = &inference.run(g, input, layer_pointers, *pool); },
+                           repeats);
+        float max_diff = 0.0f;
+        for (size_t i = 0; i < out->data.size(); i++)
+            max_diff = max(max_diff, fabs(out->data[i] - expected.data[i]));
+        string name = "layer-wise x" + to_string(pool->size());
+        cout << left << setw(18) << name << right << fixed << setprecision(2) << setw(12) << ms
+             << setw(14) << 2.0 * input.data.size() * sizeof(float) / 1024.0 << scientific << setw(12) << max_diff
+             << fixed << "   " << baseline / ms << "x" << endl;
+    }
+    cout.unsetf(ios::fixed | ios::scientific);
+}
+
+// One epoch of partition-ordered mini-batches from a memory-mapped copy of
+// the graph: mean of the sampled neighbor rows next to each target's own row.
+// Cold runs drop the file from the page cache first.
+void benchmarkOutOfCore(const string &name, const CSRGraph &g, const FeatureMatrix &features, uint64_t partition_bytes)
+{
+    string path = (filesystem::temp_directory_path() / "graphyte_partitions.bin").string();
+    double write_ms = timeMs([&]
+                             { writePartitionedGraph(path.c_str(), g, features, partition_bytes); });
+    OutOfCoreGraph graph;
+    if (!graph.open(path.c_str()))
+    {
+        return;
+    }
+    cout << "\n--- Out-of-core sampling: " << name << " (" << graph.numNodes() << " nodes, " << graph.numPartitions()
+         << " partitions, " << fixed << setprecision(1) << filesystem::file_size(path) / 1048576.0 << " MB, written in "
+         << write_ms << " ms) ---" << endl;
+    cout << left << setw(22) << "mode" << right << setw(12) << "epoch ms" << setw(10) << "batches" << setw(16) << "checksum" << endl;
+
+    const int dim = graph.dim();
+    auto run = [&](const char *mode, bool prefetch, bool cold)
+    {
+        if (cold)
+        {
+            for (int p = 0; p < graph.numPartitions(); p++)
+                graph.release(p);
+        }
+        OutOfCoreSampler sampler(graph);
+        sampler.prefetch = prefetch;
+        sampler.release_finished = cold;
+        sampler.seed = 7;
+        double checksum = 0.0;
+        size_t batches = 0;
+        vector<float> combined(2 * dim);
+        double ms = timeMs([&]
+                           {
+                               batches = sampler.runEpoch(0, [&](const OutOfCoreBatch &batch)
+                                                          {
+                                   for (size_t i = 0; i < batch.targets.size(); i++)
+                                   {
+                                       fill(combined.begin(), combined.end(), 0.0f);
+                                       int64_t count = batch.offsets[i + 1] - batch.offsets[i];
+                                       for (int64_t j = batch.offsets[i]; j < batch.offsets[i + 1]; j++)
+                                           accumulateFloat(combined.data(), graph.featureRow(batch.neighbors[j]), 1.0f / count, dim);
+                                       accumulateFloat(combined.data() + dim, graph.featureRow(batch.targets[i]), 1.0f, dim);
+                                       for (float x : combined)
+                                           checksum += x;
+                                   } }); });
+        cout << left << setw(22) << mode << right << fixed << setprecision(2) << setw(12) << ms << setw(10) << batches
+             << setprecision(4) << setw(16) << checksum << endl;
+    };
+    run("cold", false, true);
+    run("cold + prefetch", true, true);
+    run("resident", false, false);
+    cout.unsetf(ios::fixed);
+    graph.close();
+    remove(path.c_str());
+}
+
+// One epoch of sampled mini-batches, each target's sampled-neighbor mean and
+// own row put through a dense layer: every phase back to back on one thread,
+// then through the pipelined loader from memory and from a cold
+// memory-mapped partition file. Utilization is each stage's share of its
+// threads' time spent working; "compute wait" is how long compute sat idle.
+void benchmarkPipeline(const string &name, const CSRGraph &g, const FeatureMatrix &features, PipelineOptions options)
+{
+    const int dim = features.dim;
+    vector<float> weights = xavierWeights(dim, 2 * dim, 12);
+    cout << "\n--- Pipelined loader: " << name << " (" << g.numNodes() << " nodes, batch " << options.batch_size << ", fanout "
+         << options.fanout << ", " << options.sampler_threads << "/" << options.gather_threads << "/" << options.compute_threads
+         << " sample/gather/compute threads) ---" << endl;
+    cout << left << setw(18) << "mode" << right << setw(12) << "epoch ms" << setw(10) << "sample" << setw(10) << "gather"
+         << setw(10) << "compute" << setw(16) << "compute wait" << setw(14) << "checksum" << endl;
+
+    vector<double> checksums(max(1, options.compute_threads));
+    vector<vector<float>> scratch(max(1, options.compute_threads), vector<float>(3 * dim));
+    auto compute = [&](const LoaderBatch &batch, int thread)
+    {
+        float *combined = scratch[thread].data(), *out = combined + 2 * dim;
+        for (size_t i = 0; i < batch.targets.size(); i++)
+        {
+            fill(combined, combined + 2 * dim, 0.0f);
+            int64_t count = batch.offsets[i + 1] - batch.offsets[i];
+            for (int64_t j = batch.offsets[i]; j < batch.offsets[i + 1]; j++)
+                accumulateFloat(combined, batch.neighborRow(j, dim), 1.0f / count, dim);
+            copy(batch.targetRow(i, dim), batch.targetRow(i, dim) + dim, combined + dim);
+            for (int o = 0; o < dim; o++)
+            {
+                out[o] = max(0.0f, dotFloat(&weights[(size_t)o * 2 * dim], combined, 2 * dim));
+                checksums[thread] += out[o];
+            }
+        }
+    };
+    auto report = [&](const char *mode, const PipelineStats &stats, double baseline)
+    {
+        double checksum = 0.0;
+        for (double &c : checksums)
+        {
+            checksum += c;
+            c = 0.0;
+        }
+        cout << left << setw(18) << mode << right << fixed << setprecision(2) << setw(12) << stats.wall_ms << setprecision(1);
+        for (const PipelineStageStats &stage : stats.stages)
+            cout << setw(9) << 100.0 * stage.utilization(stats.wall_ms) << "%";
+        cout << setprecision(2) << setw(16) << stats.stages[2].input_wait_ms << setprecision(4) << setw(14) << checksum;
+        if (baseline > 0)
+            cout << setprecision(2) << "   " << baseline / stats.wall_ms << "x";
+        cout << endl;
+    };
+
+    PipelinedLoader loader(g, dim, [&](int64_t r)
+                           { return features.row(r); },
+                           options);
+    PipelineStats serial;
+    serial.stages[0].threads = serial.stages[1].threads = serial.stages[2].threads = 1;
+    LoaderBatch batch;
+    auto start = chrono::steady_clock::now();
+    for (int64_t b = 0; b < loader.numBatches(); b++)
+    {
+        auto t0 = chrono::steady_clock::now();
+        loader.sample(0, b, batch);
+        auto t1 = chrono::steady_clock::now();
+        loader.gather(batch);
+        auto t2 = chrono::steady_clock::now();
+        compute(batch, 0);
+        auto t3 = chrono::steady_clock::now();
+        serial.stages[0].busy_ms += chrono::duration<double, milli>(t1 - t0).count();
+        serial.stages[1].busy_ms += chrono::duration<double, milli>(t2 - t1).count();
+        serial.stages[2].busy_ms += chrono::duration<double, milli>(t3 - t2).count();
+        serial.stages[2].input_wait_ms += chrono::duration<double, milli>(t2 - t0).count();
+    }
+    serial.wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    report("serial", serial, 0);
+    report("pipelined", loader.runEpoch(0, compute), serial.wall_ms);
+
+    string path = (filesystem::temp_directory_path() / "graphyte_pipeline.bin").string();
+    OutOfCoreGraph graph;
+    if (writePartitionedGraph(path.c_str(), g, features, 8 << 20) && graph.open(path.c_str()))
+    {
+        for (int p = 0; p < graph.numPartitions(); p++)
+            graph.release(p);
+        PipelinedLoader mapped(g, dim, [&](int64_t r)
+                               { return graph.featureRow(r); },
+                               options);
+        report("pipelined, mapped", mapped.runEpoch(0, compute), serial.wall_ms);
+        graph.close();
+    }
+    remove(path.c_str());
+    cout.unsetf(ios::fixed);
+}
+
+// Two epochs of sampled batches gathered from a memory-mapped partition file,
+// dropped from the page cache before each epoch, directly and through feature
+// caches holding `capacity_fraction` of the rows with different pinned shares
+// and eviction policies: build time, epoch time, hit rate, the share of
+// lookups served by the pinned region, and evictions in the second epoch
+void benchmarkFeatureCache(const string &name, const CSRGraph &g, const FeatureMatrix &features, PipelineOptions options,
+                           double capacity_fraction = 0.1)
+{
+    string path = (filesystem::temp_directory_path() / "graphyte_cache.bin").string();
+    OutOfCoreGraph graph;
+    if (!writePartitionedGraph(path.c_str(), g, features, 8 << 20) || !graph.open(path.c_str()))
+    {
+        remove(path.c_str());
+        return;
+    }
+    const int dim = features.dim;
+    FeatureCacheOptions cache_options;
+    cache_options.capacity_rows = g.numNodes() * capacity_fraction;
+    cout << "\n--- Feature cache: " << name << " (" << g.numNodes() << " nodes, " << cache_options.capacity_rows
+         << " cached rows, " << fixed << setprecision(1) << cache_options.capacity_rows * dim * sizeof(float) / 1048576.0
+         << " MB) ---" << endl;
+    cout << left << setw(22) << "cache" << right << setw(10) << "build ms" << setw(12) << "epoch 1 ms" << setw(12) << "epoch 2 ms"
+         << setw(10) << "hit rate" << setw(10) << "pinned" << setw(12) << "evictions" << endl;
+
+    vector<double> checksums(max(1, options.compute_threads));
+    auto compute = [&](const LoaderBatch &batch, int thread)
+    {
+        double sum = 0.0;
+        for (float x : batch.features)
+            sum += x;
+        checksums[thread] += sum;
+    };
+    auto evict = [&]
+    {
+        for (int p = 0; p < graph.numPartitions(); p++)
+            graph.release(p);
+    };
+    auto run = [&](const string &label, FeatureCacheOptions *cache_settings)
+    {
+        evict();
+        auto row = [&](int64_t r)
+        { return graph.featureRow(r); };
+        unique_ptr<FeatureCache> cache;
+        double build_ms = timeMs([&]
+                                 {
+                                     if (cache_settings)
+                                         cache.reset(new FeatureCache(g, dim, row, *cache_settings)); });
+        unique_ptr<PipelinedLoader> loader;
+        if (cache)
+            loader.reset(new PipelinedLoader(
+                g, dim, [&](int64_t r, float *out)
+                { cache->copyRow(r, out); },
+                options));
+        else
+            loader.reset(new PipelinedLoader(g, dim, row, options));
+        double first_ms = loader->runEpoch(0, compute).wall_ms;
+        if (cache)
+            cache->resetStats();
+        evict(); // the cache keeps its rows, the store has to read them again
+        double second_ms = loader->runEpoch(1, compute).wall_ms;
+        cout << left << setw(22) << label << right << fixed << setprecision(2) << setw(10) << build_ms << setw(12) << first_ms
+             << setw(12) << second_ms;
+        if (cache)
+        {
+            FeatureCacheStats stats = cache->stats();
+            cout << setprecision(1) << setw(9) << 100.0 * stats.hitRate() << "%" << setw(9)
+                 << 100.0 * stats.pinned_hits / max<uint64_t>(1, stats.lookups()) << "%" << setw(12) << stats.evictions;
+        }
+        else
+        {
+            cout << setw(10) << "-" << setw(10) << "-" << setw(12) << "-";
+        }
+        cout << endl;
+    };
+
+    run("none", nullptr);
+    for (CacheEviction eviction : {EVICT_CLOCK, EVICT_LRU})
+    {
+        for (float pinned : {0.0f, 0.5f, 1.0f})
+        {
+            FeatureCacheOptions settings = cache_options;
+            settings.eviction = eviction;
+            settings.pinned_fraction = pinned;
+            if (pinned == 1.0f && eviction == EVICT_LRU)
+                continue; // nothing to evict
+            string label = pinned == 1.0f ? string("pinned only")
+                                          : string(cacheEvictionName(eviction)) + ", " + to_string((int)(pinned * 100)) + "% pinned";
+            run(label, &settings);
+        }
+    }
+    cout.unsetf(ios::fixed);
+    graph.close();
+    remove(path.c_str());
+}
+
+// Edge cut, balance and halo size of k-way partitions: contiguous id ranges,
+// community order cut into k pieces, and the label-propagation refinement
+void benchmarkPartitioning(const string &name, const CSRGraph &g)
+{
+    cout << "\n--- Partitioning: " << name << " (" << g.numNodes() << " nodes, " << g.numEdges() / 2 << " edges) ---" << endl;
+    cout << left << setw(4) << "k" << setw(14) << "method" << right << setw(10) << "time ms" << setw(12) << "edge cut"
+         << setw(12) << "imbalance" << setw(10) << "halo" << endl;
+    for (int k : {2, 4, 8})
+    {
+        for (int iterations : {-1, 0, 10})
+        {
+            vector<int> part(g.numNodes());
+            double ms = timeMs([&]
+                               {
+                                   if (iterations < 0)
+                                       for (int u = 0; u < g.numNodes(); u++)
+                                           part[u] = (int64_t)u * k / g.numNodes();
+                                   else
+                                       part = partitionGraph(g, k, iterations); });
+            vector<int> sizes(k, 0);
+            for (int p : part)
+                sizes[p]++;
+            size_t halo = 0;
+            for (int p = 0; p < k; p++)
+                halo += buildPartition(g, part, p).numHalo();
+            const char *method = iterations < 0 ? "id ranges" : (iterations == 0 ? "community" : "refined");
+            cout << left << setw(4) << k << setw(14) << method << right << fixed << setprecision(2) << setw(10) << ms
+                 << setprecision(1) << setw(11) << 100.0 * edgeCut(g, part) / max<int64_t>(1, g.numEdges() / 2) << "%"
+                 << setprecision(3) << setw(12) << (double)*max_element(sizes.begin(), sizes.end()) * k / g.numNodes()
+                 << setprecision(1) << setw(9) << 100.0 * halo / g.numNodes() << "%" << endl;
+        }
+    }
+    cout.unsetf(ios::fixed);
+}
+
+#ifndef _WIN32
+// Final embeddings from k worker processes against the in-process engine
+void benchmarkPartitionedInference(unordered_map<int, vector<int>> &edges, unordered_map<int, vector<vector<float>>> &features,
+                                   vector<SAGELayer> &layers)
+{
+    SAGEModel model;
+    model.train_pos_g = Graph(edges);
+    model.feature_matrix = features;
+    model.input_features = features;
+    model.pos_layer1 = layers[0];
+    model.pos_layer2 = layers[1];
+    SAGEModel reference = model;
+    double baseline = timeMs([&]
+                             { reference.computeEmbeddings(); });
+    cout << "\n--- Partitioned inference: 0.edges (" << model.train_pos_g.adjList.size() << " nodes) ---" << endl;
+    cout << left << setw(14) << "workers" << right << setw(12) << "time ms" << setw(12) << "max diff" << endl;
+    cout << left << setw(14) << "in-process" << right << fixed << setprecision(2) << setw(12) << baseline << setw(12) << "-" << endl;
+    for (int k : {1, 2, 4})
+    {
+        SAGEModel partitioned = model;
+        bool ok = true;
+        double ms = timeMs([&]
+                           { ok = computeEmbeddingsPartitioned(partitioned, k); });
+        float max_diff = 0.0f;
+        for (auto &[node_id, embedding] : reference.feature_matrix)
+        {
+            const vector<vector<float>> &other = partitioned.feature_matrix[node_id];
+            if (embedding.size() != other.size())
+                continue;
+            for (size_t i = 0; i < embedding.size(); i++)
+                max_diff = max(max_diff, fabs(embedding[i][0] - other[i][0]));
+        }
+        cout << left << setw(14) << (to_string(k) + " processes") << right << fixed << setprecision(2) << setw(12) << ms
+             << scientific << setw(12) << (ok ? max_diff : NAN) << fixed << "   " << baseline / ms << "x" << endl;
+    }
+    cout.unsetf(ios::fixed | ios::scientific);
+}
+#endif
+
+// Link-prediction training on 0.edges, synchronous, with historical
+// embeddings and asynchronous, on one thread and on the default pool: epochs
+// per second, final loss, how far the weights are from the synchronous
+// single-thread run, staleness (mean age of the historical rows read, or of
+// the asynchronous updates), test metrics of the resulting embeddings against
+// the untrained ones, and the loss of every epoch. The last rows train from a
+// partition file with OutOfCoreTrainer and with one worker process per
+// partition (trainPartitioned). A second table follows the
+// historical-embedding run on one thread epoch by epoch, and a third ranks the
+// synchronous model from each embedding store format.
+void benchmarkTraining(unordered_map<int, vector<int>> &edges, unordered_map<int, vector<vector<float>>> &features,
+                       int epochs = 5)
+{
+    unordered_map<int, vector<int>> train_pos, test_pos, train_neg, test_neg;
+    prepareTrainingData(edges, train_pos, test_pos, train_neg, test_neg);
+    SAGEModel initial(train_pos, train_neg, features);
+    CSRGraph g = CSRGraph::fromGraph(initial.train_pos_g);
+    FeatureMatrix inputs = FeatureMatrix::fromFeatureMap(g, initial.feature_matrix);
+    TrainingOptions options;
+    cout << "\n--- Training: 0.edges (" << g.numNodes() << " nodes, " << epochs << " epochs, " << options.gradient_shards
+         << " shards) ---" << endl;
+    cout << left << setw(14) << "mode" << right << setw(8) << "threads" << setw(12) << "epochs/s" << setw(10) << "loss"
+         << setw(12) << "max diff" << setw(11) << "staleness" << setw(9) << "AUC" << setw(10) << "Hits@10" << "   loss by epoch" << endl;
+
+    auto evaluate = [&](SAGEModel &model)
+    {
+        model.computeEmbeddings();
+        RankingMetrics ranking = model.evaluateRanking(test_pos);
+        cout << setprecision(4) << setw(9) << model.evaluate(test_pos, test_neg) << setw(10) << ranking.hits_at_k;
+    };
+    SAGEModel untrained = initial;
+    cout << left << setw(14) << "untrained" << right << setw(8) << "-" << setw(12) << "-" << setw(10) << "-" << setw(12) << "-"
+         << setw(11) << "-" << fixed;
+    evaluate(untrained);
+    cout << endl;
+
+    ThreadPool single(1);
+    vector<vector<float>> reference;
+    vector<EpochStats> synchronous_epochs, historical_epochs;
+    SAGEModel synchronous_model;
+    const char *modes[3] = {"synchronous", "historical", "asynchronous"};
+    for (int mode = 0; mode < 3; mode++)
+    {
+        for (ThreadPool *pool : {&single, &defaultThreadPool()})
+        {
+            SAGEModel model = initial;
+            options.historical_embeddings = mode == 1;
+            options.asynchronous = mode == 2;
+            SAGETrainer trainer(g, inputs, {&model.pos_layer1, &model.pos_layer2}, model.optimizer_state, model.optimizer_step, options);
+            vector<double> losses;
+            double ms = 0.0, staleness = 0.0;
+            for (int epoch = 0; epoch < epochs; epoch++)
+            {
+                EpochStats stats = trainer.runEpoch(epoch, *pool);
+                losses.push_back(stats.loss);
+                ms += stats.ms;
+                staleness += (mode == 1 ? stats.mean_history_age : stats.mean_staleness) / epochs;
+                if (pool == &single && mode < 2)
+                    (mode == 0 ? synchronous_epochs : historical_epochs).push_back(stats);
+            }
+            trainer.store();
+
+            float max_diff = 0.0f;
+            if (reference.empty())
+                reference = model.pos_layer2.weights;
+            for (size_t i = 0; i < reference.size(); i++)
+                for (size_t j = 0; j < reference[i].size(); j++)
+                    max_diff = max(max_diff, fabs(reference[i][j] - model.pos_layer2.weights[i][j]));
+            cout << left << setw(14) << modes[mode] << right << setw(8) << pool->size()
+                 << fixed << setprecision(2) << setw(12) << epochs * 1000.0 / ms << setprecision(4) << setw(10) << losses.back()
+                 << scientific << setprecision(2) << setw(12) << max_diff << fixed;
+            if (mode > 0)
+                cout << setw(11) << staleness;
+            else
+                cout << setw(11) << "-";
+            evaluate(model);
+            if (mode == 0 && pool == &single)
+                synchronous_model = model;
+            cout << "  ";
+            for (double loss : losses)
+                cout << " " << setprecision(3) << loss;
+            cout << endl;
+        }
+    }
+
+    // The same graph in community order, written to a partition file of about
+    // eight partitions and trained partition by partition
+    string path = (filesystem::temp_directory_path() / "graphyte_training.bin").string();
+    vector<int> order = communityOrder(g);
+    FeatureMatrix ordered = permuteFeatures(inputs, order);
+    OutOfCoreGraph graph;
+    if (writePartitionedGraph(path.c_str(), permuteGraph(g, order), ordered, ordered.data.size() * sizeof(float) / 8 + 1) &&
+        graph.open(path.c_str()))
+    {
+        SAGEModel model = initial;
+        options.historical_embeddings = options.asynchronous = false;
+        OutOfCoreTrainer trainer(graph, {&model.pos_layer1, &model.pos_layer2}, model.optimizer_state, model.optimizer_step, options);
+        vector<double> losses;
+        double ms = 0.0;
+        for (int epoch = 0; epoch < epochs; epoch++)
+        {
+            EpochStats stats = trainer.runEpoch(epoch);
+            losses.push_back(stats.loss);
+            ms += stats.ms;
+        }
+        float max_diff = 0.0f;
+        for (size_t i = 0; i < reference.size(); i++)
+            for (size_t j = 0; j < reference[i].size(); j++)
+                max_diff = max(max_diff, fabs(reference[i][j] - model.pos_layer2.weights[i][j]));
+        cout << left << setw(14) << "out-of-core" << right << setw(8) << defaultThreadPool().size()
+             << fixed << setprecision(2) << setw(12) << epochs * 1000.0 / ms << setprecision(4) << setw(10) << losses.back()
+             << scientific << setprecision(2) << setw(12) << max_diff << fixed << setw(11) << "-";
+        evaluate(model);
+        cout << "  ";
+        for (double loss : losses)
+            cout << " " << setprecision(3) << loss;
+        cout << "   (" << graph.numPartitions() << " partitions)" << endl;
+    }
+    graph.close();
+    remove(path.c_str());
+
+#ifndef _WIN32
+    // One worker process per partition; the threads column is the worker count
+    for (int k : {2, 4})
+    {
+        SAGEModel model = initial;
+        options.verbose = false;
+        vector<double> losses;
+        double ms = timeMs([&]
+                           { losses = trainPartitioned(model, k, epochs, options); });
+        if (losses.empty())
+            continue;
+        float max_diff = 0.0f;
+        for (size_t i = 0; i < reference.size(); i++)
+            for (size_t j = 0; j < reference[i].size(); j++)
+                max_diff = max(max_diff, fabs(reference[i][j] - model.pos_layer2.weights[i][j]));
+        cout << left << setw(14) << "partitioned" << right << setw(8) << k
+             << fixed << setprecision(2) << setw(12) << epochs * 1000.0 / ms << setprecision(4) << setw(10) << losses.back()
+             << scientific << setprecision(2) << setw(12) << max_diff << fixed << setw(11) << "-";
+        evaluate(model);
+        cout << "  ";
+        for (double loss : losses)
+            cout << " " << setprecision(3) << loss;
+        cout << endl;
+    }
+#endif
+
+    cout << left << setw(8) << "epoch" << right << setw(10) << "ms" << setw(10) << "speedup" << setw(10) << "refresh" << setw(12)
+         << "fresh rows" << setw(12) << "historical" << setw(10) << "stale" << setw(10) << "mean age" << setw(10) << "max age" << endl;
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        const EpochStats &stats = historical_epochs[epoch];
+        cout << left << setw(8) << epoch + 1 << right << setprecision(2) << setw(10) << stats.ms << setw(9)
+             << synchronous_epochs[epoch].ms / stats.ms << "x" << setw(10) << stats.history_ms << setw(12) << stats.fresh_rows
+             << setw(12) << stats.history_reads << setw(10) << stats.stale_recomputes << setw(10) << stats.mean_history_age
+             << setw(10) << stats.max_history_age << endl;
+    }
+
+    // The synchronous model ranked again from each embedding store after the
+    // float map is released, as main.cpp does; Hits@10 should stay near fp32
+    cout << left << setw(8) << "format" << right << setw(10) << "Hits@10" << setw(10) << "MRR" << setw(12) << "vs fp32" << endl;
+    double fp32_hits = 0.0;
+    for (EmbeddingFormat format : {EMBEDDING_FP32, EMBEDDING_FP16, EMBEDDING_INT8})
+    {
+        SAGEModel model = synchronous_model;
+        model.quantizeEmbeddings(format, true);
+        RankingMetrics ranking = model.evaluateRanking(test_pos);
+        if (format == EMBEDDING_FP32)
+            fp32_hits = ranking.hits_at_k;
+        cout << left << setw(8) << embeddingFormatName(format) << right << setprecision(4) << setw(10) << ranking.hits_at_k
+             << setw(10) << ranking.mrr << showpos << setw(12) << ranking.hits_at_k - fp32_hits << noshowpos;
+        if (fabs(ranking.hits_at_k - fp32_hits) > 0.02)
+            cout << "   (drifted from fp32)";
+        cout << endl;
+    }
+    cout.unsetf(ios::fixed | ios::scientific);
+}
+
+// Layer-wise inference on the default pool against per-node pinned pools
+// with each activation placement: time, share of row reads served from the
+// reading node's memory, where the pages ended up, and the kernel's count of
+// pages allocated off-node during the run
+void benchmarkNuma(const string &name, const CSRGraph &g, const FeatureMatrix &features, vector<SAGELayer> &layers)
+{
+    NumaExecutor executor;
+    vector<SAGELayer *> layer_pointers;
+    for (SAGELayer &layer : layers)
+        layer_pointers.push_back(&layer);
+    cout << "\n--- NUMA placement: " << name << " (" << g.numNodes() << " nodes, " << executor.numNodes() << " NUMA nodes, "
+         << defaultThreadPool().size() << " threads) ---" << endl;
+    cout << left << setw(14) << "placement" << right << setw(12) << "time ms" << setw(14) << "local reads" << setw(12)
+         << "off-node" << "   pages per node" << endl;
+
+    auto report = [&](const char *placement, double ms, const FeatureMatrix &out, const NumaCounters &before)
+    {
+        NumaCounters after = NumaCounters::read(executor.topology);
+        NumaAccessReport access = numaAccessReport(executor, g, out);
+        cout << left << setw(14) << placement << right << fixed << setprecision(2) << setw(12) << ms;
+        if (access.available)
+        {
+            cout << setprecision(1) << setw(13) << 100.0 * access.local_reads << "%" << setw(12)
+                 << after.other_node - before.other_node << "  ";
+            for (double share : access.page_share)
+                cout << " " << setprecision(2) << share;
+        }
+        else
+        {
+            cout << setw(14) << "n/a" << setw(12) << "n/a";
+        }
+        cout << endl;
+    };
+
+    LayerwiseInference inference;
+    NumaCounters before = NumaCounters::read(executor.topology);
+    double ms = timeMs([&]
+                       { inference.run(g, features, layer_pointers); });
+    report("default pool", ms, inference.buffers[layers.size() % 2], before);
+    for (NumaPlacement placement : {NUMA_FIRST_TOUCH, NUMA_INTERLEAVE, NUMA_PARTITIONED})
+    {
+        LayerwiseInference pinned;
+        before = NumaCounters::read(executor.topology);
+        ms = timeMs([&]
+                    { numaInference(executor, pinned, g, features, layer_pointers, placement); });
+        report(numaPlacementName(placement), ms, pinned.buffers[layers.size() % 2], before);
+    }
+    cout.unsetf(ios::fixed);
+}
+
+void runBenchmarks(unordered_map<int, vector<int>> &edges, unordered_map<int, vector<vector<float>>> &features)
+{
+    cout << "\n=== Benchmarks ===" << endl;
+    CSRGraph g = CSRGraph::fromGraph(Graph(edges));
+    benchmarkOrderings("0.edges", g, FeatureMatrix::fromFeatureMap(g, features), 50);
+
+    CSRGraph synthetic = generateCommunityGraph(200000, 16, 200, 1);
+    benchmarkOrderings("synthetic", synthetic, randomFeatures(synthetic.numNodes(), 64, 2));
+
+    benchmarkAggregators("0.edges", g, FeatureMatrix::fromFeatureMap(g, features), RankingOptions(), 20);
+    RankingOptions sampled;
+    sampled.num_sampled_negatives = 100;
+    benchmarkAggregators("synthetic", synthetic, randomFeatures(synthetic.numNodes(), 64, 2), sampled);
+
+    benchmarkArchitectures("0.edges", g, FeatureMatrix::fromFeatureMap(g, features), 64, RankingOptions(), 20);
+    CSRGraph architecture_graph = generateCommunityGraph(50000, 16, 200, 8);
+    benchmarkArchitectures("synthetic", architecture_graph, randomFeatures(architecture_graph.numNodes(), 64, 9), 64, sampled);
+
+    benchmarkPartitioning("0.edges", g);
+    benchmarkPartitioning("synthetic", synthetic);
+
+    benchmarkOutOfCore("synthetic", synthetic, randomFeatures(synthetic.numNodes(), 64, 2), 8 << 20);
+    benchmarkPipeline("synthetic", synthetic, randomFeatures(synthetic.numNodes(), 64, 2), PipelineOptions());
+    CSRGraph power_law = generatePowerLawGraph(200000, 16, 2.1, 13);
+    benchmarkFeatureCache("power law", power_law, randomFeatures(power_law.numNodes(), 64, 14), PipelineOptions());
+
+    benchmarkAUC(5000000, 3);
+
+    benchmarkRandom(1 << 24, 15);
+
+    benchmarkRanking(100000, 64, 4);
+
+    // Weights of two freshly initialized layers, as used by SAGEModel
+    vector<SAGELayer> layers(2);
+    vector<vector<vector<float>>> layer_weights;
+    for (SAGELayer &layer : layers)
+    {
+        layer.init(Graph(), features);
+        layer_weights.push_back(layer.weights);
+    }
+    benchmarkInference(edges, features, layers);
+#ifndef _WIN32
+    benchmarkPartitionedInference(edges, features, layers);
+#endif
+    CSRGraph numa_graph = generateCommunityGraph(5000, 16, 200, 10);
+    benchmarkNuma("synthetic", numa_graph, randomFeatures(numa_graph.numNodes(), 223, 11), layers);
+    benchmarkTraining(edges, features);
+    benchmarkQuantization("0.edges", g, FeatureMatrix::fromFeatureMap(g, features), layer_weights, 20);
+    CSRGraph quantization_graph = generateCommunityGraph(20000, 16, 200, 5);
+    benchmarkQuantization("synthetic", quantization_graph, randomFeatures(quantization_graph.numNodes(), 223, 6), layer_weights);
+
+    benchmarkEmbeddingStore("0.feat", features, 223, 347);
+    unordered_map<int, vector<vector<float>>> synthetic_embeddings;
+    randomFeatures(quantization_graph.numNodes(), 223, 7).toFeatureMap(quantization_graph, synthetic_embeddings);
+    benchmarkEmbeddingStore("synthetic", synthetic_embeddings, 223, 200);
+}
+
+#endif
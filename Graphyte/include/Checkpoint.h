@@ -0,0 +1,458 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include "Model.h"
+
+#ifdef _WIN32
+// Keep windows.h from clashing with raylib (Rectangle, CloseWindow, DrawText...)
+#define NOGDI
+#define NOUSER
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// On-disk layout (native endianness, every section 64-byte aligned):
+//   CheckpointHeader
+//   layer weights   num_layers x weight_rows x weight_cols floats
+//   optimizer state optimizer_size floats of Adam moments; the step count is
+//                   in the header
+//   node ids        num_nodes ints, sorted ascending
+//   embeddings      num_nodes x embedding_dim floats, row i belongs to node_ids[i]
+const char CHECKPOINT_MAGIC[8] = {'G', 'R', 'P', 'H', 'C', 'K', 'P', 'T'};
+const uint32_t CHECKPOINT_VERSION = 2;
+const uint64_t CHECKPOINT_ALIGNMENT = 64;
+
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_layers;
+    uint32_t weight_rows;
+    uint32_t weight_cols;
+    uint32_t embedding_dim;
+    uint32_t reserved;
+    uint64_t num_nodes;
+    uint64_t optimizer_size;
+    uint64_t weights_offset;
+    uint64_t optimizer_offset;
+    uint64_t node_ids_offset;
+    uint64_t embeddings_offset;
+    uint64_t file_size;
+    uint64_t optimizer_step;
+};
+
+uint64_t alignCheckpointOffset(uint64_t offset)
+{
+    return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+}
+
+CheckpointHeader makeCheckpointHeader(uint32_t num_layers, uint32_t weight_rows, uint32_t weight_cols,
+                                      uint32_t embedding_dim, uint64_t num_nodes, uint64_t optimizer_size)
+{
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.num_layers = num_layers;
+    header.weight_rows = weight_rows;
+    header.weight_cols = weight_cols;
+    header.embedding_dim = embedding_dim;
+    header.num_nodes = num_nodes;
+    header.optimizer_size = optimizer_size;
+
+    header.weights_offset = alignCheckpointOffset(sizeof(CheckpointHeader));
+    header.optimizer_offset = alignCheckpointOffset(header.weights_offset + (uint64_t)num_layers * weight_rows * weight_cols * sizeof(float));
+    header.node_ids_offset = alignCheckpointOffset(header.optimizer_offset + optimizer_size * sizeof(float));
+    header.embeddings_offset = alignCheckpointOffset(header.node_ids_offset + num_nodes * sizeof(int));
+    header.file_size = header.embeddings_offset + num_nodes * embedding_dim * sizeof(float);
+    return header;
+}
+
+bool validCheckpointHeader(const CheckpointHeader &header, uint64_t actual_size)
+{
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0)
+    {
+        cout << "Error: not a checkpoint file" << endl;
+        return false;
+    }
+    if (header.version != CHECKPOINT_VERSION)
+    {
+        cout << "Error: unsupported checkpoint version " << header.version << endl;
+        return false;
+    }
+    CheckpointHeader expected = makeCheckpointHeader(header.num_layers, header.weight_rows, header.weight_cols,
+                                                     header.embedding_dim, header.num_nodes, header.optimizer_size);
+    // Every section offset is read back as stored, so each must be where the
+    // layout puts it, not just the ones that end the file
+    if (expected.file_size != header.file_size || header.file_size != actual_size ||
+        expected.weights_offset != header.weights_offset || expected.optimizer_offset != header.optimizer_offset ||
+        expected.node_ids_offset != header.node_ids_offset || expected.embeddings_offset != header.embeddings_offset)
+    {
+        cout << "Error: checkpoint is truncated or corrupt" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Writes the padding up to `offset` followed by `bytes` bytes of `data`
+bool writeCheckpointSection(FILE *file, uint64_t &position, uint64_t offset, const void *data, size_t bytes)
+{
+    static const char zeros[CHECKPOINT_ALIGNMENT] = {0};
+    if (offset - position > 0 && fwrite(zeros, 1, offset - position, file) != offset - position)
+    {
+        return false;
+    }
+    position = offset;
+    if (bytes > 0 && fwrite(data, 1, bytes, file) != bytes)
+    {
+        return false;
+    }
+    position += bytes;
+    return true;
+}
+
+bool syncAndClose(FILE *file)
+{
+    bool ok = fflush(file) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(file)) == 0;
+#else
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    return fclose(file) == 0 && ok;
+}
+
+// Renames `from` over `to` and makes the rename itself durable: the directory
+// entry is flushed too, so a crash cannot bring back the old file
+bool replaceFile(const string &from, const string &to)
+{
+#ifdef _WIN32
+    if (!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        cout << "Error replacing " << to << ": error " << GetLastError() << endl;
+        return false;
+    }
+    return true;
+#else
+    if (::rename(from.c_str(), to.c_str()) != 0)
+    {
+        cout << "Error replacing " << to << ": " << strerror(errno) << endl;
+        return false;
+    }
+    string directory = filesystem::path(to).parent_path().string();
+    int dir_fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    bool ok = dir_fd >= 0 && fsync(dir_fd) == 0;
+    if (dir_fd >= 0)
+    {
+        ::close(dir_fd);
+    }
+    if (!ok)
+    {
+        cout << "Error syncing the directory of " << to << ": " << strerror(errno) << endl;
+    }
+    return ok;
+#endif
+}
+
+// Serializes the model to `<path>.tmp` and renames it over `path`, so readers
+// only ever see the previous checkpoint or the complete new one
+bool saveCheckpoint(const char *path, SAGEModel &model)
+{
+    vector<const SAGELayer *> layers = {&model.pos_layer1, &model.pos_layer2};
+    uint32_t rows = layers[0]->weights.size();
+    uint32_t cols = rows > 0 ? layers[0]->weights[0].size() : 0;
+    for (const SAGELayer *layer : layers)
+    {
+        for (const vector<float> &row : layer->weights)
+        {
+            if (layer->weights.size() != rows || row.size() != cols)
+            {
+                cout << "Error: checkpoints need layers of equal shape" << endl;
+                return false;
+            }
+        }
+    }
+    // The embedding table is as wide as the widest feature row. A model whose
+    // float embeddings were released is saved from its (dequantized) store.
+    const EmbeddingStore &store = model.embedding_store;
+    const bool from_store = model.featuresReleased();
+    int dim = from_store ? store.dim : 0;
+    vector<int> node_ids = from_store ? store.node_ids : vector<int>();
+    for (auto &[node_id, features] : model.feature_matrix)
+    {
+        dim = max(dim, (int)features.size());
+        node_ids.push_back(node_id);
+    }
+    sort(node_ids.begin(), node_ids.end());
+
+    CheckpointHeader header = makeCheckpointHeader(layers.size(), rows, cols, dim, node_ids.size(), model.optimizer_state.size());
+    header.optimizer_step = model.optimizer_step;
+
+    string tmp_path = string(path) + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "wb");
+    if (!file)
+    {
+        cout << "Error opening file" << endl;
+        return false;
+    }
+
+    uint64_t position = 0;
+    bool ok = writeCheckpointSection(file, position, 0, &header, sizeof(header));
+
+    vector<float> row_buffer(cols);
+    for (uint64_t l = 0; ok && l < layers.size(); l++)
+    {
+        for (uint32_t i = 0; ok && i < rows; i++)
+        {
+            copy(layers[l]->weights[i].begin(), layers[l]->weights[i].end(), row_buffer.begin());
+            uint64_t offset = header.weights_offset + ((l * rows + i) * cols) * sizeof(float);
+            ok = writeCheckpointSection(file, position, offset, row_buffer.data(), cols * sizeof(float));
+        }
+    }
+    ok = ok && writeCheckpointSection(file, position, header.optimizer_offset, model.optimizer_state.data(), model.optimizer_state.size() * sizeof(float));
+    ok = ok && writeCheckpointSection(file, position, header.node_ids_offset, node_ids.data(), node_ids.size() * sizeof(int));
+
+    // Nodes whose feature rows were never filled in are stored as zero vectors
+    vector<float> embedding(dim);
+    for (size_t n = 0; ok && n < node_ids.size(); n++)
+    {
+        if (from_store)
+        {
+            embedding = store.dequantizeRow(store.rowOf(node_ids[n]));
+        }
+        else
+        {
+            auto &features = model.feature_matrix[node_ids[n]];
+            for (int i = 0; i < dim; i++)
+            {
+                embedding[i] = (features.size() == (size_t)dim) ? features[i][0] : 0.0f;
+            }
+        }
+        uint64_t offset = header.embeddings_offset + n * dim * sizeof(float);
+        ok = writeCheckpointSection(file, position, offset, embedding.data(), dim * sizeof(float));
+    }
+
+    ok = syncAndClose(file) && ok;
+    if (!ok)
+    {
+        cout << "Error writing checkpoint" << endl;
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+    if (!replaceFile(tmp_path, path))
+    {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Read-only, zero-copy view of a checkpoint file. All pointers point straight
+// into the mapping and stay valid until close() or destruction.
+class CheckpointView
+{
+public:
+    CheckpointHeader header;
+    const float *weights = nullptr;
+    const float *optimizer_state = nullptr;
+    const int *node_ids = nullptr;
+    const float *embeddings = nullptr;
+
+    CheckpointView() {}
+    CheckpointView(const CheckpointView &) = delete;
+    CheckpointView &operator=(const CheckpointView &) = delete;
+    ~CheckpointView() { close(); }
+
+    bool open(const char *path)
+    {
+        close();
+        uint64_t size = 0;
+#ifdef _WIN32
+        file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_handle == INVALID_HANDLE_VALUE)
+        {
+            cout << "Error opening file" << endl;
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file_handle, &file_size);
+        size = file_size.QuadPart;
+        if (size >= sizeof(CheckpointHeader))
+        {
+            mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping_handle != NULL)
+            {
+                data = (const char *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+            }
+        }
+#else
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            cout << "Error opening file" << endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+        {
+            size = st.st_size;
+        }
+        if (size >= sizeof(CheckpointHeader))
+        {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            data = (mapped == MAP_FAILED) ? nullptr : (const char *)mapped;
+        }
+#endif
+        mapped_size = size;
+        if (!data)
+        {
+            cout << "Error mapping checkpoint" << endl;
+            close();
+            return false;
+        }
+
+        memcpy(&header, data, sizeof(header));
+        if (!validCheckpointHeader(header, size))
+        {
+            close();
+            return false;
+        }
+        weights = (const float *)(data + header.weights_offset);
+        optimizer_state = (const float *)(data + header.optimizer_offset);
+        node_ids = (const int *)(data + header.node_ids_offset);
+        embeddings = (const float *)(data + header.embeddings_offset);
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping_handle != NULL)
+            CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(file_handle);
+        mapping_handle = NULL;
+        file_handle = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap((void *)data, mapped_size);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        mapped_size = 0;
+        weights = optimizer_state = embeddings = nullptr;
+        node_ids = nullptr;
+    }
+
+    bool isOpen() const { return data != nullptr; }
+
+    uint64_t numNodes() const { return header.num_nodes; }
+
+    int dim() const { return header.embedding_dim; }
+
+    const float *layerWeights(int layer) const
+    {
+        return weights + (uint64_t)layer * header.weight_rows * header.weight_cols;
+    }
+
+    // Row of `node_id` in the embedding table, or -1 if the node is unknown
+    int64_t rowOf(int node_id) const
+    {
+        const int *end = node_ids + header.num_nodes;
+        const int *it = lower_bound(node_ids, end, node_id);
+        return (it != end && *it == node_id) ? it - node_ids : -1;
+    }
+
+    const float *embedding(int node_id) const
+    {
+        int64_t row = rowOf(node_id);
+        return row < 0 ? nullptr : embeddings + row * header.embedding_dim;
+    }
+
+private:
+    const char *data = nullptr;
+    uint64_t mapped_size = 0;
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = NULL;
+#else
+    int fd = -1;
+#endif
+};
+
+// Copies a checkpoint back into a model, e.g. to resume training
+bool loadCheckpoint(const char *path, SAGEModel &model)
+{
+    CheckpointView view;
+    if (!view.open(path))
+    {
+        return false;
+    }
+    const CheckpointHeader &header = view.header;
+    vector<SAGELayer *> layers = {&model.pos_layer1, &model.pos_layer2};
+    if (header.num_layers != layers.size())
+    {
+        cout << "Error: checkpoint has " << header.num_layers << " layers, model has " << layers.size() << endl;
+        return false;
+    }
+    // Layers that were already initialized must match the stored shape
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        const vector<vector<float>> &weights = layers[l]->weights;
+        if (!weights.empty() && (weights.size() != header.weight_rows || weights[0].size() != header.weight_cols))
+        {
+            cout << "Error: checkpoint weights are " << header.weight_rows << " x " << header.weight_cols << ", layer "
+                 << l + 1 << " is " << weights.size() << " x " << weights[0].size() << endl;
+            return false;
+        }
+    }
+
+    for (uint32_t l = 0; l < header.num_layers; l++)
+    {
+        const float *w = view.layerWeights(l);
+        layers[l]->weights.assign(header.weight_rows, vector<float>(header.weight_cols));
+        for (uint32_t i = 0; i < header.weight_rows; i++)
+        {
+            copy(w + (uint64_t)i * header.weight_cols, w + (uint64_t)(i + 1) * header.weight_cols, layers[l]->weights[i].begin());
+        }
+    }
+
+    model.optimizer_state.assign(view.optimizer_state, view.optimizer_state + header.optimizer_size);
+    model.optimizer_step = header.optimizer_step;
+
+    for (uint64_t n = 0; n < header.num_nodes; n++)
+    {
+        const float *row = view.embeddings + n * header.embedding_dim;
+        vector<vector<float>> features(header.embedding_dim, vector<float>(1, 0.0f));
+        for (uint32_t i = 0; i < header.embedding_dim; i++)
+        {
+            features[i][0] = row[i];
+        }
+        model.feature_matrix[view.node_ids[n]] = features;
+    }
+    return true;
+}
+
+#endif
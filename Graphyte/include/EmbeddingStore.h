@@ -0,0 +1,265 @@
+#ifndef EMBEDDING_STORE_H
+#define EMBEDDING_STORE_H
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "Quantize.h"
+using namespace std;
+
+enum EmbeddingFormat
+{
+    EMBEDDING_FP32,
+    EMBEDDING_FP16,
+    EMBEDDING_INT8, // uint8 codes with a scale and zero point per vector
+};
+
+const char *embeddingFormatName(EmbeddingFormat format)
+{
+    switch (format)
+    {
+    case EMBEDDING_FP16:
+        return "fp16";
+    case EMBEDDING_INT8:
+        return "int8";
+    default:
+        return "fp32";
+    }
+}
+
+// Compact table of node embeddings for scoring. Vectors stay in their stored
+// form: dot products run on the fp16 values or the uint8 codes directly, and
+// each row's norm is precomputed once, so a cosine score costs a single pass
+// over two rows. Rows can be rewritten or appended one at a time, so an
+// incremental refresh only re-encodes the nodes it changed.
+class EmbeddingStore
+{
+public:
+    EmbeddingFormat format = EMBEDDING_FP32;
+    int dim = 0;
+    vector<int> node_ids; // row r holds node_ids[r]; sorted when built, updates append
+    vector<float> fp32;
+    vector<uint16_t> fp16;
+    vector<uint8_t> codes;
+    vector<float> scales;          // int8 only
+    vector<int32_t> zero_points;   // int8 only
+    vector<int32_t> code_sums;     // int8 only, sum of the row's codes
+    vector<float> norms;           // of the stored (dequantized) vectors
+
+    EmbeddingStore() {}
+
+    // Nodes whose feature vector does not have `dim` rows are left out
+    EmbeddingStore(const unordered_map<int, vector<vector<float>>> &features, EmbeddingFormat format, int dim = 223)
+        : format(format), dim(dim)
+    {
+        vector<int> ids;
+        for (auto &[node_id, feature] : features)
+        {
+            if (feature.size() == (size_t)dim)
+            {
+                ids.push_back(node_id);
+            }
+        }
+        sort(ids.begin(), ids.end());
+        reserve(ids.size());
+        vector<float> row(dim);
+        for (int node_id : ids)
+        {
+            const vector<vector<float>> &feature = features.at(node_id);
+            for (int i = 0; i < dim; i++)
+            {
+                row[i] = feature[i][0];
+            }
+            appendRow(node_id, row.data());
+        }
+        sortIndex();
+    }
+
+    // From `count` flat rows, e.g. a checkpoint's embedding table
+    EmbeddingStore(const int *ids, const float *rows, size_t count, int dim, EmbeddingFormat format)
+        : format(format), dim(dim)
+    {
+        reserve(count);
+        for (size_t r = 0; r < count; r++)
+        {
+            appendRow(ids[r], rows + r * dim);
+        }
+        sortIndex();
+    }
+
+    // Re-encodes the node's row, appending it if the node is new. Vectors
+    // without `dim` rows are ignored, as in the constructor.
+    void update(int node_id, const vector<vector<float>> &feature)
+    {
+        if (feature.size() != (size_t)dim)
+        {
+            return;
+        }
+        vector<float> row(dim);
+        for (int i = 0; i < dim; i++)
+        {
+            row[i] = feature[i][0];
+        }
+        int r = rowOf(node_id);
+        if (r < 0)
+        {
+            appendRow(node_id, row.data());
+            // New nodes are rare, so shifting the index to keep it sorted is fine
+            id_order.insert(lower_bound(id_order.begin(), id_order.end(), node_id, [&](int row, int id)
+                                        { return node_ids[row] < id; }),
+                            node_ids.size() - 1);
+        }
+        else
+        {
+            encodeRow(r, row.data());
+        }
+    }
+
+    size_t size() const { return node_ids.size(); }
+
+    bool empty() const { return node_ids.empty(); }
+
+    // Everything the store has allocated, the row index included
+    size_t bytes() const
+    {
+        return (node_ids.capacity() + id_order.capacity()) * sizeof(int) + fp32.capacity() * sizeof(float) +
+               fp16.capacity() * sizeof(uint16_t) + codes.capacity() + (scales.capacity() + norms.capacity()) * sizeof(float) +
+               (zero_points.capacity() + code_sums.capacity()) * sizeof(int32_t);
+    }
+
+    // -1 when the node has no embedding
+    int rowOf(int node_id) const
+    {
+        auto it = lower_bound(id_order.begin(), id_order.end(), node_id, [&](int row, int id)
+                              { return node_ids[row] < id; });
+        return it != id_order.end() && node_ids[*it] == node_id ? *it : -1;
+    }
+
+    float dotRows(int a, int b) const
+    {
+        size_t offset_a = (size_t)a * dim, offset_b = (size_t)b * dim;
+        switch (format)
+        {
+        case EMBEDDING_FP16:
+            return dotHalf(&fp16[offset_a], &fp16[offset_b], dim);
+        case EMBEDDING_INT8:
+        {
+            // sum (qa - za)(qb - zb), expanded so the inner loop is a plain
+            // integer dot product of the codes
+            int64_t products = dotUInt8(&codes[offset_a], &codes[offset_b], dim);
+            int64_t centered = products - (int64_t)zero_points[b] * code_sums[a] - (int64_t)zero_points[a] * code_sums[b] +
+                               (int64_t)dim * zero_points[a] * zero_points[b];
+            return scales[a] * scales[b] * centered;
+        }
+        default:
+            return dotFloat(&fp32[offset_a], &fp32[offset_b], dim);
+        }
+    }
+
+    float cosineRows(int a, int b) const
+    {
+        float denominator = norms[a] * norms[b];
+        return denominator == 0 ? 0.0f : dotRows(a, b) / denominator;
+    }
+
+    // 0 when either node has no embedding, as SAGEModel::cosine_similarity
+    float cosine(int u, int v) const
+    {
+        int a = rowOf(u), b = rowOf(v);
+        return (a < 0 || b < 0) ? 0.0f : cosineRows(a, b);
+    }
+
+    vector<float> dequantizeRow(int r) const
+    {
+        vector<float> row(dim);
+        size_t offset = (size_t)r * dim;
+        for (int i = 0; i < dim; i++)
+        {
+            if (format == EMBEDDING_FP32)
+                row[i] = fp32[offset + i];
+            else if (format == EMBEDDING_FP16)
+                row[i] = halfToFloat(fp16[offset + i]);
+            else
+                row[i] = scales[r] * ((int)codes[offset + i] - zero_points[r]);
+        }
+        return row;
+    }
+
+private:
+    vector<int> id_order; // rows sorted by node id, searched by rowOf()
+
+    void reserve(size_t rows)
+    {
+        node_ids.reserve(rows);
+        id_order.reserve(rows);
+        norms.reserve(rows);
+        if (format == EMBEDDING_FP32)
+            fp32.reserve(rows * dim);
+        else if (format == EMBEDDING_FP16)
+            fp16.reserve(rows * dim);
+        else
+        {
+            codes.reserve(rows * dim);
+            scales.reserve(rows);
+            zero_points.reserve(rows);
+            code_sums.reserve(rows);
+        }
+    }
+
+    void appendRow(int node_id, const float *row)
+    {
+        size_t r = node_ids.size();
+        node_ids.push_back(node_id);
+        norms.push_back(0.0f);
+        if (format == EMBEDDING_FP32)
+            fp32.resize((r + 1) * dim);
+        else if (format == EMBEDDING_FP16)
+            fp16.resize((r + 1) * dim);
+        else
+        {
+            codes.resize((r + 1) * dim);
+            scales.push_back(0.0f);
+            zero_points.push_back(0);
+            code_sums.push_back(0);
+        }
+        encodeRow(r, row);
+    }
+
+    void sortIndex()
+    {
+        id_order.resize(node_ids.size());
+        for (size_t r = 0; r < id_order.size(); r++)
+            id_order[r] = r;
+        stable_sort(id_order.begin(), id_order.end(), [&](int a, int b)
+                    { return node_ids[a] < node_ids[b]; });
+    }
+
+    void encodeRow(size_t r, const float *row)
+    {
+        size_t offset = r * dim;
+        if (format == EMBEDDING_FP32)
+        {
+            copy(row, row + dim, &fp32[offset]);
+        }
+        else if (format == EMBEDDING_FP16)
+        {
+            for (int i = 0; i < dim; i++)
+                fp16[offset + i] = floatToHalf(row[i]);
+        }
+        else
+        {
+            int zero_point;
+            quantizeUInt8(row, &codes[offset], dim, scales[r], zero_point);
+            zero_points[r] = zero_point;
+            int32_t sum = 0;
+            for (int i = 0; i < dim; i++)
+                sum += codes[offset + i];
+            code_sums[r] = sum;
+        }
+        norms[r] = sqrt(max(0.0f, dotRows(r, r)));
+    }
+};
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef FEATURE_CACHE_H
+#define FEATURE_CACHE_H
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <functional>
+#include <algorithm>
+#include "Graph.h"
+using namespace std;
+
+enum CacheEviction
+{
+    EVICT_CLOCK,
+    EVICT_LRU
+};
+
+const char *cacheEvictionName(CacheEviction eviction)
+{
+    return eviction == EVICT_LRU ? "LRU" : "CLOCK";
+}
+
+struct FeatureCacheOptions
+{
+    size_t capacity_rows = 0;      // pinned plus evictable rows
+    float pinned_fraction = 0.5f;  // share of the capacity pinned to the highest-degree rows
+    int min_admission_degree = 2;  // rows of lower degree are read through without being cached
+    CacheEviction eviction = EVICT_CLOCK;
+    int shards = 16;               // pieces of the evictable region, each locked for misses
+};
+
+struct FeatureCacheStats
+{
+    uint64_t pinned_hits = 0;
+    uint64_t hits = 0; // evictable region
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+
+    uint64_t lookups() const { return pinned_hits + hits + misses; }
+    double hitRate() const { return lookups() ? double(pinned_hits + hits) / lookups() : 0.0; }
+};
+
+// Row cache in front of a slower feature store, typically a memory-mapped
+// OutOfCoreGraph. Sampling reads a row about as often as it has neighbors,
+// so the highest-degree rows are copied once into a contiguous pinned region
+// that is read without locking. The rest of the capacity is evictable (CLOCK
+// or LRU), split into shards by row; only misses take a shard's lock. Hits
+// copy a slot without locking and check its version before and after, so a
+// slot rewritten by a concurrent miss is detected and the row is read from the
+// store instead. Rows are therefore copied out rather than returned by
+// pointer.
+class FeatureCache
+{
+public:
+    FeatureCacheOptions options;
+
+    FeatureCache(const CSRGraph &g, int dim, function<const float *(int64_t)> source,
+                 FeatureCacheOptions options = FeatureCacheOptions())
+        : options(options), dim(dim), source(move(source)), degrees(g.numNodes())
+    {
+        const int n = g.numNodes();
+        for (int r = 0; r < n; r++)
+            degrees[r] = g.degree(r);
+        size_t capacity = min<size_t>(options.capacity_rows, n);
+        size_t num_pinned = min(capacity, (size_t)(capacity * max(0.0f, min(1.0f, options.pinned_fraction))));
+
+        vector<int> by_degree(n);
+        iota(by_degree.begin(), by_degree.end(), 0);
+        partial_sort(by_degree.begin(), by_degree.begin() + num_pinned, by_degree.end(), [&](int a, int b)
+                     { return degrees[a] > degrees[b] || (degrees[a] == degrees[b] && a < b); });
+        pinned_index.assign(n, -1);
+        pinned.resize(num_pinned * dim);
+        for (size_t i = 0; i < num_pinned; i++)
+        {
+            pinned_index[by_degree[i]] = i;
+            const float *row = this->source(by_degree[i]);
+            copy(row, row + dim, &pinned[i * dim]);
+        }
+
+        const int num_shards = max(1, options.shards);
+        size_t evictable = capacity - num_pinned;
+        slot_of = vector<atomic<int>>(n);
+        for (int r = 0; r < n; r++)
+            slot_of[r].store(-1, memory_order_relaxed);
+        for (int s = 0; s < num_shards; s++)
+        {
+            shards.emplace_back(new Shard());
+            Shard &shard = *shards.back();
+            size_t slots = evictable / num_shards + (s < (int)(evictable % num_shards));
+            shard.rows = vector<atomic<float>>(slots * dim);
+            shard.slots = vector<Slot>(slots);
+        }
+    }
+
+    size_t pinnedRows() const { return pinned.size() / dim; }
+
+    size_t bytes() const
+    {
+        size_t total = pinned.size() * sizeof(float);
+        for (const auto &shard : shards)
+            total += shard->rows.size() * sizeof(atomic<float>);
+        return total;
+    }
+
+    // Copies the `dim` features of `row` into `out`. Safe from several threads.
+    void copyRow(int64_t row, float *out)
+    {
+        Shard &shard = *shards[row % shards.size()];
+        if (pinned_index[row] >= 0)
+        {
+            const float *cached = &pinned[(size_t)pinned_index[row] * dim];
+            copy(cached, cached + dim, out);
+            shard.pinned_hits.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+
+        bool admit = degrees[row] >= options.min_admission_degree && !shard.slots.empty();
+        if (admit && readSlot(shard, row, out))
+        {
+            shard.hits.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+
+        // Miss: read the store without holding the lock, then insert
+        const float *stored = source(row);
+        copy(stored, stored + dim, out);
+        shard.misses.fetch_add(1, memory_order_relaxed);
+        if (!admit)
+            return;
+        lock_guard<mutex> lock(shard.shard_mutex);
+        shard.tick.fetch_add(1, memory_order_relaxed);
+        if (slot_of[row].load(memory_order_relaxed) < 0)
+        {
+            int slot = victim(shard);
+            int64_t evicted = shard.slots[slot].row.load(memory_order_relaxed);
+            if (evicted >= 0)
+            {
+                slot_of[evicted].store(-1, memory_order_relaxed);
+                shard.evictions++;
+            }
+            // Odd version while the slot is rewritten, so readers retry
+            uint32_t version = shard.slots[slot].version.load(memory_order_relaxed);
+            shard.slots[slot].version.store(version + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            atomic<float> *cached = &shard.rows[(size_t)slot * dim];
+            for (int i = 0; i < dim; i++)
+                cached[i].store(out[i], memory_order_relaxed);
+            shard.slots[slot].row.store(row, memory_order_relaxed);
+            shard.slots[slot].version.store(version + 2, memory_order_release);
+            slot_of[row].store(slot, memory_order_release);
+            inserted(shard, slot);
+        }
+    }
+
+    FeatureCacheStats stats()
+    {
+        FeatureCacheStats total;
+        for (auto &shard : shards)
+        {
+            lock_guard<mutex> lock(shard->shard_mutex);
+            total.pinned_hits += shard->pinned_hits.load(memory_order_relaxed);
+            total.hits += shard->hits.load(memory_order_relaxed);
+            total.misses += shard->misses.load(memory_order_relaxed);
+            total.evictions += shard->evictions;
+        }
+        return total;
+    }
+
+    void resetStats()
+    {
+        for (auto &shard : shards)
+        {
+            lock_guard<mutex> lock(shard->shard_mutex);
+            shard->pinned_hits.store(0, memory_order_relaxed);
+            shard->hits.store(0, memory_order_relaxed);
+            shard->misses.store(0, memory_order_relaxed);
+            shard->evictions = 0;
+        }
+    }
+
+private:
+    // A hit reads all of a slot's bookkeeping from one cache line
+    struct alignas(32) Slot
+    {
+        atomic<uint32_t> version{0}; // odd while the slot is being rewritten
+        atomic<int64_t> row{-1};     // -1 for a free slot
+        atomic<uint64_t> used{0};    // CLOCK reference bit, or LRU tick of the last hit
+        uint64_t queued = 0;         // LRU tick the slot entered the queue at
+    };
+    struct Shard
+    {
+        mutex shard_mutex;        // taken by admitted misses only
+        vector<atomic<float>> rows; // slots x dim
+        vector<Slot> slots;
+        atomic<uint64_t> tick{0}; // admitted misses so far, the LRU clock
+        size_t hand = 0;
+        list<int> lru;            // LRU queue, most recently queued first
+        atomic<uint64_t> pinned_hits{0};
+        atomic<uint64_t> hits{0};
+        atomic<uint64_t> misses{0};
+        uint64_t evictions = 0;
+    };
+
+    const int dim;
+    function<const float *(int64_t)> source;
+    vector<int> degrees;
+    vector<int> pinned_index; // read-only after construction
+    vector<float> pinned;
+    vector<atomic<int>> slot_of; // slot in the row's shard, written under that shard's lock
+    vector<unique_ptr<Shard>> shards;
+
+    // Copies the row's slot into `out` without locking. Fails when the row
+    // is not cached or its slot was rewritten during the copy; the version
+    // read before and after the copy tells.
+    bool readSlot(Shard &shard, int64_t row, float *out)
+    {
+        int slot = slot_of[row].load(memory_order_acquire);
+        if (slot < 0)
+            return false;
+        uint32_t version = shard.slots[slot].version.load(memory_order_acquire);
+        if ((version & 1) || shard.slots[slot].row.load(memory_order_relaxed) != row)
+            return false;
+        const atomic<float> *cached = &shard.rows[(size_t)slot * dim];
+        for (int i = 0; i < dim; i++)
+            out[i] = cached[i].load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (shard.slots[slot].version.load(memory_order_relaxed) != version)
+            return false;
+
+        // Only written when it changes, so hot rows do not bounce the line
+        uint64_t used = options.eviction == EVICT_CLOCK ? 1 : shard.tick.load(memory_order_relaxed);
+        if (shard.slots[slot].used.load(memory_order_relaxed) != used)
+            shard.slots[slot].used.store(used, memory_order_relaxed);
+        return true;
+    }
+
+    // Marks a slot that just received a new row as used
+    void inserted(Shard &shard, int slot)
+    {
+        if (options.eviction == EVICT_CLOCK)
+        {
+            shard.slots[slot].used.store(1, memory_order_relaxed);
+            return;
+        }
+        uint64_t now = shard.tick.load(memory_order_relaxed);
+        shard.slots[slot].used.store(now, memory_order_relaxed);
+        shard.slots[slot].queued = now;
+        shard.lru.push_front(slot);
+    }
+
+    // Slot for a new row: a free one if any, otherwise the eviction victim.
+    // LRU hits only record the tick, so the queue is reordered lazily: a
+    // slot at the tail that was hit since it was queued goes back to the
+    // front instead of being evicted.
+    int victim(Shard &shard)
+    {
+        const int slots = shard.slots.size();
+        if (options.eviction == EVICT_LRU)
+        {
+            if ((int)shard.lru.size() < slots)
+                return shard.lru.size();
+            while (true)
+            {
+                int slot = shard.lru.back();
+                shard.lru.pop_back();
+                uint64_t used = shard.slots[slot].used.load(memory_order_relaxed);
+                if (used == shard.slots[slot].queued)
+                    return slot;
+                shard.slots[slot].queued = used;
+                shard.lru.push_front(slot);
+            }
+        }
+        while (true)
+        {
+            int slot = shard.hand;
+            shard.hand = (shard.hand + 1) % slots;
+            if (shard.slots[slot].row.load(memory_order_relaxed) < 0 || !shard.slots[slot].used.load(memory_order_relaxed))
+                return slot;
+            shard.slots[slot].used.store(0, memory_order_relaxed);
+        }
+    }
+};
+
+#endif
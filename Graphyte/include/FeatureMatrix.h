@@ -0,0 +1,97 @@
+#ifndef FEATURE_MATRIX_H
+#define FEATURE_MATRIX_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "Graph.h"
+using namespace std;
+
+// Dense row-major node features, row r belonging to CSR row r. Unlike the
+// per-node maps used by SAGELayer, neighbor rows are plain offsets into one
+// buffer, so the memory order of the rows is the CSR row order.
+class FeatureMatrix
+{
+public:
+    int rows = 0;
+    int dim = 0;
+    vector<float> data;
+
+    FeatureMatrix() {}
+    FeatureMatrix(int rows, int dim) : rows(rows), dim(dim), data((size_t)rows * dim, 0.0f) {}
+
+    float *row(int r) { return data.data() + (size_t)r * dim; }
+
+    const float *row(int r) const { return data.data() + (size_t)r * dim; }
+
+    // Gathers the per-node feature map into CSR row order. Nodes without a
+    // well-formed feature vector get a zero row.
+    static FeatureMatrix fromFeatureMap(const CSRGraph &g, const unordered_map<int, vector<vector<float>>> &features, int dim = 223)
+    {
+        FeatureMatrix m(g.numNodes(), dim);
+        for (int r = 0; r < g.numNodes(); r++)
+        {
+            auto it = features.find(g.node_ids[r]);
+            if (it == features.end() || it->second.size() != (size_t)dim)
+            {
+                continue;
+            }
+            float *dst = m.row(r);
+            for (int i = 0; i < dim; i++)
+            {
+                dst[i] = it->second[i][0];
+            }
+        }
+        return m;
+    }
+
+    // Scatters rows back into the per-node layout under their original ids
+    void toFeatureMap(const CSRGraph &g, unordered_map<int, vector<vector<float>>> &features) const
+    {
+        for (int r = 0; r < rows; r++)
+        {
+            vector<vector<float>> feature(dim, vector<float>(1, 0.0f));
+            const float *src = row(r);
+            for (int i = 0; i < dim; i++)
+            {
+                feature[i][0] = src[i];
+            }
+            features[g.node_ids[r]] = feature;
+        }
+    }
+};
+
+// Mean of the neighbor rows for every row of `g`; isolated rows get zeros
+void aggregateMean(const CSRGraph &g, const FeatureMatrix &in, FeatureMatrix &out)
+{
+    const int dim = in.dim;
+    if (out.rows != g.numNodes() || out.dim != dim)
+    {
+        out = FeatureMatrix(g.numNodes(), dim);
+    }
+    for (int r = 0; r < g.numNodes(); r++)
+    {
+        float *dst = out.row(r);
+        fill(dst, dst + dim, 0.0f);
+        int degree = g.degree(r);
+        if (degree == 0)
+        {
+            continue;
+        }
+        for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+        {
+            const float *src = in.row(*it);
+            for (int i = 0; i < dim; i++)
+            {
+                dst[i] += src[i];
+            }
+        }
+        float scale = 1.0f / degree;
+        for (int i = 0; i < dim; i++)
+        {
+            dst[i] *= scale;
+        }
+    }
+}
+
+#endif
@@ -2,7 +2,9 @@
 #define GRAPH_H
 
 #include <vector>
+#include <cstdint>
 #include <unordered_map>
+#include <algorithm>
 using namespace std;
 
 class Graph
@@ -24,7 +26,174 @@ public:
             adjList[key] = value;
         }
     }
+
+    // Adds the undirected edge u-v, ignoring duplicates. Returns true if it was new.
+    bool addEdge(int u, int v)
+    {
+        vector<int> &u_list = adjList[u];
+        if (find(u_list.begin(), u_list.end(), v) != u_list.end())
+        {
+            return false;
+        }
+        u_list.push_back(v);
+        adjList[v].push_back(u);
+        return true;
+    }
+
+    // Removes the undirected edge u-v. Returns true if it existed.
+    bool removeEdge(int u, int v)
+    {
+        auto u_it = adjList.find(u);
+        auto v_it = adjList.find(v);
+        if (u_it == adjList.end() || v_it == adjList.end())
+        {
+            return false;
+        }
+        bool removed = eraseNeighbor(u_it->second, v);
+        eraseNeighbor(v_it->second, u);
+        return removed;
+    }
+
+private:
+    static bool eraseNeighbor(vector<int> &neighbors, int node)
+    {
+        auto it = find(neighbors.begin(), neighbors.end(), node);
+        if (it == neighbors.end())
+        {
+            return false;
+        }
+        *it = neighbors.back();
+        neighbors.pop_back();
+        return true;
+    }
 };
 
 
+// Compressed sparse row view of an undirected graph. Rows are dense indices
+// 0..n-1 assigned in ascending node-id order; node_ids maps them back.
+class CSRGraph
+{
+public:
+    vector<int> node_ids;
+    vector<int64_t> offsets; // size n + 1
+    vector<int> neighbors;   // row indices
+    // Rows sorted by node id; empty while node_ids itself is sorted (i.e. until
+    // the graph has been reordered)
+    vector<int> id_order;
+
+    CSRGraph() : offsets(1, 0) {}
+
+    int numNodes() const { return node_ids.size(); }
+
+    int64_t numEdges() const { return neighbors.size(); }
+
+    int degree(int row) const { return offsets[row + 1] - offsets[row]; }
+
+    const int *neighborsBegin(int row) const { return neighbors.data() + offsets[row]; }
+
+    const int *neighborsEnd(int row) const { return neighbors.data() + offsets[row + 1]; }
+
+    // Row of `node_id`, or -1 if the node is not in the graph
+    int rowOf(int node_id) const
+    {
+        if (id_order.empty())
+        {
+            auto it = lower_bound(node_ids.begin(), node_ids.end(), node_id);
+            return (it != node_ids.end() && *it == node_id) ? it - node_ids.begin() : -1;
+        }
+        auto it = lower_bound(id_order.begin(), id_order.end(), node_id, [&](int row, int id)
+                              { return node_ids[row] < id; });
+        return (it != id_order.end() && node_ids[*it] == node_id) ? *it : -1;
+    }
+
+    // Duplicate entries (0.edges lists both directions) and self-loops are dropped
+    static CSRGraph fromGraph(const Graph &g)
+    {
+        CSRGraph csr;
+        csr.node_ids.reserve(g.adjList.size());
+        for (auto &[node_id, adjacent] : g.adjList)
+        {
+            csr.node_ids.push_back(node_id);
+            for (int neighbor : adjacent)
+            {
+                csr.node_ids.push_back(neighbor);
+            }
+        }
+        sort(csr.node_ids.begin(), csr.node_ids.end());
+        csr.node_ids.erase(unique(csr.node_ids.begin(), csr.node_ids.end()), csr.node_ids.end());
+
+        csr.offsets.assign(csr.node_ids.size() + 1, 0);
+        for (int row = 0; row < csr.numNodes(); row++)
+        {
+            auto it = g.adjList.find(csr.node_ids[row]);
+            size_t start = csr.neighbors.size();
+            if (it != g.adjList.end())
+            {
+                for (int neighbor : it->second)
+                {
+                    if (neighbor != csr.node_ids[row])
+                    {
+                        csr.neighbors.push_back(csr.rowOf(neighbor));
+                    }
+                }
+            }
+            sort(csr.neighbors.begin() + start, csr.neighbors.end());
+            csr.neighbors.erase(unique(csr.neighbors.begin() + start, csr.neighbors.end()), csr.neighbors.end());
+            csr.offsets[row + 1] = csr.neighbors.size();
+        }
+        return csr;
+    }
+
+    // Builds a symmetric CSR over the given rows from (row, row) pairs, each
+    // undirected edge listed once. Rows keep the numbering of `node_ids`.
+    static CSRGraph fromRowEdges(const vector<int> &node_ids, const vector<pair<int, int>> &edges)
+    {
+        CSRGraph csr;
+        csr.node_ids = node_ids;
+        csr.offsets.assign(node_ids.size() + 1, 0);
+        for (auto &[u, v] : edges)
+        {
+            csr.offsets[u + 1]++;
+            csr.offsets[v + 1]++;
+        }
+        for (size_t row = 0; row < node_ids.size(); row++)
+        {
+            csr.offsets[row + 1] += csr.offsets[row];
+        }
+        csr.neighbors.resize(csr.offsets.back());
+        vector<int64_t> cursor(csr.offsets.begin(), csr.offsets.end() - 1);
+        for (auto &[u, v] : edges)
+        {
+            csr.neighbors[cursor[u]++] = v;
+            csr.neighbors[cursor[v]++] = u;
+        }
+        for (size_t row = 0; row < node_ids.size(); row++)
+        {
+            sort(csr.neighbors.begin() + csr.offsets[row], csr.neighbors.begin() + csr.offsets[row + 1]);
+        }
+        return csr;
+    }
+
+    // Adjacency-list form used by SAGEModel. Rows without edges are kept only
+    // when `keep_isolated` is set.
+    unordered_map<int, vector<int>> toAdjList(bool keep_isolated = true) const
+    {
+        unordered_map<int, vector<int>> adj;
+        for (int row = 0; row < numNodes(); row++)
+        {
+            if (degree(row) == 0 && !keep_isolated)
+            {
+                continue;
+            }
+            vector<int> &list = adj[node_ids[row]];
+            list.reserve(degree(row));
+            for (const int *it = neighborsBegin(row); it != neighborsEnd(row); it++)
+            {
+                list.push_back(node_ids[*it]);
+            }
+        }
+        return adj;
+    }
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,233 @@
+#ifndef GRAPH_LAYERS_H
+#define GRAPH_LAYERS_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "Quantize.h"
+#include "ThreadPool.h"
+#include "Random.h"
+using namespace std;
+
+// Inference-only GCN and GAT layers over the same CSR graph and feature rows
+// as QuantizedSAGELayer, so the architectures can be compared on equal terms.
+// Both treat every node as its own neighbor (A + I) without materializing the
+// self loops.
+
+// Xavier-uniform rows x cols matrix, row-major
+vector<float> xavierWeights(int rows, int cols, uint64_t seed)
+{
+    vector<float> weights((size_t)rows * cols);
+    float bound = sqrt(6.0f / (rows + cols));
+    CounterRandom(seed).fillUniform(weights.data(), weights.size(), -bound, bound);
+    return weights;
+}
+
+// out = in W^T for `weights` of outputs x in.dim, four rows at a time so they
+// share weight loads
+void transformRows(const FeatureMatrix &in, const vector<float> &weights, int outputs, FeatureMatrix &out,
+                   ThreadPool &pool = defaultThreadPool())
+{
+    out = FeatureMatrix(in.rows, outputs);
+    const int64_t num_groups = (in.rows + 3) / 4;
+    pool.parallelFor(0, num_groups, [&](int64_t first, int64_t last)
+                     {
+                         float y[4];
+                         const float *x[4];
+                         for (int64_t group = first; group < last; group++)
+                         {
+                             int64_t r0 = group * 4;
+                             int count = min<int64_t>(4, in.rows - r0);
+                             // A short group repeats its last row
+                             for (int v = 0; v < 4; v++)
+                                 x[v] = in.row(r0 + min(v, count - 1));
+                             for (int o = 0; o < outputs; o++)
+                             {
+                                 dotFloat4(&weights[(size_t)o * in.dim], x, in.dim, y);
+                                 for (int v = 0; v < count; v++)
+                                     out.row(r0 + v)[o] = y[v];
+                             }
+                         } },
+                     16);
+}
+
+// Softmax of `values` within each segment [offsets[s], offsets[s + 1])
+void segmentSoftmax(const vector<int64_t> &offsets, vector<float> &values, ThreadPool &pool = defaultThreadPool())
+{
+    pool.parallelFor(0, (int64_t)offsets.size() - 1, [&](int64_t first, int64_t last)
+                     {
+                         for (int64_t s = first; s < last; s++)
+                         {
+                             float *begin = values.data() + offsets[s];
+                             float *end = values.data() + offsets[s + 1];
+                             if (begin == end)
+                                 continue;
+                             float largest = *max_element(begin, end);
+                             float sum = 0.0f;
+                             for (float *v = begin; v != end; v++)
+                             {
+                                 *v = exp(*v - largest);
+                                 sum += *v;
+                             }
+                             float scale = 1.0f / sum;
+                             for (float *v = begin; v != end; v++)
+                                 *v *= scale;
+                         } },
+                     256);
+}
+
+// Kipf & Welling: out = relu(D^-1/2 (A + I) D^-1/2 X W). The dense transform
+// runs on whichever side of the propagation has the narrower rows.
+class GCNLayer
+{
+public:
+    int input_dim = 0;
+    int output_dim = 0;
+    vector<float> weights; // output_dim x input_dim, row-major
+    bool activation = true; // relu; usually off for the last layer
+
+    GCNLayer() {}
+
+    GCNLayer(int input_dim, int output_dim, uint64_t seed)
+        : input_dim(input_dim), output_dim(output_dim), weights(xavierWeights(output_dim, input_dim, seed)) {}
+
+    // out[r] = sum over u in N(r) + {r} of in[u] / sqrt((deg r + 1)(deg u + 1))
+    static void propagate(const CSRGraph &g, const FeatureMatrix &in, FeatureMatrix &out, ThreadPool &pool = defaultThreadPool())
+    {
+        const int dim = in.dim;
+        vector<float> norms(g.numNodes());
+        for (int r = 0; r < g.numNodes(); r++)
+        {
+            norms[r] = 1.0f / sqrt(g.degree(r) + 1.0f);
+        }
+        out = FeatureMatrix(g.numNodes(), dim);
+        pool.parallelFor(0, g.numNodes(), [&](int64_t first, int64_t last)
+                         {
+                             for (int64_t r = first; r < last; r++)
+                             {
+                                 float *acc = out.row(r);
+                                 accumulateFloat(acc, in.row(r), norms[r] * norms[r], dim);
+                                 for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                                     accumulateFloat(acc, in.row(*it), norms[r] * norms[*it], dim);
+                             } },
+                         256);
+    }
+
+    void forward(const CSRGraph &g, const FeatureMatrix &in, FeatureMatrix &out, ThreadPool &pool = defaultThreadPool()) const
+    {
+        FeatureMatrix hidden;
+        if (output_dim <= input_dim)
+        {
+            transformRows(in, weights, output_dim, hidden, pool);
+            propagate(g, hidden, out, pool);
+        }
+        else
+        {
+            propagate(g, in, hidden, pool);
+            transformRows(hidden, weights, output_dim, out, pool);
+        }
+        if (activation)
+        {
+            for (float &x : out.data)
+                x = max(0.0f, x);
+        }
+    }
+};
+
+// Velickovic et al.: per head, z = W x and for an edge from u into r
+//   e(r, u) = leaky_relu(a_dst . z_r + a_src . z_u)
+// softmax-normalized over N(r) + {r}, then out_r = elu(sum alpha(r, u) z_u).
+// Heads are concatenated, so rows come out heads * head_dim wide.
+class GATLayer
+{
+public:
+    int input_dim = 0;
+    int head_dim = 0;
+    int heads = 1;
+    vector<float> weights;           // heads * head_dim x input_dim, row-major
+    vector<float> attention_src;     // heads * head_dim
+    vector<float> attention_dst;     // heads * head_dim
+    float negative_slope = 0.2f;
+    bool activation = true;          // elu; usually off for the last layer
+
+    GATLayer() {}
+
+    GATLayer(int input_dim, int head_dim, int heads, uint64_t seed)
+        : input_dim(input_dim), head_dim(head_dim), heads(heads),
+          weights(xavierWeights(heads * head_dim, input_dim, seed)),
+          attention_src(xavierWeights(heads, head_dim, seed + 1)),
+          attention_dst(xavierWeights(heads, head_dim, seed + 2)) {}
+
+    int outputDim() const { return heads * head_dim; }
+
+    // Attention weights of head `head`, laid out like the CSR rows with the
+    // self loop in front: row r owns [offsets[r] + r, offsets[r + 1] + r + 1)
+    vector<float> attention(const CSRGraph &g, const FeatureMatrix &z, int head, ThreadPool &pool = defaultThreadPool()) const
+    {
+        const float *a_src = &attention_src[(size_t)head * head_dim];
+        const float *a_dst = &attention_dst[(size_t)head * head_dim];
+        vector<float> src_scores(g.numNodes()), dst_scores(g.numNodes());
+        pool.parallelFor(0, g.numNodes(), [&](int64_t first, int64_t last)
+                         {
+                             for (int64_t r = first; r < last; r++)
+                             {
+                                 const float *z_r = z.row(r) + head * head_dim;
+                                 src_scores[r] = dotFloat(a_src, z_r, head_dim);
+                                 dst_scores[r] = dotFloat(a_dst, z_r, head_dim);
+                             } },
+                         1024);
+
+        vector<int64_t> offsets(g.numNodes() + 1);
+        for (int r = 0; r <= g.numNodes(); r++)
+        {
+            offsets[r] = g.offsets[r] + r;
+        }
+        auto leakyRelu = [&](float x)
+        { return x > 0.0f ? x : negative_slope * x; };
+        vector<float> scores(offsets.back());
+        pool.parallelFor(0, g.numNodes(), [&](int64_t first, int64_t last)
+                         {
+                             for (int64_t r = first; r < last; r++)
+                             {
+                                 float *out = &scores[offsets[r]];
+                                 *out++ = leakyRelu(dst_scores[r] + src_scores[r]);
+                                 for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                                     *out++ = leakyRelu(dst_scores[r] + src_scores[*it]);
+                             } },
+                         1024);
+        segmentSoftmax(offsets, scores, pool);
+        return scores;
+    }
+
+    void forward(const CSRGraph &g, const FeatureMatrix &in, FeatureMatrix &out, ThreadPool &pool = defaultThreadPool()) const
+    {
+        FeatureMatrix z;
+        transformRows(in, weights, outputDim(), z, pool);
+        out = FeatureMatrix(g.numNodes(), outputDim());
+        for (int head = 0; head < heads; head++)
+        {
+            vector<float> alpha = attention(g, z, head, pool);
+            const int column = head * head_dim;
+            pool.parallelFor(0, g.numNodes(), [&](int64_t first, int64_t last)
+                             {
+                                 for (int64_t r = first; r < last; r++)
+                                 {
+                                     const float *weight = &alpha[g.offsets[r] + r];
+                                     float *acc = out.row(r) + column;
+                                     accumulateFloat(acc, z.row(r) + column, *weight++, head_dim);
+                                     for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                                         accumulateFloat(acc, z.row(*it) + column, *weight++, head_dim);
+                                 } },
+                             256);
+        }
+        if (activation)
+        {
+            for (float &x : out.data)
+                x = x > 0.0f ? x : expm1(x);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "Graph.h"
+#include "Layer.h"
+#include "Model.h"
+using namespace std;
+
+// Keeps every layer's activations of a trained SAGEModel so that edge updates
+// only recompute the nodes they can reach. A node's layer-l output depends on
+// its (l-1)-hop neighborhood, so the dirty set starts at the endpoints of the
+// changed edges and grows by one hop per layer.
+class IncrementalSAGE
+{
+public:
+    Graph g;
+    // activations[0] holds the input features, activations[l] the output of layer l
+    vector<unordered_map<int, vector<vector<float>>>> activations;
+
+    IncrementalSAGE(SAGEModel &model) : model(model)
+    {
+        g.copyGraph(model.train_pos_g);
+        layers = {&model.pos_layer1, &model.pos_layer2};
+        activations.resize(layers.size() + 1);
+        activations[0] = model.input_features;
+    }
+
+    // Full forward over the whole graph; must run once before refresh()
+    void recomputeAll()
+    {
+        for (size_t l = 0; l < layers.size(); l++)
+        {
+            auto &input = activations[l];
+            auto &output = activations[l + 1];
+            output = input;
+            for (auto &[node_id, neighbors] : g.adjList)
+            {
+                output[node_id] = layers[l]->computeNode(node_id, neighbors, input);
+            }
+        }
+        publish(activations.back());
+        changed.clear();
+    }
+
+    bool insertEdge(int u, int v)
+    {
+        if (!g.addEdge(u, v))
+        {
+            return false;
+        }
+        markChanged(u, v);
+        return true;
+    }
+
+    bool removeEdge(int u, int v)
+    {
+        if (!g.removeEdge(u, v))
+        {
+            return false;
+        }
+        markChanged(u, v);
+        return true;
+    }
+
+    // Recomputes only the affected neighborhood of the edges changed since the
+    // last refresh. Returns the number of node updates performed across layers.
+    size_t refresh()
+    {
+        size_t updates = 0;
+        unordered_set<int> dirty = changed;
+        for (size_t l = 0; l < layers.size(); l++)
+        {
+            if (l > 0)
+            {
+                dirty = expand(dirty);
+            }
+            auto &input = activations[l];
+            auto &output = activations[l + 1];
+            for (int node_id : dirty)
+            {
+                auto it = g.adjList.find(node_id);
+                if (it == g.adjList.end())
+                {
+                    output[node_id] = input[node_id];
+                    continue;
+                }
+                output[node_id] = layers[l]->computeNode(node_id, it->second, input);
+                updates++;
+            }
+        }
+
+        // `dirty` is now the set whose final embeddings changed
+        unordered_map<int, vector<vector<float>>> fresh;
+        for (int node_id : dirty)
+        {
+            fresh[node_id] = activations.back()[node_id];
+        }
+        publish(fresh);
+        changed.clear();
+        return updates;
+    }
+
+    size_t pendingChanges() const { return changed.size(); }
+
+private:
+    SAGEModel &model;
+    vector<SAGELayer *> layers;
+    unordered_set<int> changed;
+
+    void markChanged(int u, int v)
+    {
+        changed.insert(u);
+        changed.insert(v);
+        // New nodes enter with zero features, matching loadFeatures' layout
+        for (int node_id : {u, v})
+        {
+            if (activations[0].find(node_id) == activations[0].end())
+            {
+                activations[0][node_id] = vector<vector<float>>(223, vector<float>(1, 0.0f));
+            }
+        }
+    }
+
+    unordered_set<int> expand(const unordered_set<int> &nodes)
+    {
+        unordered_set<int> result = nodes;
+        for (int node_id : nodes)
+        {
+            auto it = g.adjList.find(node_id);
+            if (it != g.adjList.end())
+            {
+                result.insert(it->second.begin(), it->second.end());
+            }
+        }
+        return result;
+    }
+
+    // Final embeddings are what getPrediction() and checkpoints read; only the
+    // changed rows of the model's embedding store are re-encoded
+    void publish(const unordered_map<int, vector<vector<float>>> &embeddings)
+    {
+        for (auto &[node_id, embedding] : embeddings)
+        {
+            model.setEmbedding(node_id, embedding);
+        }
+    }
+};
+
+#endif
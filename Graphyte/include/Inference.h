@@ -0,0 +1,96 @@
+#ifndef INFERENCE_H
+#define INFERENCE_H
+
+#include <vector>
+#include <algorithm>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "Aggregators.h"
+#include "Layer.h"
+#include "ThreadPool.h"
+using namespace std;
+
+// Full-graph SAGE inference one layer at a time. Each layer runs over every
+// row in parallel node chunks and is materialized once before the next layer
+// starts, so shared neighbors are never recomputed and the total cost is
+// O(layers * edges * dim). Activations ping-pong between two row buffers that
+// are kept across runs; pool-MLP layers also hold their transformed inputs
+// while they run.
+class LayerwiseInference
+{
+public:
+    int chunk_rows = 256; // rows per parallel task
+    FeatureMatrix buffers[2];
+
+    // Output of the last layer, row r for CSR row r. Matches calling
+    // computeNode() on every node, layer by layer, over the feature map.
+    const FeatureMatrix &run(const CSRGraph &g, const FeatureMatrix &features, const vector<SAGELayer *> &layers,
+                             ThreadPool &pool = defaultThreadPool())
+    {
+        buffers[0] = features;
+        for (size_t l = 0; l < layers.size(); l++)
+        {
+            const FeatureMatrix &in = buffers[l % 2];
+            FeatureMatrix &out = buffers[(l + 1) % 2];
+            if (out.rows != in.rows || out.dim != in.dim)
+            {
+                out = FeatureMatrix(in.rows, in.dim);
+            }
+            runLayer(g, in, out, *layers[l], pool);
+        }
+        return buffers[layers.size() % 2];
+    }
+
+    // One layer for CSR rows [first_row, last_row) (all rows by default);
+    // `out` must already have the right shape. Pool-MLP layers transform all
+    // of `in` unless the caller passes that transform as `pool_rows`.
+    void runLayer(const CSRGraph &g, const FeatureMatrix &in, FeatureMatrix &out, SAGELayer &layer,
+                  ThreadPool &pool = defaultThreadPool(), int64_t first_row = 0, int64_t last_row = -1,
+                  const FeatureMatrix *pool_rows = nullptr)
+    {
+        last_row = last_row < 0 ? g.numNodes() : last_row;
+        switch (layer.aggregator)
+        {
+        case AGGREGATE_SUM:
+            runLayer(g, in, in, out, layer, SumAggregator(), pool, first_row, last_row);
+            break;
+        case AGGREGATE_MAX:
+            runLayer(g, in, in, out, layer, MaxAggregator(), pool, first_row, last_row);
+            break;
+        case AGGREGATE_POOL:
+            if (pool_rows)
+                runLayer(g, *pool_rows, in, out, layer, layer.pool_aggregator, pool, first_row, last_row);
+            else
+                runLayer(g, layer.pool_aggregator.transform(in, pool), in, out, layer, layer.pool_aggregator, pool,
+                         first_row, last_row);
+            break;
+        default:
+            runLayer(g, in, in, out, layer, MeanAggregator(), pool, first_row, last_row);
+            break;
+        }
+    }
+
+private:
+    // `neighbor_rows` are what the aggregator reads (the input, or its MLP
+    // transform for pool layers); `in` supplies each node's own row
+    template <class Aggregator>
+    void runLayer(const CSRGraph &g, const FeatureMatrix &neighbor_rows, const FeatureMatrix &in, FeatureMatrix &out,
+                  SAGELayer &layer, const Aggregator &aggregator, ThreadPool &pool, int64_t first_row, int64_t last_row)
+    {
+        const int dim = neighbor_rows.dim;
+        pool.parallelFor(first_row, last_row, [&](int64_t first, int64_t last)
+                         {
+                             vector<float> acc(dim);
+                             for (int64_t r = first; r < last; r++)
+                             {
+                                 aggregator.begin(acc.data(), dim);
+                                 for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                                     aggregator.add(acc.data(), neighbor_rows.row(*it), dim);
+                                 aggregator.finish(acc.data(), dim, g.degree(r));
+                                 layer.outputRow(acc.data(), in.row(r), out.row(r));
+                             } },
+                         chunk_rows);
+    }
+};
+
+#endif
@@ -3,7 +3,17 @@
 
 #include <iostream>
 #include <math.h>
+#include <atomic>
 #include "Graph.h"
+#include "Aggregators.h"
+#include "Random.h"
+
+// Seeds for layers that were not given one: 1, 2, 3, ... in construction order
+uint64_t nextLayerSeed()
+{
+    static atomic<uint64_t> next{1};
+    return next.fetch_add(1);
+}
 
 class SAGELayer
 {
@@ -11,6 +21,11 @@ public:
     Graph g;
     unordered_map<int, vector<vector<float>>> feature_matrix;
     vector<vector<float>> weights;
+    // Set before init(); the pool MLP is only created for AGGREGATE_POOL
+    AggregatorType aggregator = AGGREGATE_MEAN;
+    PoolAggregator pool_aggregator;
+    // Set before init() for reproducible weights; 0 takes nextLayerSeed()
+    uint64_t seed = 0;
 
     SAGELayer() {}
     void init(Graph pos_g, unordered_map<int, vector<vector<float>>> &feature_matrix)
@@ -20,7 +35,15 @@ public:
         {
             this->feature_matrix[key] = value;
         }
+        if (seed == 0)
+        {
+            seed = nextLayerSeed();
+        }
         weights = Xavier_initialization(223, 223);
+        if (aggregator == AGGREGATE_POOL)
+        {
+            pool_aggregator = PoolAggregator(223, seed, 1);
+        }
     }
 
     void forward()
@@ -30,47 +53,121 @@ public:
 
         for (auto &[node_id, neighbors] : g.adjList)
         {
-            // First aggregate 1-hop neighbors
-            vector<vector<float>> neighbor_features(223, vector<float>(1, 0.0f));
+            feature_matrix[node_id] = computeNode(node_id, neighbors, feature_matrix);
+        }
+    }
 
-            for (int neighbor : neighbors)
-            {
-                auto &neighbor_feat = feature_matrix[neighbor];
-                for (int i = 0; i < 223; i++)
-                {
-                    neighbor_features[i][0] += neighbor_feat[i][0] / neighbors.size();
-                }
-            }
+    // Layer output for a single node, reading self and neighbor features from `input`
+    vector<vector<float>> computeNode(int node_id, const vector<int> &neighbors, unordered_map<int, vector<vector<float>>> &input)
+    {
+        // First aggregate 1-hop neighbors
+        vector<vector<float>> neighbor_features;
+        switch (aggregator)
+        {
+        case AGGREGATE_SUM:
+            neighbor_features = aggregate(neighbors, input, SumAggregator());
+            break;
+        case AGGREGATE_MAX:
+            neighbor_features = aggregate(neighbors, input, MaxAggregator());
+            break;
+        case AGGREGATE_POOL:
+            neighbor_features = aggregate(neighbors, input, pool_aggregator);
+            break;
+        default:
+            neighbor_features = aggregate(neighbors, input, MeanAggregator());
+            break;
+        }
 
-            // Concatenate with self features
-            auto combined_features = concat(neighbor_features, feature_matrix[node_id]);
+        return combine(neighbor_features, input[node_id]);
+    }
+
+    // computeNode() on flat rows: `aggregated` is the neighbor aggregate and
+    // `self` the node's own input row, each half as wide as a weight row, and
+    // `out` gets one value per weight row. Each weight row is dotted with
+    // [aggregated | self] straight from the inputs, then the outputs are
+    // squashed and normalized in place, so no row allocates. Only reads the
+    // layer, so rows can be computed from several threads at once.
+    void outputRow(const float *aggregated, const float *self, float *out)
+    {
+        const int outputs = weights.size();
+        const int inputs = outputs > 0 ? weights[0].size() / 2 : 0;
+        float norm = 0.0f;
+        for (int o = 0; o < outputs; o++)
+        {
+            const float *w = weights[o].data();
+            out[o] = sigmoid(dotFloat(w, aggregated, inputs) + dotFloat(w + inputs, self, inputs));
+            norm += out[o] * out[o];
+        }
+        norm = sqrt(norm);
+        for (int o = 0; o < outputs; o++)
+        {
+            out[o] /= norm;
+        }
+    }
 
-            // Apply weights, non-linearity, and normalization
-            combined_features = applyWeights(weights, combined_features);
-            for (auto &feat : combined_features)
+private:
+    vector<vector<float>> combine(vector<vector<float>> &neighbor_features, vector<vector<float>> &self_features)
+    {
+        // Concatenate with self features
+        auto combined_features = concat(neighbor_features, self_features);
+
+        // Apply weights, non-linearity, and normalization
+        combined_features = applyWeights(weights, combined_features);
+        for (auto &feat : combined_features)
+        {
+            feat[0] = sigmoid(feat[0]);
+        }
+        return l2_normalization(combined_features);
+    }
+
+    template <class Aggregator>
+    vector<vector<float>> aggregate(const vector<int> &neighbors, unordered_map<int, vector<vector<float>>> &input, const Aggregator &aggregator)
+    {
+        vector<float> acc(223), row(223), transformed(223);
+        aggregator.begin(acc.data(), 223);
+        for (int neighbor : neighbors)
+        {
+            auto &neighbor_feat = input[neighbor];
+            for (int i = 0; i < 223; i++)
+            {
+                row[i] = neighbor_feat[i][0];
+            }
+            if constexpr (Aggregator::transforms)
             {
-                feat[0] = sigmoid(feat[0]);
+                aggregator.transformRow(row.data(), transformed.data());
+                aggregator.add(acc.data(), transformed.data(), 223);
+            }
+            else
+            {
+                aggregator.add(acc.data(), row.data(), 223);
             }
-            feature_matrix[node_id] = l2_normalization(combined_features);
         }
+        aggregator.finish(acc.data(), 223, neighbors.size());
+
+        vector<vector<float>> res(223, vector<float>(1, 0.0f));
+        for (int i = 0; i < 223; i++)
+        {
+            res[i][0] = acc[i];
+        }
+        return res;
     }
 
-private:
     vector<vector<float>> concat(vector<vector<float>> &v1, vector<vector<float>> &v2)
     {
-        vector<vector<float>> res(v1.size() + v2.size(), vector<float>(v1[0].size(), 0.0f));
-        for (int i = 0; i < v1.size(); i++)
+        // A node without features of its own contributes zeros
+        vector<vector<float>> res(2 * v1.size(), vector<float>(v1[0].size(), 0.0f));
+        for (size_t i = 0; i < v1.size(); i++)
         {
-            for (int j = 0; j < v1[0].size(); j++)
+            for (size_t j = 0; j < v1[0].size(); j++)
             {
                 res[i][j] = v1[i][j];
             }
         }
-        for (int i = 0; i < v1.size(); i++)
+        for (size_t i = 0; i < v2.size() && i < v1.size(); i++)
         {
-            for (int j = 0; j < v1[0].size(); j++)
+            for (size_t j = 0; j < v2[i].size() && j < v1[0].size(); j++)
             {
-                res[i + v1.size()][j] = v1[i][j];
+                res[i + v1.size()][j] = v2[i][j];
             }
         }
         return res;
@@ -81,12 +178,11 @@ private:
         vector<vector<float>> weights(223, vector<float>(446, 0.0f));
         float upper_bound = sqrt(6.0 / (inputs + outputs));
         float lower_bound = -1.0 * sqrt(6.0 / (inputs + outputs));
+        // Row i is elements i * 446 .. i * 446 + 445 of the layer's stream
+        CounterRandom random(seed);
         for (int i = 0; i < 223; i++)
         {
-            for (int j = 0; j < 446; j++)
-            {
-                weights[i][j] = ((rand() / float(RAND_MAX)) * (upper_bound - lower_bound)) + lower_bound;
-            }
+            random.fillUniform(weights[i].data(), 446, lower_bound, upper_bound, (uint64_t)i * 446);
         }
         return weights;
     }
@@ -100,7 +196,7 @@ private:
             {
                 for (int k = 0; k < 446; k++)
                 {
-                    res[i][j] = weights[i][k] * features[k][j];
+                    res[i][j] += weights[i][k] * features[k][j];
                 }
             }
         }
@@ -0,0 +1,489 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "raylib.h"
+using namespace std;
+
+float Vector2Distance(Vector2 p1, Vector2 p2)
+{
+    return sqrt(((p1.x - p2.x) * (p1.x - p2.x)) + ((p1.y - p2.y) * (p1.y - p2.y)));
+}
+
+float Vector2Length(Vector2 p)
+{
+    return sqrt((p.x * p.x) + (p.y * p.y));
+}
+
+float Clamp(float val, float min, float max)
+{
+    return (val < min) ? min : (val > max) ? max : val;
+}
+
+struct Node
+{
+    Vector2 position;
+    bool isTestNode;
+    int id;
+    float radius = 20.0f; // Larger nodes for better visibility
+    Vector2 velocity = {0, 0};
+};
+
+const float REPULSION_STRENGTH = 2000.0f;
+const float SPRING_LENGTH = 150.0f;
+const float SPRING_CONSTANT = 0.05f;
+const float MIN_DISTANCE = 0.01f;
+
+// Force-directed layout helper functions
+Vector2 calculateRepulsion(const Node &n1, const Node &n2)
+{
+    Vector2 diff = {n1.position.x - n2.position.x, n1.position.y - n2.position.y};
+    float dist = Vector2Length(diff);
+    if (dist < MIN_DISTANCE)
+        dist = MIN_DISTANCE;
+    float force = REPULSION_STRENGTH / (dist * dist);
+    return {(diff.x / dist) * force, (diff.y / dist) * force};
+}
+
+Vector2 calculateAttraction(const Node &n1, const Node &n2)
+{
+    Vector2 diff = {n2.position.x - n1.position.x, n2.position.y - n1.position.y};
+    float dist = Vector2Length(diff);
+    if (dist < MIN_DISTANCE)
+        dist = MIN_DISTANCE;
+    float force = (dist - SPRING_LENGTH) * SPRING_CONSTANT;
+    return {(diff.x / dist) * force, (diff.y / dist) * force};
+}
+
+// Barnes-Hut quadtree over node positions. Cells far enough away (cell size /
+// distance < theta) act as a single body at their center of mass, turning the
+// all-pairs repulsion into O(N log N) per step.
+class QuadTree
+{
+public:
+    void build(const vector<Node> &nodes)
+    {
+        cells.clear();
+        order.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            order[i] = i;
+        }
+        if (nodes.empty())
+        {
+            return;
+        }
+
+        float min_x = nodes[0].position.x, max_x = min_x;
+        float min_y = nodes[0].position.y, max_y = min_y;
+        for (const Node &node : nodes)
+        {
+            min_x = min(min_x, node.position.x);
+            max_x = max(max_x, node.position.x);
+            min_y = min(min_y, node.position.y);
+            max_y = max(max_y, node.position.y);
+        }
+        float size = max(max(max_x - min_x, max_y - min_y), 1.0f);
+        cells.reserve(2 * nodes.size());
+        buildCell(nodes, 0, nodes.size(), min_x, min_y, size, 0);
+    }
+
+    // Total repulsion on nodes[self] from every other node
+    Vector2 repulsion(const vector<Node> &nodes, int self, float theta) const
+    {
+        Vector2 total = {0, 0};
+        if (cells.empty())
+        {
+            return total;
+        }
+        const Vector2 p = nodes[self].position;
+        int stack[MAX_DEPTH * 4 + 4];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Cell &cell = cells[stack[--top]];
+            float dx = p.x - cell.center_of_mass.x;
+            float dy = p.y - cell.center_of_mass.y;
+            float dist = sqrt(dx * dx + dy * dy);
+
+            if (cell.leaf)
+            {
+                for (int i = cell.begin; i < cell.end; i++)
+                {
+                    if (order[i] != self)
+                    {
+                        Vector2 force = calculateRepulsion(nodes[self], nodes[order[i]]);
+                        total.x += force.x;
+                        total.y += force.y;
+                    }
+                }
+            }
+            else if (cell.size < theta * dist)
+            {
+                float force = cell.mass * REPULSION_STRENGTH / (dist * dist);
+                total.x += (dx / dist) * force;
+                total.y += (dy / dist) * force;
+            }
+            else
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    if (cell.children[c] >= 0)
+                    {
+                        stack[top++] = cell.children[c];
+                    }
+                }
+            }
+        }
+        return total;
+    }
+
+private:
+    static const int MAX_DEPTH = 24;
+    static const int LEAF_SIZE = 4;
+
+    struct Cell
+    {
+        float size;
+        float mass;
+        Vector2 center_of_mass;
+        int begin, end; // range in `order`
+        bool leaf;
+        int children[4];
+    };
+
+    vector<Cell> cells;
+    vector<int> order;
+
+    int buildCell(const vector<Node> &nodes, int begin, int end, float x, float y, float size, int depth)
+    {
+        int index = cells.size();
+        cells.push_back(Cell());
+        Cell cell;
+        cell.size = size;
+        cell.mass = end - begin;
+        cell.begin = begin;
+        cell.end = end;
+        cell.leaf = true;
+        fill(cell.children, cell.children + 4, -1);
+
+        float sum_x = 0.0f, sum_y = 0.0f;
+        for (int i = begin; i < end; i++)
+        {
+            sum_x += nodes[order[i]].position.x;
+            sum_y += nodes[order[i]].position.y;
+        }
+        cell.center_of_mass = {sum_x / cell.mass, sum_y / cell.mass};
+
+        if (end - begin > LEAF_SIZE && depth < MAX_DEPTH)
+        {
+            // Partition the range into the four quadrants: bottom/top, then left/right
+            float half = size / 2;
+            float mid_x = x + half, mid_y = y + half;
+            auto below = [&](int i)
+            { return nodes[i].position.y < mid_y; };
+            auto left = [&](int i)
+            { return nodes[i].position.x < mid_x; };
+            int split_y = partition(order.begin() + begin, order.begin() + end, below) - order.begin();
+            int split_low = partition(order.begin() + begin, order.begin() + split_y, left) - order.begin();
+            int split_high = partition(order.begin() + split_y, order.begin() + end, left) - order.begin();
+
+            int bounds[5] = {begin, split_low, split_y, split_high, end};
+            float origins[4][2] = {{x, y}, {mid_x, y}, {x, mid_y}, {mid_x, mid_y}};
+            cell.leaf = false;
+            for (int c = 0; c < 4; c++)
+            {
+                if (bounds[c + 1] > bounds[c])
+                {
+                    cell.children[c] = buildCell(nodes, bounds[c], bounds[c + 1], origins[c][0], origins[c][1], half, depth + 1);
+                }
+            }
+        }
+        cells[index] = cell;
+        return index;
+    }
+};
+
+// Force-directed layout of the visualized neighborhood: Barnes-Hut repulsion plus
+// spring attraction along each node's own adjacency list
+class ForceLayout
+{
+public:
+    vector<Node> nodes;
+    vector<vector<int>> adjacency; // indices into `nodes`
+    float theta = 0.8f;            // 0 gives exact all-pairs repulsion
+    Rectangle bounds = {0, 0, 0, 0};
+
+    void clear()
+    {
+        nodes.clear();
+        adjacency.clear();
+        index_of.clear();
+    }
+
+    // Adds a node unless it already exists; returns its index
+    int addNode(const Node &node)
+    {
+        auto it = index_of.find(node.id);
+        if (it != index_of.end())
+        {
+            return it->second;
+        }
+        index_of[node.id] = nodes.size();
+        nodes.push_back(node);
+        adjacency.emplace_back();
+        return nodes.size() - 1;
+    }
+
+    void addEdge(int id1, int id2)
+    {
+        int a = indexOf(id1), b = indexOf(id2);
+        if (a < 0 || b < 0)
+        {
+            return;
+        }
+        adjacency[a].push_back(b);
+        adjacency[b].push_back(a);
+    }
+
+    int indexOf(int id) const
+    {
+        auto it = index_of.find(id);
+        return it == index_of.end() ? -1 : it->second;
+    }
+
+    // One simulation step; returns true if every node has (nearly) come to rest
+    bool step()
+    {
+        tree.build(nodes);
+        forces.assign(nodes.size(), Vector2{0, 0});
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            Vector2 total = tree.repulsion(nodes, i, theta);
+            for (int j : adjacency[i])
+            {
+                Vector2 force = calculateAttraction(nodes[i], nodes[j]);
+                total.x += force.x;
+                total.y += force.y;
+            }
+            forces[i] = total;
+        }
+
+        bool stable = true;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            Node &node = nodes[i];
+            node.velocity.x = (node.velocity.x + forces[i].x) * 0.9f;
+            node.velocity.y = (node.velocity.y + forces[i].y) * 0.9f;
+
+            // Update position and constrain to bounding box
+            node.position.x += node.velocity.x;
+            node.position.y += node.velocity.y;
+            node.position.x = Clamp(node.position.x, bounds.x + node.radius, bounds.x + bounds.width - node.radius);
+            node.position.y = Clamp(node.position.y, bounds.y + node.radius, bounds.y + bounds.height - node.radius);
+
+            if (fabs(node.velocity.x) > 0.1f || fabs(node.velocity.y) > 0.1f)
+            {
+                stable = false;
+            }
+        }
+        return stable;
+    }
+
+private:
+    unordered_map<int, int> index_of;
+    QuadTree tree;
+    vector<Vector2> forces;
+};
+
+// Position snapshot published by the layout thread
+struct LayoutSnapshot
+{
+    vector<Vector2> positions;
+    uint64_t sequence = 0;
+    double time = 0.0; // seconds on the steady clock
+    bool stabilized = false;
+};
+
+// Single-producer/single-consumer latest-value buffer without locks. It is the
+// double buffer (one slot being written, one being read) plus a spare slot, so
+// the writer never waits for the reader: the writer fills its slot and swaps it
+// with the spare; the reader swaps the spare in only if something new arrived.
+class SnapshotBuffer
+{
+public:
+    LayoutSnapshot &writeSlot() { return slots[write_index]; }
+
+    void publish()
+    {
+        int previous = spare.exchange(write_index | FRESH, memory_order_acq_rel);
+        write_index = previous & INDEX_MASK;
+    }
+
+    // Returns true and updates readSlot() if a newer snapshot was published
+    bool acquire()
+    {
+        if ((spare.load(memory_order_relaxed) & FRESH) == 0)
+        {
+            return false;
+        }
+        int previous = spare.exchange(read_index, memory_order_acq_rel);
+        read_index = previous & INDEX_MASK;
+        return true;
+    }
+
+    const LayoutSnapshot &readSlot() const { return slots[read_index]; }
+
+    // Only valid while no writer is running
+    void reset()
+    {
+        for (LayoutSnapshot &slot : slots)
+        {
+            slot = LayoutSnapshot();
+        }
+        write_index = 0;
+        read_index = 1;
+        spare.store(2, memory_order_relaxed);
+    }
+
+private:
+    static const int FRESH = 4;
+    static const int INDEX_MASK = 3;
+    LayoutSnapshot slots[3];
+    int write_index = 0; // owned by the writer
+    int read_index = 1;  // owned by the reader
+    atomic<int> spare{2};
+};
+
+// Runs ForceLayout::step on a background thread at a fixed rate and publishes
+// positions through a SnapshotBuffer, so a slow step never stalls input or
+// drawing. The render loop interpolates between the last two snapshots.
+class LayoutWorker
+{
+public:
+    // Static node data (ids, colors, radii) and adjacency for drawing; only
+    // positions change after start()
+    vector<Node> nodes;
+    vector<vector<int>> adjacency;
+    double step_interval = 1.0 / 60.0;
+    int stability_threshold = 100;
+
+    LayoutWorker() {}
+    LayoutWorker(const LayoutWorker &) = delete;
+    LayoutWorker &operator=(const LayoutWorker &) = delete;
+    ~LayoutWorker() { stop(); }
+
+    // Stops any running simulation and starts laying out `layout` from scratch
+    void start(const ForceLayout &layout)
+    {
+        stop();
+        simulation = layout;
+        nodes = layout.nodes;
+        adjacency = layout.adjacency;
+        buffer.reset();
+        previous = LayoutSnapshot();
+        latest = LayoutSnapshot();
+        publish(false, 0);
+        running = true;
+        worker = thread(&LayoutWorker::run, this);
+    }
+
+    void stop()
+    {
+        running = false;
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+
+    bool stabilized() const { return latest.stabilized; }
+
+    // Positions to draw this frame, blended between the two latest snapshots.
+    // Drawing runs one simulation step behind so motion stays smooth even when
+    // the frame rate and the step rate differ.
+    const vector<Vector2> &positions()
+    {
+        if (buffer.acquire())
+        {
+            previous = latest;
+            latest = buffer.readSlot();
+        }
+        if (previous.positions.size() != latest.positions.size())
+        {
+            previous = latest;
+        }
+
+        double span = latest.time - previous.time;
+        float alpha = span <= 0 ? 1.0f : Clamp((now() - latest.time) / span, 0.0f, 1.0f);
+        interpolated.resize(latest.positions.size());
+        for (size_t i = 0; i < interpolated.size(); i++)
+        {
+            const Vector2 &a = previous.positions[i];
+            const Vector2 &b = latest.positions[i];
+            interpolated[i] = {a.x + (b.x - a.x) * alpha, a.y + (b.y - a.y) * alpha};
+        }
+        return interpolated;
+    }
+
+private:
+    ForceLayout simulation; // touched only by the worker thread once started
+    SnapshotBuffer buffer;
+    atomic<bool> running{false};
+    thread worker;
+    LayoutSnapshot previous, latest; // reader side
+    vector<Vector2> interpolated;
+
+    static double now()
+    {
+        return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void publish(bool stabilized, uint64_t sequence)
+    {
+        LayoutSnapshot &slot = buffer.writeSlot();
+        slot.positions.resize(simulation.nodes.size());
+        for (size_t i = 0; i < simulation.nodes.size(); i++)
+        {
+            slot.positions[i] = simulation.nodes[i].position;
+        }
+        slot.sequence = sequence;
+        slot.time = now();
+        slot.stabilized = stabilized;
+        buffer.publish();
+    }
+
+    void run()
+    {
+        int stability_counter = 0;
+        uint64_t sequence = 0;
+        auto next_step = chrono::steady_clock::now();
+        while (running && stability_counter < stability_threshold)
+        {
+            bool stable = simulation.step();
+            stability_counter = stable ? stability_counter + 1 : 0;
+            publish(stability_counter >= stability_threshold, ++sequence);
+
+            // Pace the simulation; if a step overran, continue immediately
+            next_step += chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(step_interval));
+            auto current = chrono::steady_clock::now();
+            if (next_step > current)
+            {
+                this_thread::sleep_until(next_step);
+            }
+            else
+            {
+                next_step = current;
+            }
+        }
+    }
+};
+
+#endif
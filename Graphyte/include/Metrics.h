@@ -0,0 +1,425 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "ThreadPool.h"
+#include "Random.h"
+using namespace std;
+
+enum AUCMode
+{
+    AUC_EXACT,     // serial sort of all scores
+    AUC_PARALLEL,  // parallel sort of all scores, same result as AUC_EXACT
+    AUC_HISTOGRAM, // one streaming pass into fixed bins, no scores stored
+};
+
+// Rank AUC (Mann-Whitney U) of (score, is_positive) pairs sorted by descending
+// score. Tied scores count half, so a constant scorer gets 0.5.
+float aucFromSorted(const vector<pair<float, bool>> &sorted_scores)
+{
+    double positive_count = 0, negative_count = 0, auc = 0;
+    size_t i = 0;
+    while (i < sorted_scores.size())
+    {
+        // Group of equal scores
+        double group_positive = 0, group_negative = 0;
+        size_t j = i;
+        for (; j < sorted_scores.size() && sorted_scores[j].first == sorted_scores[i].first; j++)
+        {
+            if (sorted_scores[j].second)
+                group_positive++;
+            else
+                group_negative++;
+        }
+        auc += group_negative * positive_count + 0.5 * group_negative * group_positive;
+        positive_count += group_positive;
+        negative_count += group_negative;
+        i = j;
+    }
+
+    if (positive_count == 0 || negative_count == 0)
+    {
+        return 0.5; // Return random classifier score if only one class present
+    }
+    return auc / (positive_count * negative_count);
+}
+
+bool higherScore(const pair<float, bool> &a, const pair<float, bool> &b)
+{
+    return a.first > b.first;
+}
+
+float exactAUC(vector<pair<float, bool>> scores)
+{
+    sort(scores.begin(), scores.end(), higherScore);
+    return aucFromSorted(scores);
+}
+
+// Sorts `scores` in place
+float parallelAUC(vector<pair<float, bool>> &scores, ThreadPool &pool = defaultThreadPool())
+{
+    parallelSort(scores, higherScore, pool);
+    return aucFromSorted(scores);
+}
+
+// Streaming AUC over a fixed score range. Scores are counted into equal-width
+// bins per class; pairs falling in the same bin count as ties, so the error is
+// bounded by the fraction of positive/negative pairs sharing a bin. Cosine
+// scores live in [-1, 1], the default range.
+class AUCHistogram
+{
+public:
+    AUCHistogram(int num_bins = 4096, float min_score = -1.0f, float max_score = 1.0f)
+        : min_score(min_score), max_score(max_score), positives(num_bins, 0), negatives(num_bins, 0) {}
+
+    void add(float score, bool positive)
+    {
+        int bin = (int)((score - min_score) / (max_score - min_score) * positives.size());
+        bin = max(0, min((int)positives.size() - 1, bin));
+        (positive ? positives : negatives)[bin]++;
+    }
+
+    void merge(const AUCHistogram &other)
+    {
+        for (size_t b = 0; b < positives.size(); b++)
+        {
+            positives[b] += other.positives[b];
+            negatives[b] += other.negatives[b];
+        }
+    }
+
+    float auc() const
+    {
+        double positive_count = 0, negative_count = 0, auc = 0;
+        // Walk from the highest bin down, as aucFromSorted walks scores
+        for (size_t b = positives.size(); b-- > 0;)
+        {
+            auc += (double)negatives[b] * positive_count + 0.5 * negatives[b] * positives[b];
+            positive_count += positives[b];
+            negative_count += negatives[b];
+        }
+        if (positive_count == 0 || negative_count == 0)
+        {
+            return 0.5;
+        }
+        return auc / (positive_count * negative_count);
+    }
+
+private:
+    float min_score, max_score;
+    vector<uint64_t> positives;
+    vector<uint64_t> negatives;
+};
+
+struct RankingOptions
+{
+    int k = 10;
+    // 0 ranks every positive against all other nodes; otherwise against this
+    // many negatives sampled per query
+    int num_sampled_negatives = 0;
+    uint64_t seed = 0;
+    // 0 evaluates every node with test edges
+    int max_queries = 0;
+    int query_batch = 64;
+    int candidate_block = 1024;
+};
+
+struct RankingMetrics
+{
+    int k = 0;
+    size_t num_queries = 0;
+    size_t num_positives = 0;
+    double hits_at_k = 0.0; // fraction of positives ranked in the top k
+    double mrr = 0.0;       // mean reciprocal rank of the positives
+    double ndcg_at_k = 0.0; // mean over queries, positives have gain 1
+};
+
+// Unit-length copy of the embeddings, so cosine similarity is a dot product
+FeatureMatrix normalizedRows(const FeatureMatrix &m)
+{
+    FeatureMatrix n = m;
+    for (int r = 0; r < n.rows; r++)
+    {
+        float *row = n.row(r);
+        float norm = 0.0f;
+        for (int i = 0; i < n.dim; i++)
+        {
+            norm += row[i] * row[i];
+        }
+        norm = sqrt(norm);
+        for (int i = 0; i < n.dim && norm > 0; i++)
+        {
+            row[i] /= norm;
+        }
+    }
+    return n;
+}
+
+// Hits@K, MRR and NDCG@K of link prediction. Queries are the rows of `test`
+// with edges; their test neighbors are the positives, and their neighbors in
+// `exclude` (usually the training graph) are filtered from the candidates.
+// Rows of `embeddings`, `test` and `exclude` must refer to the same nodes.
+//
+// In full mode a batch of queries is scored against a block of candidate rows
+// at a time into one small score matrix, so each candidate row is read once
+// per query batch rather than once per query.
+RankingMetrics evaluateRanking(const FeatureMatrix &embeddings, const CSRGraph &test, const CSRGraph *exclude,
+                               RankingOptions options = RankingOptions(), ThreadPool &pool = defaultThreadPool())
+{
+    const FeatureMatrix unit = normalizedRows(embeddings);
+    const int dim = unit.dim;
+    const int k = options.k;
+
+    vector<int> queries;
+    for (int r = 0; r < test.numNodes(); r++)
+    {
+        if (test.degree(r) > 0)
+        {
+            queries.push_back(r);
+        }
+    }
+    if (options.max_queries > 0 && (int)queries.size() > options.max_queries)
+    {
+        counterShuffle(queries, CounterRandom(options.seed));
+        queries.resize(options.max_queries);
+        sort(queries.begin(), queries.end());
+    }
+
+    auto dot = [&](int a, int b)
+    {
+        const float *x = unit.row(a), *y = unit.row(b);
+        float sum = 0.0f;
+        for (int i = 0; i < dim; i++)
+            sum += x[i] * y[i];
+        return sum;
+    };
+    auto excluded = [&](int query, int candidate)
+    {
+        return candidate == query ||
+               binary_search(test.neighborsBegin(query), test.neighborsEnd(query), candidate) ||
+               (exclude && binary_search(exclude->neighborsBegin(query), exclude->neighborsEnd(query), candidate));
+    };
+
+    // Per-query results: sum of hits, reciprocal ranks, and the query's NDCG
+    vector<double> hits(queries.size()), reciprocal(queries.size()), ndcg(queries.size());
+    const int64_t num_batches = (queries.size() + options.query_batch - 1) / options.query_batch;
+
+    pool.parallelFor(0, num_batches, [&](int64_t first_batch, int64_t last_batch)
+                     {
+        vector<float> block, query_t, candidate_t;
+        vector<int> candidates;
+        for (int64_t batch = first_batch; batch < last_batch; batch++)
+        {
+            size_t q_begin = batch * options.query_batch;
+            size_t q_end = min(queries.size(), q_begin + options.query_batch);
+            size_t batch_size = q_end - q_begin;
+
+            // Positive scores, and per positive the number of negatives above it
+            vector<vector<float>> positive_scores(batch_size);
+            vector<vector<double>> above(batch_size);
+            vector<float> lowest_positive(batch_size, numeric_limits<float>::infinity());
+            // Top-k negative scores per query, for NDCG (min-heaps)
+            vector<vector<float>> top_negatives(batch_size);
+            for (size_t j = 0; j < batch_size; j++)
+            {
+                int q = queries[q_begin + j];
+                for (const int *it = test.neighborsBegin(q); it != test.neighborsEnd(q); it++)
+                {
+                    positive_scores[j].push_back(dot(q, *it));
+                    lowest_positive[j] = min(lowest_positive[j], positive_scores[j].back());
+                }
+                above[j].assign(positive_scores[j].size(), 0.0);
+            }
+
+            auto countNegative = [&](size_t j, int candidate, float score)
+            {
+                vector<float> &heap = top_negatives[j];
+                bool heap_full = (int)heap.size() >= k;
+                // Most candidates score below every positive and the current
+                // top k, and cannot change any metric
+                if (score < lowest_positive[j] && heap_full && (k == 0 || score <= heap.front()))
+                    return;
+                if (excluded(queries[q_begin + j], candidate))
+                    return;
+                for (size_t p = 0; p < positive_scores[j].size(); p++)
+                {
+                    // Ties count half, as in the AUC
+                    if (score > positive_scores[j][p])
+                        above[j][p] += 1.0;
+                    else if (score == positive_scores[j][p])
+                        above[j][p] += 0.5;
+                }
+                if (!heap_full)
+                {
+                    heap.push_back(score);
+                    push_heap(heap.begin(), heap.end(), greater<float>());
+                }
+                else if (k > 0 && score > heap.front())
+                {
+                    pop_heap(heap.begin(), heap.end(), greater<float>());
+                    heap.back() = score;
+                    push_heap(heap.begin(), heap.end(), greater<float>());
+                }
+            };
+
+            // Scores queries [first, last) of the batch against the candidate
+            // rows into block[j][c]. Both sides are transposed so a 4x4 tile of
+            // scores is accumulated in registers while walking the dimension
+            // once; each sum keeps the summation order of `dot`.
+            auto scoreBlock = [&](size_t first, size_t last, const vector<int> &candidates)
+            {
+                size_t m = last - first, n = candidates.size();
+                query_t.resize((size_t)dim * m);
+                for (size_t j = 0; j < m; j++)
+                {
+                    const float *x = unit.row(queries[q_begin + first + j]);
+                    for (int i = 0; i < dim; i++)
+                        query_t[i * m + j] = x[i];
+                }
+                candidate_t.resize((size_t)dim * n);
+                for (size_t c = 0; c < n; c++)
+                {
+                    const float *y = unit.row(candidates[c]);
+                    for (int i = 0; i < dim; i++)
+                        candidate_t[i * n + c] = y[i];
+                }
+                block.resize(m * n);
+                for (size_t j0 = 0; j0 < m; j0 += 4)
+                {
+                    for (size_t c0 = 0; c0 < n; c0 += 4)
+                    {
+                        if (j0 + 4 <= m && c0 + 4 <= n)
+                        {
+                            float tile[4][4] = {};
+                            for (int i = 0; i < dim; i++)
+                            {
+                                const float *x = &query_t[i * m + j0];
+                                const float *y = &candidate_t[i * n + c0];
+                                for (int a = 0; a < 4; a++)
+                                    for (int b = 0; b < 4; b++)
+                                        tile[a][b] += x[a] * y[b];
+                            }
+                            for (int a = 0; a < 4; a++)
+                                for (int b = 0; b < 4; b++)
+                                    block[(j0 + a) * n + c0 + b] = tile[a][b];
+                            continue;
+                        }
+                        // Ragged edge of the block
+                        for (size_t j = j0; j < min(m, j0 + 4); j++)
+                        {
+                            for (size_t c = c0; c < min(n, c0 + 4); c++)
+                            {
+                                float sum = 0.0f;
+                                for (int i = 0; i < dim; i++)
+                                    sum += query_t[i * m + j] * candidate_t[i * n + c];
+                                block[j * n + c] = sum;
+                            }
+                        }
+                    }
+                }
+            };
+
+            if (options.num_sampled_negatives > 0)
+            {
+                for (size_t j = 0; j < batch_size; j++)
+                {
+                    int q = queries[q_begin + j];
+                    // One stream per query, so results do not depend on the thread count
+                    CounterRandom random(options.seed, q);
+                    candidates.clear();
+                    for (int attempts = 0; (int)candidates.size() < options.num_sampled_negatives &&
+                                           attempts < options.num_sampled_negatives * 20;
+                         attempts++)
+                    {
+                        int c = random.below(attempts, unit.rows);
+                        if (!excluded(q, c))
+                            candidates.push_back(c);
+                    }
+                    // Gather the sampled rows in memory order
+                    sort(candidates.begin(), candidates.end());
+                    scoreBlock(j, j + 1, candidates);
+                    for (size_t c = 0; c < candidates.size(); c++)
+                        countNegative(j, candidates[c], block[c]);
+                }
+            }
+            else
+            {
+                for (int c_begin = 0; c_begin < unit.rows; c_begin += options.candidate_block)
+                {
+                    int c_end = min(unit.rows, c_begin + options.candidate_block);
+                    candidates.resize(c_end - c_begin);
+                    iota(candidates.begin(), candidates.end(), c_begin);
+                    // Score matrix: batch queries x candidate block
+                    scoreBlock(0, batch_size, candidates);
+                    for (size_t j = 0; j < batch_size; j++)
+                    {
+                        const float *scores = &block[j * candidates.size()];
+                        for (size_t c = 0; c < candidates.size(); c++)
+                            countNegative(j, candidates[c], scores[c]);
+                    }
+                }
+            }
+
+            for (size_t j = 0; j < batch_size; j++)
+            {
+                size_t query_index = q_begin + j;
+                const vector<float> &positives = positive_scores[j];
+                for (size_t p = 0; p < positives.size(); p++)
+                {
+                    double rank = 1.0 + above[j][p];
+                    hits[query_index] += rank <= k ? 1.0 : 0.0;
+                    reciprocal[query_index] += 1.0 / rank;
+                }
+
+                // Merge the positives with the top negatives to get the top-k list
+                vector<pair<float, bool>> ranked;
+                for (float score : positives)
+                    ranked.push_back({score, true});
+                for (float score : top_negatives[j])
+                    ranked.push_back({score, false});
+                sort(ranked.begin(), ranked.end(), [](const pair<float, bool> &a, const pair<float, bool> &b)
+                     { return a.first > b.first || (a.first == b.first && !a.second && b.second); });
+                double dcg = 0.0, ideal = 0.0;
+                for (int i = 0; i < k && i < (int)ranked.size(); i++)
+                {
+                    if (ranked[i].second)
+                        dcg += 1.0 / log2(i + 2.0);
+                }
+                for (int i = 0; i < k && i < (int)positives.size(); i++)
+                {
+                    ideal += 1.0 / log2(i + 2.0);
+                }
+                ndcg[query_index] = ideal > 0 ? dcg / ideal : 0.0;
+            }
+        } });
+
+    RankingMetrics metrics;
+    metrics.k = k;
+    metrics.num_queries = queries.size();
+    for (size_t j = 0; j < queries.size(); j++)
+    {
+        metrics.num_positives += test.degree(queries[j]);
+        metrics.hits_at_k += hits[j];
+        metrics.mrr += reciprocal[j];
+        metrics.ndcg_at_k += ndcg[j];
+    }
+    if (metrics.num_positives > 0)
+    {
+        metrics.hits_at_k /= metrics.num_positives;
+        metrics.mrr /= metrics.num_positives;
+    }
+    if (metrics.num_queries > 0)
+    {
+        metrics.ndcg_at_k /= metrics.num_queries;
+    }
+    return metrics;
+}
+
+#endif
@@ -2,7 +2,14 @@
 #define MODEL_H
 
 #include "Layer.h"
+#include "Inference.h"
+#include "Quantize.h"
+#include "Training.h"
+#include "Metrics.h"
+#include "EmbeddingStore.h"
+#include "ThreadPool.h"
 #include <algorithm>
+#include <mutex>
 using namespace std;
 
 class SAGEModel
@@ -16,6 +23,19 @@ public:
     Graph train_pos_g;
     Graph train_neg_g;
     unordered_map<int, vector<vector<float>>> feature_matrix;
+    // The input features the model was built with; feature_matrix holds the
+    // final embeddings once they have been computed
+    unordered_map<int, vector<vector<float>>> input_features;
+    // Flattened optimizer moments and the number of updates made, persisted
+    // alongside the weights in checkpoints
+    vector<float> optimizer_state;
+    uint64_t optimizer_step = 0;
+    // Compact copy of feature_matrix used for scoring once quantizeEmbeddings()
+    // has been called; empty otherwise
+    EmbeddingStore embedding_store;
+    // Weight and activation precision of computeEmbeddings(); bf16 and int8
+    // run the layers as QuantizedSAGELayer and need mean aggregators
+    Precision inference_precision = PRECISION_FP32;
 
     SAGEModel() {}
 
@@ -23,77 +43,292 @@ public:
     {
         this->train_pos_g.copyGraph(train_pos_g);
         this->train_neg_g.copyGraph(train_neg_g);
+        // Fixed seeds, so every run starts from the same weights
+        pos_layer1.seed = 1;
+        pos_layer2.seed = 2;
         pos_layer1.init(this->train_pos_g, feature_matrix);
         pos_layer2.init(this->train_pos_g, feature_matrix);
         for (auto &[key, value] : feature_matrix)
         {
             this->feature_matrix[key] = value;
         }
+        input_features = this->feature_matrix;
     }
 
-    void train(int num_epochs = 5)
+    // Trains the positive-graph layers for link prediction (see Training.h)
+    // and returns the mean loss of every epoch. Embeddings are not refreshed; call computeEmbeddings().
+    vector<double> train(int num_epochs = 5, TrainingOptions options = TrainingOptions(), ThreadPool &pool = defaultThreadPool())
     {
+        vector<double> losses;
+        for (SAGELayer *layer : {&pos_layer1, &pos_layer2})
+        {
+            if (layer->aggregator != AGGREGATE_MEAN && layer->aggregator != AGGREGATE_SUM)
+            {
+                cout << "Error: training supports only mean and sum aggregators" << endl;
+                return losses;
+            }
+        }
+        CSRGraph g = CSRGraph::fromGraph(train_pos_g);
+        FeatureMatrix inputs = FeatureMatrix::fromFeatureMap(g, input_features);
+
+        SAGETrainer trainer(g, inputs, {&pos_layer1, &pos_layer2}, optimizer_state, optimizer_step, options);
         for (int i = 0; i < num_epochs; i++)
         {
-            cout << "Epoch: " << i + 1 << " / " << num_epochs << endl;
-            pos_layer1.forward();
-            pos_layer2.init(pos_layer1.g, pos_layer1.feature_matrix);
-            pos_layer2.forward();
+            EpochStats stats = trainer.runEpoch(i, pool);
+            losses.push_back(stats.loss);
+            if (options.verbose)
+            {
+                cout << "Epoch: " << i + 1 << " / " << num_epochs << "  loss " << stats.loss << "  (" << stats.steps
+                     << " steps, " << stats.ms << " ms";
+                if (options.asynchronous)
+                    cout << ", staleness mean " << stats.mean_staleness << " max " << stats.max_staleness;
+                else if (options.historical_embeddings)
+                    cout << ", " << stats.fresh_rows << " fresh / " << stats.history_reads << " historical rows, age mean "
+                         << stats.mean_history_age << " max " << stats.max_history_age << ", refresh " << stats.history_ms << " ms";
+                cout << ")" << endl;
+            }
+        }
+        trainer.store();
+        return losses;
+    }
+
+    // Final embeddings of every node in the training graph from the current
+    // weights, computed layer by layer over a CSR copy of the graph. The layers
+    // always start from input_features, so calling it again gives the same
+    // embeddings rather than stacking the layers. Nodes outside the graph keep
+    // their features.
+    void computeEmbeddings(ThreadPool &pool = defaultThreadPool())
+    {
+        CSRGraph g = CSRGraph::fromGraph(train_pos_g);
+        if (inference_precision != PRECISION_FP32)
+        {
+            if (pos_layer1.aggregator != AGGREGATE_MEAN || pos_layer2.aggregator != AGGREGATE_MEAN)
+            {
+                cout << "Error: " << precisionName(inference_precision) << " inference supports only mean aggregators" << endl;
+                return;
+            }
+            vector<QuantizedSAGELayer> layers = {QuantizedSAGELayer(pos_layer1.weights, inference_precision),
+                                                 QuantizedSAGELayer(pos_layer2.weights, inference_precision)};
+            quantizedInference(g, FeatureMatrix::fromFeatureMap(g, input_features), layers, pool).toFeatureMap(g, feature_matrix);
+        }
+        else
+        {
+            LayerwiseInference inference;
+            inference.run(g, FeatureMatrix::fromFeatureMap(g, input_features), {&pos_layer1, &pos_layer2}, pool)
+                .toFeatureMap(g, feature_matrix);
+        }
+        if (!embedding_store.empty())
+        {
+            for (int node_id : g.node_ids)
+            {
+                embedding_store.update(node_id, feature_matrix[node_id]);
+            }
+        }
+    }
+
+    // Scores from now on come from a compact copy of the embeddings. With
+    // `release_features` the float embeddings are dropped to save memory, and
+    // only scoring (getPrediction, evaluate), setEmbedding() and checkpoints
+    // keep working.
+    void quantizeEmbeddings(EmbeddingFormat format, bool release_features = false)
+    {
+        embedding_store = EmbeddingStore(feature_matrix, format);
+        if (release_features)
+        {
+            unordered_map<int, vector<vector<float>>>().swap(feature_matrix);
+            features_released = true;
+        }
+    }
 
-            neg_layer1.forward();
-            neg_layer2.init(neg_layer1.g, neg_layer1.feature_matrix);
-            neg_layer2.forward();
+    bool featuresReleased() const { return features_released; }
 
-            cout << calculateLoss(pos_layer2.g.adjList, neg_layer2.g.adjList, pos_layer2.feature_matrix, neg_layer2.feature_matrix) << endl;
+    // Replaces one node's final embedding in the tables scoring reads: the
+    // float map unless it was released, and the store's row if there is one
+    void setEmbedding(int node_id, const vector<vector<float>> &embedding)
+    {
+        if (!features_released)
+        {
+            feature_matrix[node_id] = embedding;
+        }
+        if (!embedding_store.empty())
+        {
+            embedding_store.update(node_id, embedding);
         }
     }
 
-    vector<pair<int, float>> getPrediction(int u)
+    // All other training nodes by similarity to u, best first. With top_k > 0
+    // only the top_k best are kept, ranked by a partial sort.
+    vector<pair<int, float>> getPrediction(int u, size_t top_k = 0)
     {
         vector<pair<int, float>> scores;
+        int u_row = embedding_store.empty() ? -1 : embedding_store.rowOf(u);
         for (auto &[key, value] : train_pos_g.adjList)
         {
             if (key == u)
             {
                 continue;
             }
-            float score = cosine_similarity(u, key);
+            float score;
+            if (embedding_store.empty())
+            {
+                score = cosine_similarity(u, key);
+            }
+            else
+            {
+                int key_row = embedding_store.rowOf(key);
+                score = (u_row < 0 || key_row < 0) ? 0.0f : embedding_store.cosineRows(u_row, key_row);
+            }
             scores.push_back(make_pair(key, score));
         }
-        sort(scores.begin(), scores.end(), [](pair<int, float> a, pair<int, float> b)
-             { return a.second > b.second; });
+        auto better = [](const pair<int, float> &a, const pair<int, float> &b)
+        { return a.second > b.second; };
+        if (top_k > 0 && top_k < scores.size())
+        {
+            partial_sort(scores.begin(), scores.begin() + top_k, scores.end(), better);
+            scores.resize(top_k);
+        }
+        else
+        {
+            sort(scores.begin(), scores.end(), better);
+        }
         return scores;
     }
 
     float evaluate(const unordered_map<int, vector<int>> &test_pos_edges,
-                   const unordered_map<int, vector<int>> &test_neg_edges)
+                   const unordered_map<int, vector<int>> &test_neg_edges,
+                   AUCMode mode = AUC_EXACT)
     {
-        vector<pair<float, bool>> all_scores;
-
-        // Calculate scores for positive edges
-        for (const auto &[node, neighbors] : test_pos_edges)
+        if (mode == AUC_EXACT)
         {
-            for (int neighbor : neighbors)
+            vector<pair<float, bool>> all_scores;
+
+            // Calculate scores for positive edges
+            for (const auto &[node, neighbors] : test_pos_edges)
+            {
+                for (int neighbor : neighbors)
+                {
+                    float score = cosine_similarity(node, neighbor);
+                    all_scores.push_back({score, true});
+                }
+            }
+
+            // Calculate scores for negative edges
+            for (const auto &[node, neighbors] : test_neg_edges)
             {
-                float score = cosine_similarity(node, neighbor);
-                all_scores.push_back({score, true});
+                for (int neighbor : neighbors)
+                {
+                    float score = cosine_similarity(node, neighbor);
+                    all_scores.push_back({score, false});
+                }
             }
+
+            return calculateAUC(all_scores);
         }
 
-        // Calculate scores for negative edges
+        // Parallel paths work over the source nodes of both edge sets
+        vector<pair<const vector<int> *, pair<int, bool>>> sources;
+        for (const auto &[node, neighbors] : test_pos_edges)
+            sources.push_back({&neighbors, {node, true}});
         for (const auto &[node, neighbors] : test_neg_edges)
+            sources.push_back({&neighbors, {node, false}});
+        ThreadPool &pool = defaultThreadPool();
+
+        if (mode == AUC_HISTOGRAM)
         {
-            for (int neighbor : neighbors)
+            // One histogram per chunk; scores are never stored
+            mutex merge_mutex;
+            AUCHistogram histogram;
+            pool.parallelFor(0, sources.size(), [&](int64_t first, int64_t last)
+                             {
+                                 AUCHistogram local;
+                                 for (int64_t s = first; s < last; s++)
+                                 {
+                                     auto &[neighbors, source] = sources[s];
+                                     for (int neighbor : *neighbors)
+                                         local.add(cosine_similarity(source.first, neighbor), source.second);
+                                 }
+                                 lock_guard<mutex> lock(merge_mutex);
+                                 histogram.merge(local); });
+            return histogram.auc();
+        }
+
+        // AUC_PARALLEL: score into preassigned slices, then parallel sort
+        vector<size_t> offsets(sources.size() + 1, 0);
+        for (size_t s = 0; s < sources.size(); s++)
+        {
+            offsets[s + 1] = offsets[s] + sources[s].first->size();
+        }
+        vector<pair<float, bool>> all_scores(offsets.back());
+        pool.parallelFor(0, sources.size(), [&](int64_t first, int64_t last)
+                         {
+                             for (int64_t s = first; s < last; s++)
+                             {
+                                 auto &[neighbors, source] = sources[s];
+                                 size_t out = offsets[s];
+                                 for (int neighbor : *neighbors)
+                                     all_scores[out++] = {cosine_similarity(source.first, neighbor), source.second};
+                             } });
+        return parallelAUC(all_scores, pool);
+    }
+
+    // Hits@K, MRR and NDCG@K of the test edges, ranking each positive against
+    // every node with an embedding (or sampled ones) minus the training edges
+    RankingMetrics evaluateRanking(const unordered_map<int, vector<int>> &test_pos_edges,
+                                   RankingOptions options = RankingOptions())
+    {
+        vector<int> node_ids;
+        for (auto &[node_id, feature] : feature_matrix)
+            node_ids.push_back(node_id);
+        node_ids.insert(node_ids.end(), embedding_store.node_ids.begin(), embedding_store.node_ids.end());
+        for (auto &[node_id, neighbors] : train_pos_g.adjList)
+            node_ids.push_back(node_id);
+        for (auto &[node_id, neighbors] : test_pos_edges)
+        {
+            node_ids.push_back(node_id);
+            node_ids.insert(node_ids.end(), neighbors.begin(), neighbors.end());
+        }
+        sort(node_ids.begin(), node_ids.end());
+        node_ids.erase(unique(node_ids.begin(), node_ids.end()), node_ids.end());
+
+        auto rowEdges = [&](const unordered_map<int, vector<int>> &adj)
+        {
+            vector<pair<int, int>> edges;
+            for (auto &[node_id, neighbors] : adj)
             {
-                float score = cosine_similarity(node, neighbor);
-                all_scores.push_back({score, false});
+                int u = lower_bound(node_ids.begin(), node_ids.end(), node_id) - node_ids.begin();
+                for (int neighbor : neighbors)
+                {
+                    int v = lower_bound(node_ids.begin(), node_ids.end(), neighbor) - node_ids.begin();
+                    if (u != v)
+                        edges.push_back({min(u, v), max(u, v)});
+                }
             }
+            sort(edges.begin(), edges.end());
+            edges.erase(unique(edges.begin(), edges.end()), edges.end());
+            return CSRGraph::fromRowEdges(node_ids, edges);
+        };
+        CSRGraph test = rowEdges(test_pos_edges);
+        CSRGraph train = rowEdges(train_pos_g.adjList);
+        if (embedding_store.empty())
+            return ::evaluateRanking(FeatureMatrix::fromFeatureMap(test, feature_matrix), test, &train, options);
+
+        // Scoring reads the store once there is one (the float map may be
+        // released), so rank its dequantized rows
+        FeatureMatrix embeddings(test.numNodes(), embedding_store.dim);
+        for (int r = 0; r < test.numNodes(); r++)
+        {
+            int row = embedding_store.rowOf(test.node_ids[r]);
+            if (row < 0)
+                continue;
+            vector<float> values = embedding_store.dequantizeRow(row);
+            copy(values.begin(), values.end(), embeddings.row(r));
         }
-
-        return calculateAUC(all_scores);
+        return ::evaluateRanking(embeddings, test, &train, options);
     }
 
 private:
+    bool features_released = false;
+
     float dot_product(int u, int v)
     {
         vector<vector<float>> u_features = feature_matrix[u];
@@ -106,13 +341,25 @@ private:
         return score;
     }
 
-    float cosine_similarity(int u, int v)
+    // Read-only lookups, so it is safe to call from several threads at once
+    float cosine_similarity(int u, int v) const
     {
+        if (!embedding_store.empty())
+        {
+            return embedding_store.cosine(u, v);
+        }
         float score = 0.0f;
         float mag_a = 0.0f;
         float mag_b = 0.0f;
-        vector<vector<float>> u_features = feature_matrix[u];
-        vector<vector<float>> v_features = feature_matrix[v];
+        auto u_it = feature_matrix.find(u);
+        auto v_it = feature_matrix.find(v);
+        if (u_it == feature_matrix.end() || v_it == feature_matrix.end() ||
+            u_it->second.size() < 223 || v_it->second.size() < 223)
+        {
+            return 0.0f;
+        }
+        const vector<vector<float>> &u_features = u_it->second;
+        const vector<vector<float>> &v_features = v_it->second;
 
         for (int i = 0; i < 223; i++)
         {
@@ -175,48 +422,7 @@ private:
 
     float calculateAUC(const vector<pair<float, bool>> &scores)
     {
-        // Sort scores in descending order
-        vector<pair<float, bool>> sorted_scores = scores;
-        sort(sorted_scores.begin(), sorted_scores.end(),
-             [](const auto &a, const auto &b)
-             { return a.first > b.first; });
-
-        int positive_count = 0;
-        int negative_count = 0;
-
-        // Count positive and negative examples
-        for (const auto &score : sorted_scores)
-        {
-            if (score.second)
-                positive_count++;
-            else
-                negative_count++;
-        }
-
-        if (positive_count == 0 || negative_count == 0)
-        {
-            return 0.5; // Return random classifier score if only one class present
-        }
-
-        float auc = 0.0;
-        int positive_seen = 0;
-
-        // Calculate AUC using the rank formula
-        for (size_t i = 0; i < sorted_scores.size(); i++)
-        {
-            if (sorted_scores[i].second)
-            {
-                positive_seen++;
-            }
-            else
-            {
-                auc += positive_seen;
-            }
-        }
-
-        // Normalize AUC
-        auc /= (positive_count * negative_count);
-        return auc;
+        return exactAUC(scores);
     }
 };
 
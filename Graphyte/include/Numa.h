@@ -0,0 +1,395 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "Inference.h"
+#include "ThreadPool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// NUMA placement for the layer-wise engine: one pinned worker pool per node,
+// each computing a contiguous range of rows whose activation rows are bound
+// to that node's memory. Uses the Linux syscalls directly so no libnuma is
+// needed; elsewhere, and on single-node machines, it degrades to one pool
+// and the OS default placement.
+
+// mbind() modes and flags from <numaif.h>
+const int NUMA_MPOL_BIND = 2;
+const int NUMA_MPOL_INTERLEAVE = 3;
+const unsigned NUMA_MPOL_MF_MOVE = 1 << 1;
+
+enum NumaPlacement
+{
+    NUMA_FIRST_TOUCH, // leave pages wherever they were first written
+    NUMA_INTERLEAVE,  // pages round-robin over all nodes
+    NUMA_PARTITIONED, // each node's row range on its own memory
+};
+
+const char *numaPlacementName(NumaPlacement placement)
+{
+    switch (placement)
+    {
+    case NUMA_INTERLEAVE:
+        return "interleave";
+    case NUMA_PARTITIONED:
+        return "partitioned";
+    default:
+        return "first-touch";
+    }
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}, as in the sysfs cpu and node lists
+vector<int> parseCpuList(const string &list)
+{
+    vector<int> cpus;
+    stringstream ss(list);
+    string range;
+    while (getline(ss, range, ','))
+    {
+        if (range.empty() || range == "\n")
+            continue;
+        size_t dash = range.find('-');
+        int first = stoi(range.substr(0, dash));
+        int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+struct NumaTopology
+{
+    vector<int> node_ids;          // OS numbering, nodes without CPUs left out
+    vector<vector<int>> node_cpus; // CPUs of each entry in node_ids
+
+    int numNodes() const { return node_ids.size(); }
+
+    // From /sys/devices/system/node; a single node with every CPU otherwise
+    static NumaTopology detect()
+    {
+        NumaTopology topology;
+#ifdef __linux__
+        ifstream online("/sys/devices/system/node/online");
+        string nodes;
+        getline(online, nodes);
+        for (int node : parseCpuList(nodes))
+        {
+            ifstream file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+            string list;
+            getline(file, list);
+            vector<int> cpus = parseCpuList(list);
+            if (!cpus.empty())
+            {
+                topology.node_ids.push_back(node);
+                topology.node_cpus.push_back(cpus);
+            }
+        }
+#endif
+        if (topology.node_ids.empty())
+        {
+            topology.node_ids = {0};
+            topology.node_cpus.assign(1, vector<int>());
+            for (unsigned cpu = 0; cpu < max(1u, thread::hardware_concurrency()); cpu++)
+                topology.node_cpus[0].push_back(cpu);
+        }
+        return topology;
+    }
+};
+
+uintptr_t numaPageSize()
+{
+#ifdef __linux__
+    return sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+}
+
+bool pinCurrentThread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Applies a memory policy to the whole pages covering [addr, addr + bytes),
+// moving pages that already exist. False when the OS does not support it.
+bool setMemoryPolicy(const void *addr, size_t bytes, int mode, const vector<int> &nodes)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    if (bytes == 0 || nodes.empty())
+    {
+        return true;
+    }
+    const uintptr_t page = numaPageSize();
+    uintptr_t begin = (uintptr_t)addr / page * page;
+    uintptr_t end = ((uintptr_t)addr + bytes + page - 1) / page * page;
+    unsigned long mask[16] = {0}; // nodes 0-1023
+    for (int node : nodes)
+    {
+        mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+    }
+    return syscall(SYS_mbind, begin, end - begin, mode, mask, 8 * sizeof(mask) + 1, NUMA_MPOL_MF_MOVE) == 0;
+#else
+    (void)addr, (void)bytes, (void)mode, (void)nodes;
+    return false;
+#endif
+}
+
+// Node of every page in [addr, addr + bytes), or a negative errno for pages
+// that are not resident; empty when the OS cannot tell
+vector<int> pageNodes(const void *addr, size_t bytes)
+{
+    vector<int> nodes;
+#if defined(__linux__) && defined(SYS_move_pages)
+    const uintptr_t page = numaPageSize();
+    uintptr_t begin = (uintptr_t)addr / page * page;
+    size_t count = ((uintptr_t)addr + bytes + page - 1) / page - begin / page;
+    vector<void *> pages(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        pages[i] = (void *)(begin + i * page);
+    }
+    nodes.resize(count);
+    if (syscall(SYS_move_pages, 0, count, pages.data(), nullptr, nodes.data(), 0) != 0)
+    {
+        nodes.clear();
+    }
+#else
+    (void)addr, (void)bytes;
+#endif
+    return nodes;
+}
+
+// Kernel counters of pages allocated on the node the allocating thread ran
+// on (local) or elsewhere (other), summed over nodes. These count
+// allocations rather than loads, but are the only access split Linux exposes
+// without hardware counters.
+struct NumaCounters
+{
+    uint64_t local_node = 0;
+    uint64_t other_node = 0;
+
+    static NumaCounters read(const NumaTopology &topology)
+    {
+        NumaCounters counters;
+        for (int node : topology.node_ids)
+        {
+            ifstream file("/sys/devices/system/node/node" + to_string(node) + "/numastat");
+            string key;
+            uint64_t value;
+            while (file >> key >> value)
+            {
+                if (key == "local_node")
+                    counters.local_node += value;
+                else if (key == "other_node")
+                    counters.other_node += value;
+            }
+        }
+        return counters;
+    }
+};
+
+// One thread pool per NUMA node, workers pinned to that node's CPUs
+class NumaExecutor
+{
+public:
+    NumaTopology topology;
+    vector<unique_ptr<ThreadPool>> pools;
+
+    explicit NumaExecutor(const NumaTopology &topology = NumaTopology::detect(), bool pin = true) : topology(topology)
+    {
+        for (const vector<int> &cpus : topology.node_cpus)
+        {
+            function<void(size_t)> on_start = nullptr;
+            if (pin)
+            {
+                on_start = [cpus](size_t i)
+                { pinCurrentThread(cpus[i % cpus.size()]); };
+            }
+            pools.emplace_back(new ThreadPool(cpus.size(), on_start));
+        }
+    }
+
+    int numNodes() const { return topology.numNodes(); }
+
+    // Row boundaries, node n owning [ranges[n], ranges[n + 1]), sized by the
+    // node's CPU count
+    vector<int64_t> rowRanges(int64_t rows) const
+    {
+        size_t total = 0;
+        for (const vector<int> &cpus : topology.node_cpus)
+            total += cpus.size();
+        vector<int64_t> ranges(numNodes() + 1, 0);
+        size_t cpus_before = 0;
+        for (int n = 0; n < numNodes(); n++)
+        {
+            cpus_before += topology.node_cpus[n].size();
+            ranges[n + 1] = rows * cpus_before / total;
+        }
+        return ranges;
+    }
+
+    // fn(node, pool) on a worker of every node at once; returns when all are done
+    void forEachNode(const function<void(int, ThreadPool &)> &fn)
+    {
+        vector<future<void>> done;
+        for (int n = 0; n < numNodes(); n++)
+        {
+            ThreadPool &pool = *pools[n];
+            done.push_back(pool.submit([&fn, n, &pool]
+                                       { fn(n, pool); }));
+        }
+        for (future<void> &f : done)
+        {
+            f.get();
+        }
+    }
+
+    // Moves the matrix pages according to `placement`; rows follow rowRanges()
+    void placeRows(FeatureMatrix &m, NumaPlacement placement) const
+    {
+        if (placement == NUMA_INTERLEAVE)
+        {
+            setMemoryPolicy(m.data.data(), m.data.size() * sizeof(float), NUMA_MPOL_INTERLEAVE, topology.node_ids);
+        }
+        else if (placement == NUMA_PARTITIONED)
+        {
+            vector<int64_t> ranges = rowRanges(m.rows);
+            for (int n = 0; n < numNodes(); n++)
+            {
+                setMemoryPolicy(m.row(ranges[n]), (ranges[n + 1] - ranges[n]) * m.dim * sizeof(float), NUMA_MPOL_BIND,
+                                {topology.node_ids[n]});
+            }
+        }
+    }
+};
+
+// LayerwiseInference::run() with every node computing its own row range on
+// its own pinned workers, both activation buffers placed by `placement`
+const FeatureMatrix &numaInference(NumaExecutor &executor, LayerwiseInference &inference, const CSRGraph &g,
+                                   const FeatureMatrix &features, const vector<SAGELayer *> &layers,
+                                   NumaPlacement placement = NUMA_PARTITIONED)
+{
+    vector<int64_t> ranges = executor.rowRanges(g.numNodes());
+    inference.buffers[0] = features;
+    if (inference.buffers[1].rows != features.rows || inference.buffers[1].dim != features.dim)
+    {
+        inference.buffers[1] = FeatureMatrix(features.rows, features.dim);
+    }
+    executor.placeRows(inference.buffers[0], placement);
+    executor.placeRows(inference.buffers[1], placement);
+
+    FeatureMatrix transformed;
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        const FeatureMatrix &in = inference.buffers[l % 2];
+        FeatureMatrix &out = inference.buffers[(l + 1) % 2];
+        SAGELayer &layer = *layers[l];
+        if (layer.aggregator == AGGREGATE_POOL)
+        {
+            // Every node transforms its own rows once, before any node reads them
+            if (transformed.rows != in.rows || transformed.dim != layer.pool_aggregator.dim)
+            {
+                transformed = FeatureMatrix(in.rows, layer.pool_aggregator.dim);
+                executor.placeRows(transformed, placement);
+            }
+            executor.forEachNode([&](int n, ThreadPool &pool)
+                                 { pool.parallelFor(ranges[n], ranges[n + 1], [&](int64_t first, int64_t last)
+                                                    {
+                                                        for (int64_t r = first; r < last; r++)
+                                                            layer.pool_aggregator.transformRow(in.row(r), transformed.row(r)); },
+                                                    64); });
+        }
+        executor.forEachNode([&](int n, ThreadPool &pool)
+                             { inference.runLayer(g, in, out, layer, pool, ranges[n], ranges[n + 1],
+                                                  layer.aggregator == AGGREGATE_POOL ? &transformed : nullptr); });
+    }
+    return inference.buffers[layers.size() % 2];
+}
+
+// Where the rows of `m` live and how many row reads of one layer-wise pass
+// over `g` (each row's own row plus its neighbors') hit the reading node's
+// memory. Empty when the OS does not report page locations.
+struct NumaAccessReport
+{
+    vector<double> page_share; // fraction of resident pages on each node
+    double local_reads = 0.0;
+    bool available = false;
+};
+
+NumaAccessReport numaAccessReport(const NumaExecutor &executor, const CSRGraph &g, const FeatureMatrix &m)
+{
+    NumaAccessReport report;
+    vector<int> nodes = pageNodes(m.data.data(), m.data.size() * sizeof(float));
+    if (nodes.empty() || m.rows == 0)
+    {
+        return report;
+    }
+    report.available = true;
+    // OS node number -> executor node
+    vector<int> index_of(1024, -1);
+    for (int n = 0; n < executor.numNodes(); n++)
+        index_of[executor.topology.node_ids[n]] = n;
+
+    report.page_share.assign(executor.numNodes(), 0.0);
+    size_t resident = 0;
+    for (int node : nodes)
+    {
+        if (node >= 0 && node < 1024 && index_of[node] >= 0)
+        {
+            report.page_share[index_of[node]]++;
+            resident++;
+        }
+    }
+    for (double &share : report.page_share)
+        share /= max<size_t>(1, resident);
+
+    const uintptr_t page = numaPageSize();
+    const uintptr_t base = (uintptr_t)m.data.data() / page;
+    auto nodeOfRow = [&](int r)
+    {
+        int node = nodes[(uintptr_t)m.row(r) / page - base];
+        return (node >= 0 && node < 1024) ? index_of[node] : -1;
+    };
+    vector<int64_t> ranges = executor.rowRanges(g.numNodes());
+    uint64_t local = 0, total = 0;
+    for (int n = 0; n < executor.numNodes(); n++)
+    {
+        for (int64_t r = ranges[n]; r < ranges[n + 1]; r++)
+        {
+            local += nodeOfRow(r) == n;
+            for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                local += nodeOfRow(*it) == n;
+            total += 1 + g.degree(r);
+        }
+    }
+    report.local_reads = (double)local / max<uint64_t>(1, total);
+    return report;
+}
+
+#endif
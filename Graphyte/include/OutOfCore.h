@@ -0,0 +1,817 @@
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "Checkpoint.h" // platform headers, alignCheckpointOffset, syncAndClose
+#include "Random.h"
+#include "Training.h"
+using namespace std;
+
+// Graphs whose CSR and feature rows do not fit in memory. The rows are cut
+// into contiguous partitions and written to one file; OutOfCoreGraph maps the
+// file read-only and lets the OS page partitions in and out. Locality comes
+// from the row order, so reorder the graph (Reorder.h) before writing it.
+//
+// On-disk layout (native endianness, every section 64-byte aligned):
+//   PartitionFileHeader
+//   per partition   node ids (num_rows ints), offsets (num_rows + 1 int64,
+//                   relative to the partition's first edge), neighbors
+//                   (num_edges global rows), features (num_rows x dim floats)
+//   partition table num_partitions PartitionEntry
+const char PARTITION_FILE_MAGIC[8] = {'G', 'R', 'P', 'H', 'P', 'A', 'R', 'T'};
+const uint32_t PARTITION_FILE_VERSION = 1;
+
+struct PartitionFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t dim;
+    uint64_t num_nodes;
+    uint64_t num_edges;
+    uint64_t num_partitions;
+    uint64_t table_offset;
+    uint64_t file_size;
+};
+
+struct PartitionEntry
+{
+    uint64_t first_row;
+    uint64_t num_rows;
+    uint64_t num_edges;
+    uint64_t node_ids_offset;
+    uint64_t offsets_offset;
+    uint64_t neighbors_offset;
+    uint64_t features_offset;
+    uint64_t end_offset;
+};
+
+// Streams rows into a partition file, holding at most one partition in memory.
+// Rows must be added in order; neighbors are global row numbers.
+class PartitionWriter
+{
+public:
+    PartitionWriter(const PartitionWriter &) = delete;
+    PartitionWriter &operator=(const PartitionWriter &) = delete;
+
+    // Starts a new partition once the pending one reaches `partition_bytes`
+    PartitionWriter(const char *path, int dim, uint64_t partition_bytes = 64 << 20)
+        : dim(dim), partition_bytes(partition_bytes)
+    {
+        file = fopen(path, "wb");
+        if (!file)
+        {
+            cout << "Error opening file" << endl;
+            return;
+        }
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PARTITION_FILE_MAGIC, sizeof(header.magic));
+        header.version = PARTITION_FILE_VERSION;
+        header.dim = dim;
+        // The header is rewritten with the totals by finish()
+        ok = writeCheckpointSection(file, position, 0, &header, sizeof(header));
+        offsets.push_back(0);
+    }
+
+    ~PartitionWriter()
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+    }
+
+    bool good() const { return file && ok; }
+
+    void addRow(int node_id, const int *neighbors_begin, const int *neighbors_end, const float *feature)
+    {
+        node_ids.push_back(node_id);
+        neighbors.insert(neighbors.end(), neighbors_begin, neighbors_end);
+        offsets.push_back(neighbors.size());
+        features.insert(features.end(), feature, feature + dim);
+        if (pendingBytes() >= partition_bytes)
+        {
+            flushPartition();
+        }
+    }
+
+    // Writes the partition table and header; the file is complete once this
+    // returns true
+    bool finish()
+    {
+        if (!file)
+        {
+            return false;
+        }
+        flushPartition();
+        header.num_partitions = table.size();
+        header.table_offset = alignCheckpointOffset(position);
+        ok = ok && writeCheckpointSection(file, position, header.table_offset, table.data(), table.size() * sizeof(PartitionEntry));
+        header.file_size = position;
+        ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = syncAndClose(file) && ok;
+        file = nullptr;
+        if (!ok)
+        {
+            cout << "Error writing partition file" << endl;
+        }
+        return ok;
+    }
+
+private:
+    FILE *file = nullptr;
+    bool ok = false;
+    int dim;
+    uint64_t partition_bytes;
+    uint64_t position = 0;
+    PartitionFileHeader header;
+    vector<PartitionEntry> table;
+    vector<int> node_ids;
+    vector<int64_t> offsets;
+    vector<int> neighbors;
+    vector<float> features;
+
+    uint64_t pendingBytes() const
+    {
+        return node_ids.size() * (sizeof(int) + sizeof(int64_t) + dim * sizeof(float)) + neighbors.size() * sizeof(int);
+    }
+
+    void flushPartition()
+    {
+        if (node_ids.empty() || !ok)
+        {
+            return;
+        }
+        PartitionEntry entry;
+        entry.first_row = header.num_nodes;
+        entry.num_rows = node_ids.size();
+        entry.num_edges = neighbors.size();
+        entry.node_ids_offset = alignCheckpointOffset(position);
+        entry.offsets_offset = alignCheckpointOffset(entry.node_ids_offset + entry.num_rows * sizeof(int));
+        entry.neighbors_offset = alignCheckpointOffset(entry.offsets_offset + (entry.num_rows + 1) * sizeof(int64_t));
+        entry.features_offset = alignCheckpointOffset(entry.neighbors_offset + entry.num_edges * sizeof(int));
+        entry.end_offset = entry.features_offset + entry.num_rows * dim * sizeof(float);
+        ok = writeCheckpointSection(file, position, entry.node_ids_offset, node_ids.data(), node_ids.size() * sizeof(int)) &&
+             writeCheckpointSection(file, position, entry.offsets_offset, offsets.data(), offsets.size() * sizeof(int64_t)) &&
+             writeCheckpointSection(file, position, entry.neighbors_offset, neighbors.data(), neighbors.size() * sizeof(int)) &&
+             writeCheckpointSection(file, position, entry.features_offset, features.data(), features.size() * sizeof(float));
+        table.push_back(entry);
+        header.num_nodes += entry.num_rows;
+        header.num_edges += entry.num_edges;
+
+        node_ids.clear();
+        offsets.assign(1, 0);
+        neighbors.clear();
+        features.clear();
+    }
+};
+
+// Writes an in-memory graph, e.g. to build test files or convert small graphs
+bool writePartitionedGraph(const char *path, const CSRGraph &g, const FeatureMatrix &features,
+                           uint64_t partition_bytes = 64 << 20)
+{
+    PartitionWriter writer(path, features.dim, partition_bytes);
+    for (int r = 0; r < g.numNodes() && writer.good(); r++)
+    {
+        writer.addRow(g.node_ids[r], g.neighborsBegin(r), g.neighborsEnd(r), features.row(r));
+    }
+    return writer.good() && writer.finish();
+}
+
+// Granularity of madvise() ranges and of the prefetch reads
+uint64_t partitionPageSize()
+{
+#ifdef _WIN32
+    return 4096;
+#else
+    static const uint64_t page = sysconf(_SC_PAGESIZE);
+    return page;
+#endif
+}
+
+// One partition of a mapped graph; pointers point straight into the mapping
+struct PartitionView
+{
+    int64_t first_row = 0;
+    int64_t num_rows = 0;
+    const int *node_ids = nullptr;
+    const int64_t *offsets = nullptr;
+    const int *neighbors = nullptr; // global rows
+    const float *features = nullptr;
+
+    int degree(int64_t local_row) const { return offsets[local_row + 1] - offsets[local_row]; }
+
+    const int *neighborsBegin(int64_t local_row) const { return neighbors + offsets[local_row]; }
+
+    const int *neighborsEnd(int64_t local_row) const { return neighbors + offsets[local_row + 1]; }
+};
+
+// Read-only mapping of a partition file. Apart from the adjacency, which
+// open() reads once to validate it, nothing is loaded up front: pages are
+// read on first touch, prefetch() reads a partition ahead of use and
+// release() hands its pages back to the OS.
+class OutOfCoreGraph
+{
+public:
+    PartitionFileHeader header;
+    vector<PartitionEntry> table;
+
+    OutOfCoreGraph() {}
+    OutOfCoreGraph(const OutOfCoreGraph &) = delete;
+    OutOfCoreGraph &operator=(const OutOfCoreGraph &) = delete;
+    ~OutOfCoreGraph() { close(); }
+
+    bool open(const char *path)
+    {
+        close();
+        uint64_t size = 0;
+#ifdef _WIN32
+        file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_handle == INVALID_HANDLE_VALUE)
+        {
+            cout << "Error opening file" << endl;
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file_handle, &file_size);
+        size = file_size.QuadPart;
+        if (size >= sizeof(PartitionFileHeader))
+        {
+            mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping_handle != NULL)
+            {
+                data = (const char *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+            }
+        }
+#else
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            cout << "Error opening file" << endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+        {
+            size = st.st_size;
+        }
+        if (size >= sizeof(PartitionFileHeader))
+        {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            data = (mapped == MAP_FAILED) ? nullptr : (const char *)mapped;
+        }
+#endif
+        mapped_size = size;
+        if (!data)
+        {
+            cout << "Error mapping partition file" << endl;
+            close();
+            return false;
+        }
+
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, PARTITION_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != PARTITION_FILE_VERSION ||
+            header.file_size != size || header.dim == 0 || header.num_nodes > INT_MAX || header.table_offset > size ||
+            header.table_offset % CHECKPOINT_ALIGNMENT != 0 || header.num_partitions > (size - header.table_offset) / sizeof(PartitionEntry))
+        {
+            cout << "Error: partition file is truncated or corrupt" << endl;
+            close();
+            return false;
+        }
+        const PartitionEntry *entries = (const PartitionEntry *)(data + header.table_offset);
+        table.assign(entries, entries + header.num_partitions);
+        if (!validPartitions())
+        {
+            cout << "Error: partition file is truncated or corrupt" << endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping_handle != NULL)
+            CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(file_handle);
+        mapping_handle = NULL;
+        file_handle = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap((void *)data, mapped_size);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        mapped_size = 0;
+        table.clear();
+    }
+
+    bool isOpen() const { return data != nullptr; }
+
+    int64_t numNodes() const { return header.num_nodes; }
+
+    int64_t numEdges() const { return header.num_edges; }
+
+    int dim() const { return header.dim; }
+
+    int numPartitions() const { return table.size(); }
+
+    PartitionView partition(int p) const
+    {
+        const PartitionEntry &entry = table[p];
+        PartitionView view;
+        view.first_row = entry.first_row;
+        view.num_rows = entry.num_rows;
+        view.node_ids = (const int *)(data + entry.node_ids_offset);
+        view.offsets = (const int64_t *)(data + entry.offsets_offset);
+        view.neighbors = (const int *)(data + entry.neighbors_offset);
+        view.features = (const float *)(data + entry.features_offset);
+        return view;
+    }
+
+    // Partition holding `row`, or -1 if the row is out of range
+    int partitionOf(int64_t row) const
+    {
+        if (row < 0 || row >= numNodes())
+        {
+            return -1;
+        }
+        auto it = upper_bound(table.begin(), table.end(), (uint64_t)row, [](uint64_t r, const PartitionEntry &entry)
+                              { return r < entry.first_row; });
+        return (it - table.begin()) - 1;
+    }
+
+    // Feature row of any global row, faulting its page in if needed; nullptr
+    // if the row is out of range
+    const float *featureRow(int64_t row) const
+    {
+        int p = partitionOf(row);
+        if (p < 0)
+        {
+            return nullptr;
+        }
+        const PartitionEntry &entry = table[p];
+        return (const float *)(data + entry.features_offset) + (row - entry.first_row) * header.dim;
+    }
+
+    // Node id of any global row, or -1 if the row is out of range
+    int nodeId(int64_t row) const
+    {
+        int p = partitionOf(row);
+        return p < 0 ? -1 : ((const int *)(data + table[p].node_ids_offset))[row - table[p].first_row];
+    }
+
+    uint64_t partitionBytes(int p) const { return table[p].end_offset - table[p].node_ids_offset; }
+
+    // Reads every page of the partition so later accesses do not block on I/O
+    void prefetch(int p) const
+    {
+        const PartitionEntry &entry = table[p];
+        const uint64_t page = partitionPageSize();
+#ifndef _WIN32
+        uint64_t begin = entry.node_ids_offset / page * page;
+        madvise((void *)(data + begin), entry.end_offset - begin, MADV_WILLNEED);
+#endif
+        volatile char sink = 0;
+        for (uint64_t offset = entry.node_ids_offset; offset < entry.end_offset; offset += page)
+        {
+            sink = sink + data[offset];
+        }
+        (void)sink;
+    }
+
+    // Drops the partition's pages from this process and, where supported,
+    // from the page cache; they are read again from disk on the next touch
+    void release(int p) const
+    {
+#ifndef _WIN32
+        const PartitionEntry &entry = table[p];
+        const uint64_t page = partitionPageSize();
+        uint64_t begin = entry.node_ids_offset / page * page;
+        madvise((void *)(data + begin), entry.end_offset - begin, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(fd, begin, entry.end_offset - begin, POSIX_FADV_DONTNEED);
+#endif
+#else
+        (void)p;
+#endif
+    }
+
+private:
+    const char *data = nullptr;
+    uint64_t mapped_size = 0;
+
+    // Partitions must cover rows 0 .. num_nodes in order with their sections
+    // aligned, in order and inside the file, and every offset and neighbor
+    // must be in range, so no later access can leave the mapping. Each
+    // partition's pages are released again once checked.
+    bool validPartitions() const
+    {
+        const uint64_t limit = header.table_offset;
+        uint64_t rows = 0, edges = 0, end = sizeof(PartitionFileHeader);
+        for (size_t p = 0; p < table.size(); p++)
+        {
+            const PartitionEntry &entry = table[p];
+            const uint64_t sections[5] = {entry.node_ids_offset, entry.offsets_offset, entry.neighbors_offset, entry.features_offset, entry.end_offset};
+            for (uint64_t offset : sections)
+            {
+                if (offset > limit || (offset != entry.end_offset && offset % CHECKPOINT_ALIGNMENT != 0))
+                    return false;
+            }
+            // Bounding the counts by the file size keeps the sums below from overflowing
+            if (entry.first_row != rows || entry.num_rows > limit / sizeof(int) || entry.num_edges > limit / sizeof(int) ||
+                entry.node_ids_offset < end ||
+                entry.offsets_offset < entry.node_ids_offset + entry.num_rows * sizeof(int) ||
+                entry.neighbors_offset < entry.offsets_offset + (entry.num_rows + 1) * sizeof(int64_t) ||
+                entry.features_offset < entry.neighbors_offset + entry.num_edges * sizeof(int) ||
+                entry.num_rows > (limit - entry.features_offset) / ((uint64_t)header.dim * sizeof(float)) ||
+                entry.end_offset != entry.features_offset + entry.num_rows * header.dim * sizeof(float))
+                return false;
+            rows += entry.num_rows;
+            edges += entry.num_edges;
+            end = entry.end_offset;
+            if (rows > header.num_nodes || edges > header.num_edges)
+                return false;
+
+            const int64_t *offsets = (const int64_t *)(data + entry.offsets_offset);
+            const int *neighbors = (const int *)(data + entry.neighbors_offset);
+            if (offsets[0] != 0 || offsets[entry.num_rows] != (int64_t)entry.num_edges)
+                return false;
+            for (uint64_t r = 0; r < entry.num_rows; r++)
+            {
+                if (offsets[r + 1] < offsets[r])
+                    return false;
+            }
+            for (uint64_t e = 0; e < entry.num_edges; e++)
+            {
+                if (neighbors[e] < 0 || (uint64_t)neighbors[e] >= header.num_nodes)
+                    return false;
+            }
+            release(p);
+        }
+        return rows == header.num_nodes && edges == header.num_edges;
+    }
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = NULL;
+#else
+    int fd = -1;
+#endif
+};
+
+// Background thread that pages in the partition the sampler will move to next
+class PartitionPrefetcher
+{
+public:
+    explicit PartitionPrefetcher(const OutOfCoreGraph &graph) : graph(graph), worker(&PartitionPrefetcher::run, this) {}
+
+    PartitionPrefetcher(const PartitionPrefetcher &) = delete;
+    PartitionPrefetcher &operator=(const PartitionPrefetcher &) = delete;
+
+    ~PartitionPrefetcher()
+    {
+        {
+            lock_guard<mutex> lock(state_mutex);
+            running = false;
+        }
+        state_cv.notify_all();
+        worker.join();
+    }
+
+    // Replaces any request that has not started yet
+    void request(int p)
+    {
+        {
+            lock_guard<mutex> lock(state_mutex);
+            pending = p;
+        }
+        state_cv.notify_all();
+    }
+
+    // Blocks until partition `p` has been prefetched or is no longer queued
+    void wait(int p)
+    {
+        unique_lock<mutex> lock(state_mutex);
+        state_cv.wait(lock, [&]
+                      { return pending != p && active != p; });
+    }
+
+private:
+    const OutOfCoreGraph &graph;
+    mutex state_mutex;
+    condition_variable state_cv;
+    int pending = -1;
+    int active = -1;
+    bool running = true;
+    thread worker;
+
+    void run()
+    {
+        unique_lock<mutex> lock(state_mutex);
+        while (true)
+        {
+            state_cv.wait(lock, [&]
+                          { return !running || pending >= 0; });
+            if (!running)
+            {
+                return;
+            }
+            active = pending;
+            pending = -1;
+            lock.unlock();
+            graph.prefetch(active);
+            lock.lock();
+            active = -1;
+            state_cv.notify_all();
+        }
+    }
+};
+
+// Mini-batch of target rows with up to `fanout` sampled neighbors each; all
+// rows are global, features come from OutOfCoreGraph::featureRow
+struct OutOfCoreBatch
+{
+    int partition = 0;
+    vector<int64_t> targets;
+    vector<int64_t> offsets; // neighbors of targets[i]: [offsets[i], offsets[i + 1])
+    vector<int> neighbors;
+};
+
+// Schedules mini-batches partition by partition, so each batch's targets,
+// adjacency and own features come from one resident partition. While a
+// partition is being consumed the prefetcher pages in the next one; finished
+// partitions can be released to keep the resident set near two partitions.
+class OutOfCoreSampler
+{
+public:
+    int batch_size = 512;
+    int fanout = 10;
+    bool prefetch = true;
+    bool release_finished = true;
+    uint64_t seed = 0;
+
+    explicit OutOfCoreSampler(const OutOfCoreGraph &graph) : graph(graph) {}
+
+    // One epoch: partitions in a shuffled order, rows shuffled within each
+    // partition. Returns the number of batches delivered.
+    size_t runEpoch(int epoch, const function<void(const OutOfCoreBatch &)> &consume)
+    {
+        // Stream epoch << 32 orders the partitions, the p + 1st after it
+        // shuffles and samples partition p
+        const uint64_t epoch_stream = (uint64_t)epoch << 32;
+        vector<int> order(graph.numPartitions());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        counterShuffle(order, CounterRandom(seed, epoch_stream));
+
+        unique_ptr<PartitionPrefetcher> prefetcher;
+        if (prefetch && !order.empty())
+        {
+            prefetcher.reset(new PartitionPrefetcher(graph));
+            prefetcher->request(order[0]);
+        }
+
+        size_t num_batches = 0;
+        OutOfCoreBatch batch;
+        vector<int64_t> rows;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            int p = order[i];
+            if (prefetcher)
+            {
+                prefetcher->wait(p);
+                if (i + 1 < order.size())
+                {
+                    prefetcher->request(order[i + 1]);
+                }
+            }
+            PartitionView view = graph.partition(p);
+            rows.resize(view.num_rows);
+            for (int64_t r = 0; r < view.num_rows; r++)
+            {
+                rows[r] = r;
+            }
+            // The shuffle takes the first rows.size() draws, neighbor samples the rest
+            CounterRandom partition_random(seed, epoch_stream + p + 1);
+            counterShuffle(rows, partition_random);
+            uint64_t draw = rows.size();
+
+            for (size_t start = 0; start < rows.size(); start += batch_size)
+            {
+                size_t end = min(rows.size(), start + (size_t)batch_size);
+                batch.partition = p;
+                batch.targets.clear();
+                batch.offsets.assign(1, 0);
+                batch.neighbors.clear();
+                for (size_t j = start; j < end; j++)
+                {
+                    int64_t local = rows[j];
+                    batch.targets.push_back(view.first_row + local);
+                    const int *begin = view.neighborsBegin(local);
+                    int degree = view.degree(local);
+                    if (degree <= fanout)
+                    {
+                        batch.neighbors.insert(batch.neighbors.end(), begin, begin + degree);
+                    }
+                    else
+                    {
+                        // Without replacement: partial Floyd sample of positions
+                        size_t first = batch.neighbors.size();
+                        for (int k = degree - fanout; k < degree; k++)
+                        {
+                            int pick = partition_random.below(draw++, k + 1);
+                            int neighbor = begin[pick];
+                            if (find(batch.neighbors.begin() + first, batch.neighbors.end(), neighbor) != batch.neighbors.end())
+                            {
+                                neighbor = begin[k];
+                            }
+                            batch.neighbors.push_back(neighbor);
+                        }
+                    }
+                    batch.offsets.push_back(batch.neighbors.size());
+                }
+                consume(batch);
+                num_batches++;
+            }
+            if (release_finished)
+            {
+                graph.release(p);
+            }
+        }
+        return num_batches;
+    }
+
+private:
+    const OutOfCoreGraph &graph;
+};
+
+// Link-prediction training over a partition file, one partition at a time.
+// Each partition is loaded with its halo (the rows adjacent to it) into an
+// in-memory subgraph, and SAGETrainer makes one pass over the subgraph's
+// edges. Halo rows keep only their edges into the partition, so their
+// lower-layer outputs see part of their neighborhood, and negatives are
+// drawn from the subgraph. Edges between partitions are trained from both
+// sides. Weights and Adam moments carry over from one partition to the next,
+// and only one subgraph is held in memory at a time.
+class OutOfCoreTrainer
+{
+public:
+    TrainingOptions options;
+    bool prefetch = true;
+    bool release_finished = true;
+
+    // `layers` must take graph.dim() wide inputs
+    OutOfCoreTrainer(const OutOfCoreGraph &graph, const vector<SAGELayer *> &layers, vector<float> &optimizer_state,
+                     uint64_t &optimizer_step, TrainingOptions options = TrainingOptions())
+        : options(options), graph(graph), layers(layers), optimizer_state(optimizer_state), optimizer_step(optimizer_step) {}
+
+    // One pass over every partition, in a shuffled order. The loss is the mean
+    // over all scored pairs; partition i of epoch e trains as SAGETrainer
+    // epoch e * partitions + i, so every partition draws its own negatives.
+    EpochStats runEpoch(int epoch, ThreadPool &pool = defaultThreadPool())
+    {
+        auto start = chrono::steady_clock::now();
+        EpochStats stats;
+        if (layers.empty() || (int)layers[0]->weights.size() != graph.dim())
+        {
+            cout << "Error: layer width does not match the partition file" << endl;
+            return stats;
+        }
+        const int num_partitions = graph.numPartitions();
+        vector<int> order(num_partitions);
+        for (int i = 0; i < num_partitions; i++)
+        {
+            order[i] = i;
+        }
+        counterShuffle(order, CounterRandom(options.seed, ((uint64_t)epoch << 32) | 0xffffffffu));
+
+        unique_ptr<PartitionPrefetcher> prefetcher;
+        if (prefetch && !order.empty())
+        {
+            prefetcher.reset(new PartitionPrefetcher(graph));
+            prefetcher->request(order[0]);
+        }
+        double loss_sum = 0.0;
+        size_t edges = 0;
+        CSRGraph local;
+        FeatureMatrix inputs;
+        for (int i = 0; i < num_partitions; i++)
+        {
+            int p = order[i];
+            if (prefetcher)
+            {
+                prefetcher->wait(p);
+                if (i + 1 < num_partitions)
+                {
+                    prefetcher->request(order[i + 1]);
+                }
+            }
+            loadPartition(p, local, inputs);
+            if (release_finished)
+            {
+                graph.release(p);
+            }
+            if (local.numEdges() == 0)
+            {
+                continue;
+            }
+            SAGETrainer trainer(local, inputs, layers, optimizer_state, optimizer_step, options);
+            EpochStats partition_stats = trainer.runEpoch(epoch * num_partitions + i, pool);
+            trainer.store();
+            loss_sum += partition_stats.loss * local.numEdges();
+            edges += local.numEdges();
+            stats.steps += partition_stats.steps;
+        }
+        stats.loss = loss_sum / max<size_t>(1, edges);
+        stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+    // Rows of partition `p` followed by its halo rows, with their feature rows
+    // copied out of the mapping
+    void loadPartition(int p, CSRGraph &local, FeatureMatrix &inputs) const
+    {
+        PartitionView view = graph.partition(p);
+        const int num_owned = view.num_rows;
+        unordered_map<int, int> halo; // global row -> local row
+        vector<int> halo_rows;
+        vector<pair<int, int>> halo_edges; // (halo local row, owned local row)
+        local = CSRGraph();
+        local.node_ids.assign(view.node_ids, view.node_ids + num_owned);
+        for (int r = 0; r < num_owned; r++)
+        {
+            for (const int *it = view.neighborsBegin(r); it != view.neighborsEnd(r); it++)
+            {
+                int64_t owned = *it - view.first_row;
+                if (owned >= 0 && owned < num_owned)
+                {
+                    local.neighbors.push_back(owned);
+                    continue;
+                }
+                auto inserted = halo.emplace(*it, num_owned + halo_rows.size());
+                if (inserted.second)
+                    halo_rows.push_back(*it);
+                local.neighbors.push_back(inserted.first->second);
+                halo_edges.push_back({inserted.first->second, r});
+            }
+            local.offsets.push_back(local.neighbors.size());
+        }
+        // Halo rows in order of first appearance, each with its owned neighbors in row order
+        stable_sort(halo_edges.begin(), halo_edges.end(), [](const pair<int, int> &a, const pair<int, int> &b)
+                    { return a.first < b.first; });
+        size_t e = 0;
+        for (size_t h = 0; h < halo_rows.size(); h++)
+        {
+            local.node_ids.push_back(graph.nodeId(halo_rows[h]));
+            for (; e < halo_edges.size() && halo_edges[e].first == num_owned + (int)h; e++)
+                local.neighbors.push_back(halo_edges[e].second);
+            local.offsets.push_back(local.neighbors.size());
+        }
+        local.id_order.resize(local.numNodes());
+        for (int r = 0; r < local.numNodes(); r++)
+        {
+            local.id_order[r] = r;
+        }
+        sort(local.id_order.begin(), local.id_order.end(), [&](int a, int b)
+             { return local.node_ids[a] < local.node_ids[b]; });
+
+        const int dim = graph.dim();
+        inputs = FeatureMatrix(local.numNodes(), dim);
+        copy(view.features, view.features + (size_t)num_owned * dim, inputs.data.data());
+        for (size_t h = 0; h < halo_rows.size(); h++)
+        {
+            const float *src = graph.featureRow(halo_rows[h]);
+            copy(src, src + dim, inputs.row(num_owned + h));
+        }
+    }
+
+private:
+    const OutOfCoreGraph &graph;
+    vector<SAGELayer *> layers;
+    vector<float> &optimizer_state;
+    uint64_t &optimizer_step;
+};
+
+#endif
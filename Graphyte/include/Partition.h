@@ -0,0 +1,614 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <algorithm>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "Reorder.h"
+#include "Inference.h"
+#include "Model.h"
+#include "Training.h"
+#include "ThreadPool.h"
+#include "Random.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// k-way balanced partition of the rows: communityOrder() cut into k equal
+// contiguous pieces, then refined by label propagation that moves a row to
+// the partition holding most of its neighbors as long as that partition stays
+// within (1 + imbalance) of the average size. Returns the partition of each row.
+vector<int> partitionGraph(const CSRGraph &g, int k, int iterations = 10, float imbalance = 0.05f, uint64_t seed = 0)
+{
+    const int n = g.numNodes();
+    vector<int> part(n, 0);
+    if (k <= 1 || n == 0)
+    {
+        return part;
+    }
+    vector<int> order = communityOrder(g);
+    vector<int> sizes(k, 0);
+    for (int i = 0; i < n; i++)
+    {
+        part[order[i]] = (int64_t)i * k / n;
+        sizes[part[order[i]]]++;
+    }
+
+    const int capacity = (int)ceil((double)n / k * (1.0 + imbalance));
+    vector<int> counts(k, 0);
+    vector<int> touched;
+    for (int iter = 0; iter < iterations; iter++)
+    {
+        counterShuffle(order, CounterRandom(seed, iter));
+        int moves = 0;
+        for (int u : order)
+        {
+            touched.clear();
+            for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+            {
+                if (counts[part[*it]]++ == 0)
+                    touched.push_back(part[*it]);
+            }
+            int best = part[u];
+            for (int p : touched)
+            {
+                if (counts[p] > counts[best] && sizes[p] < capacity)
+                    best = p;
+            }
+            for (int p : touched)
+                counts[p] = 0;
+            if (best != part[u])
+            {
+                sizes[part[u]]--;
+                sizes[best]++;
+                part[u] = best;
+                moves++;
+            }
+        }
+        if (moves == 0)
+        {
+            break;
+        }
+    }
+    return part;
+}
+
+// Undirected edges whose endpoints are in different partitions
+int64_t edgeCut(const CSRGraph &g, const vector<int> &part)
+{
+    int64_t cut = 0;
+    for (int u = 0; u < g.numNodes(); u++)
+    {
+        for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+        {
+            cut += part[u] != part[*it];
+        }
+    }
+    return cut / 2;
+}
+
+// The rows of one partition plus its halo: the rows of other partitions that
+// its own rows are adjacent to. Owned rows come first in the local CSR and
+// keep all their edges; halo rows have none, their activations arrive from
+// the partitions that own them.
+struct GraphPartition
+{
+    int id = 0;
+    int num_owned = 0;
+    vector<int> rows;     // global row of every local row
+    vector<char> boundary; // owned rows that are in another partition's halo
+    CSRGraph local;
+
+    int numHalo() const { return rows.size() - num_owned; }
+};
+
+GraphPartition buildPartition(const CSRGraph &g, const vector<int> &part, int p)
+{
+    GraphPartition result;
+    result.id = p;
+    vector<int> local_row(g.numNodes(), -1);
+    for (int u = 0; u < g.numNodes(); u++)
+    {
+        if (part[u] == p)
+        {
+            local_row[u] = result.rows.size();
+            result.rows.push_back(u);
+        }
+    }
+    result.num_owned = result.rows.size();
+    result.boundary.assign(result.num_owned, 0);
+    for (int i = 0; i < result.num_owned; i++)
+    {
+        int u = result.rows[i];
+        for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+        {
+            if (part[*it] == p)
+                continue;
+            result.boundary[i] = 1;
+            if (local_row[*it] < 0)
+            {
+                local_row[*it] = result.rows.size();
+                result.rows.push_back(*it);
+            }
+        }
+    }
+
+    CSRGraph &local = result.local;
+    local.node_ids.resize(result.rows.size());
+    local.offsets.assign(result.rows.size() + 1, 0);
+    for (size_t i = 0; i < result.rows.size(); i++)
+    {
+        int u = result.rows[i];
+        local.node_ids[i] = g.node_ids[u];
+        if ((int)i < result.num_owned)
+        {
+            // Same order as the global row, so sums round exactly as they do
+            // over the whole graph
+            for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+                local.neighbors.push_back(local_row[*it]);
+        }
+        local.offsets[i + 1] = local.neighbors.size();
+    }
+    // Local rows are not in id order, so rowOf() needs the sorted index
+    local.id_order.resize(result.rows.size());
+    for (size_t i = 0; i < result.rows.size(); i++)
+    {
+        local.id_order[i] = i;
+    }
+    sort(local.id_order.begin(), local.id_order.end(), [&](int a, int b)
+         { return local.node_ids[a] < local.node_ids[b]; });
+    return result;
+}
+
+#ifndef _WIN32
+
+// Barrier for worker processes, living in shared memory. `failed` lets the
+// parent release everyone when a worker dies.
+struct ProcessBarrier
+{
+    atomic<uint32_t> waiting{0};
+    atomic<uint32_t> generation{0};
+    atomic<int> failed{0};
+    uint32_t parties = 0;
+
+    bool wait()
+    {
+        uint32_t current = generation.load();
+        if (waiting.fetch_add(1) + 1 == parties)
+        {
+            waiting.store(0);
+            generation.fetch_add(1);
+            return true;
+        }
+        while (generation.load() == current)
+        {
+            if (failed.load())
+            {
+                return false;
+            }
+            this_thread::yield();
+        }
+        return true;
+    }
+};
+
+static_assert(atomic<uint32_t>::is_always_lock_free, "ProcessBarrier needs address-free atomics");
+
+// Final embeddings of the training graph computed by one worker process per
+// partition, like SAGEModel::computeEmbeddings(). Each worker keeps its own
+// rows and halo in private memory. After every layer it publishes its
+// boundary rows to a shared table and reads its halo rows back from it.
+// Returns false if a worker could not be started or failed.
+bool computeEmbeddingsPartitioned(SAGEModel &model, int num_partitions)
+{
+    const int dim = 223;
+    CSRGraph g = CSRGraph::fromGraph(model.train_pos_g);
+    vector<int> part = partitionGraph(g, num_partitions);
+    vector<GraphPartition> partitions;
+    for (int p = 0; p < num_partitions; p++)
+    {
+        partitions.push_back(buildPartition(g, part, p));
+    }
+    vector<SAGELayer *> layers = {&model.pos_layer1, &model.pos_layer2};
+
+    // Barrier, then one row per node: boundary rows between layers, every row
+    // after the last layer
+    const size_t header_bytes = 64;
+    const size_t shared_bytes = header_bytes + (size_t)g.numNodes() * dim * sizeof(float);
+    void *mapped = mmap(nullptr, shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+    {
+        cout << "Error mapping shared memory" << endl;
+        return false;
+    }
+    ProcessBarrier *barrier = new (mapped) ProcessBarrier();
+    barrier->parties = num_partitions;
+    float *shared_rows = (float *)((char *)mapped + header_bytes);
+
+    auto worker = [&](const GraphPartition &partition)
+    {
+        // Threads do not survive fork(), so each worker gets a fresh pool
+        ThreadPool pool(1);
+        LayerwiseInference inference;
+        FeatureMatrix in = FeatureMatrix::fromFeatureMap(partition.local, model.input_features, dim);
+        FeatureMatrix out(in.rows, dim);
+        for (size_t l = 0; l < layers.size(); l++)
+        {
+            inference.runLayer(partition.local, in, out, *layers[l], pool, 0, partition.num_owned);
+            bool last = l + 1 == layers.size();
+            for (int i = 0; i < partition.num_owned; i++)
+            {
+                if (last || partition.boundary[i])
+                    copy(out.row(i), out.row(i) + dim, shared_rows + (size_t)partition.rows[i] * dim);
+            }
+            if (last)
+            {
+                break;
+            }
+            if (!barrier->wait())
+            {
+                return false;
+            }
+            for (size_t i = partition.num_owned; i < partition.rows.size(); i++)
+            {
+                const float *src = shared_rows + (size_t)partition.rows[i] * dim;
+                copy(src, src + dim, out.row(i));
+            }
+            // Nobody may overwrite the table before every halo has been read
+            if (!barrier->wait())
+            {
+                return false;
+            }
+            swap(in, out);
+        }
+        return true;
+    };
+
+    cout.flush();
+    vector<pid_t> children;
+    for (int p = 0; p < num_partitions; p++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            _exit(worker(partitions[p]) ? 0 : 1);
+        }
+        if (pid < 0)
+        {
+            cout << "Error starting worker process" << endl;
+            barrier->failed.store(1);
+            break;
+        }
+        children.push_back(pid);
+    }
+    bool ok = (int)children.size() == num_partitions;
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            barrier->failed.store(1);
+            ok = false;
+        }
+    }
+
+    if (ok)
+    {
+        for (int r = 0; r < g.numNodes(); r++)
+        {
+            vector<vector<float>> embedding(dim, vector<float>(1, 0.0f));
+            const float *src = shared_rows + (size_t)r * dim;
+            for (int i = 0; i < dim; i++)
+            {
+                embedding[i][0] = src[i];
+            }
+            model.setEmbedding(g.node_ids[r], embedding);
+        }
+    }
+    else
+    {
+        cout << "Error: partitioned worker failed" << endl;
+    }
+    barrier->~ProcessBarrier();
+    munmap(mapped, shared_bytes);
+    return ok;
+}
+
+// Link-prediction training of the model's layers by one worker process per
+// partition, with the batches, negatives and loss of SAGETrainer's
+// synchronous epochs (the asynchronous and historical options do not apply).
+// Each step runs the whole training graph through the layers. Workers
+// compute their own rows, exchanging boundary activations between layers as
+// computeEmbeddingsPartitioned() does, and publish every row's last-layer
+// output so pairs can be scored across partitions; a pair's gradient goes to
+// the owners of its two rows. On the way back each worker sends the gradient
+// of its halo rows to their owners through the shared table. The weight
+// gradients of all workers are summed there in worker order, so every worker
+// applies the same Adam update to its own copy of the weights. Returns the
+// loss of every epoch, or nothing if a worker could not be started or failed.
+vector<double> trainPartitioned(SAGEModel &model, int num_partitions, int num_epochs = 5, TrainingOptions options = TrainingOptions())
+{
+    vector<double> losses;
+    vector<SAGELayer *> layers = {&model.pos_layer1, &model.pos_layer2};
+    for (SAGELayer *layer : layers)
+    {
+        if (layer->aggregator != AGGREGATE_MEAN && layer->aggregator != AGGREGATE_SUM)
+        {
+            cout << "Error: training supports only mean and sum aggregators" << endl;
+            return losses;
+        }
+    }
+    const int num_layers = layers.size();
+    const int dim = model.pos_layer1.weights.size();
+    const size_t width = 2 * dim, layer_size = (size_t)dim * width;
+    const size_t num_parameters = num_layers * layer_size, state_size = 2 * num_parameters;
+    CSRGraph g = CSRGraph::fromGraph(model.train_pos_g);
+    const int n = g.numNodes();
+    vector<int> part = partitionGraph(g, num_partitions);
+    vector<GraphPartition> partitions;
+    for (int p = 0; p < num_partitions; p++)
+    {
+        partitions.push_back(buildPartition(g, part, p));
+    }
+    const vector<pair<int, int>> edges = trainingEdges(g);
+
+    // Where each worker's halo gradients go in the shared table, and for each
+    // owner the halo rows of every other worker that it owns:
+    // imports[p][q] holds (halo index in q, local row in p)
+    vector<int> local_of(n);
+    vector<size_t> halo_offset(num_partitions + 1, 0);
+    for (int p = 0; p < num_partitions; p++)
+    {
+        for (int i = 0; i < partitions[p].num_owned; i++)
+            local_of[partitions[p].rows[i]] = i;
+        halo_offset[p + 1] = halo_offset[p] + partitions[p].numHalo();
+    }
+    vector<vector<vector<pair<int, int>>>> imports(num_partitions, vector<vector<pair<int, int>>>(num_partitions));
+    for (int q = 0; q < num_partitions; q++)
+    {
+        for (int j = 0; j < partitions[q].numHalo(); j++)
+        {
+            int u = partitions[q].rows[partitions[q].num_owned + j];
+            imports[part[u]][q].push_back({j, local_of[u]});
+        }
+    }
+
+    // Barrier, then one table of rows per layer, the halo gradients of every
+    // layer but the last, one weight gradient per worker, the loss and pair
+    // count of every worker and epoch, and the optimizer step, trained weights
+    // and optimizer moments
+    // state written back by worker 0
+    auto aligned = [](size_t bytes)
+    { return (bytes + 63) / 64 * 64; };
+    const size_t activations_offset = 64;
+    const size_t halo_offset_bytes = activations_offset + aligned((size_t)num_layers * n * dim * sizeof(float));
+    const size_t gradients_offset = halo_offset_bytes + aligned((size_t)(num_layers - 1) * halo_offset[num_partitions] * dim * sizeof(float));
+    const size_t stats_offset = gradients_offset + aligned((size_t)num_partitions * num_parameters * sizeof(float));
+    const size_t result_offset = stats_offset + aligned((size_t)num_partitions * num_epochs * 2 * sizeof(double));
+    const size_t shared_bytes = result_offset + 64 + (num_parameters + state_size) * sizeof(float);
+    void *mapped = mmap(nullptr, shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+    {
+        cout << "Error mapping shared memory" << endl;
+        return losses;
+    }
+    char *base = (char *)mapped;
+    ProcessBarrier *barrier = new (mapped) ProcessBarrier();
+    barrier->parties = num_partitions;
+    auto activationTable = [&](int l)
+    { return (float *)(base + activations_offset) + (size_t)(l - 1) * n * dim; };
+    auto haloTable = [&](int l)
+    { return (float *)(base + halo_offset_bytes) + (size_t)(l - 1) * halo_offset[num_partitions] * dim; };
+    float *shared_gradients = (float *)(base + gradients_offset);
+    double *shared_stats = (double *)(base + stats_offset); // loss, pairs per worker and epoch
+    uint64_t *result_step = (uint64_t *)(base + result_offset);
+    float *result = (float *)(base + result_offset + 64); // parameters, then optimizer moments
+
+    auto worker = [&](int p)
+    {
+        const GraphPartition &partition = partitions[p];
+        const int owned = partition.num_owned, rows = partition.rows.size();
+        // Threads do not survive fork(), so each worker gets a fresh pool
+        ThreadPool pool(1);
+        FeatureMatrix in = FeatureMatrix::fromFeatureMap(partition.local, model.input_features, dim);
+        SAGETrainer trainer(partition.local, in, layers, model.optimizer_state, model.optimizer_step, options);
+        // Per layer: [aggregate | self] and norm of the owned rows, output and
+        // d loss / d output of owned and halo rows
+        vector<vector<float>> combined(num_layers + 1), output(num_layers + 1), norms(num_layers + 1), grad(num_layers + 1);
+        for (int l = 1; l <= num_layers; l++)
+        {
+            combined[l].resize(owned * width);
+            norms[l].resize(owned);
+            output[l].resize((size_t)rows * dim);
+            grad[l].resize((size_t)rows * dim);
+        }
+        vector<float> gradient(num_parameters), g_pre(dim), gc(width);
+        vector<pair<pair<int, int>, bool>> pairs;
+        const float *top = activationTable(num_layers);
+
+        for (int epoch = 0; epoch < num_epochs; epoch++)
+        {
+            vector<pair<int, int>> order = epochOrder(edges, options, epoch);
+            double loss = 0.0;
+            size_t scored = 0;
+            for (size_t first = 0; first < order.size(); first += options.batch_size)
+            {
+                size_t last = min(order.size(), first + (size_t)options.batch_size);
+
+                // Forward: boundary rows between layers, every row after the last
+                for (int l = 1; l <= num_layers; l++)
+                {
+                    const float *W = trainer.parameters.data() + (l - 1) * layer_size;
+                    float *table = activationTable(l);
+                    for (int i = 0; i < owned; i++)
+                    {
+                        norms[l][i] = trainer.forwardRow(W, l, i, [&](int row)
+                                                         { return l == 1 ? in.row(row) : &output[l - 1][(size_t)row * dim]; },
+                                                         &combined[l][i * width], &output[l][(size_t)i * dim]);
+                        if (l == num_layers || partition.boundary[i])
+                            copy(&output[l][(size_t)i * dim], &output[l][(size_t)(i + 1) * dim], table + (size_t)partition.rows[i] * dim);
+                    }
+                    if (!barrier->wait())
+                        return false;
+                    for (int i = owned; l < num_layers && i < rows; i++)
+                    {
+                        const float *src = table + (size_t)partition.rows[i] * dim;
+                        copy(src, src + dim, &output[l][(size_t)i * dim]);
+                    }
+                }
+
+                // Loss: each worker takes the pair gradient of the rows it owns
+                // and counts the pairs whose first row it owns
+                trainingPairs(order, first, last, n, options, epoch, pairs);
+                const float pair_scale = 1.0f / (last - first);
+                fill(grad[num_layers].begin(), grad[num_layers].end(), 0.0f);
+                for (auto &[edge, positive] : pairs)
+                {
+                    bool owns_a = part[edge.first] == p, owns_b = part[edge.second] == p;
+                    if (!owns_a && !owns_b)
+                        continue;
+                    const float *ya = top + (size_t)edge.first * dim, *yb = top + (size_t)edge.second * dim;
+                    float g_score;
+                    float pair_loss = pairLoss(dotFloat(ya, yb, dim), positive, options, g_score);
+                    g_score *= pair_scale;
+                    if (owns_a)
+                    {
+                        loss += pair_loss;
+                        scored++;
+                        accumulateFloat(&grad[num_layers][(size_t)local_of[edge.first] * dim], yb, g_score, dim);
+                    }
+                    if (owns_b)
+                        accumulateFloat(&grad[num_layers][(size_t)local_of[edge.second] * dim], ya, g_score, dim);
+                }
+
+                // Backward, handing halo gradients to their owners between layers
+                fill(gradient.begin(), gradient.end(), 0.0f);
+                for (int l = num_layers; l >= 1; l--)
+                {
+                    const float *W = trainer.parameters.data() + (l - 1) * layer_size;
+                    float *dW = gradient.data() + (l - 1) * layer_size;
+                    if (l > 1)
+                        fill(grad[l - 1].begin(), grad[l - 1].end(), 0.0f);
+                    for (int i = 0; i < owned; i++)
+                    {
+                        if (!trainer.backwardRow(W, &combined[l][i * width], &output[l][(size_t)i * dim], norms[l][i], &grad[l][(size_t)i * dim],
+                                                 dW, g_pre.data(), l > 1 ? gc.data() : nullptr) ||
+                            l == 1)
+                            continue;
+                        float scale = trainer.aggregateScale(l, i);
+                        for (const int *it = partition.local.neighborsBegin(i); it != partition.local.neighborsEnd(i); it++)
+                            accumulateFloat(&grad[l - 1][(size_t)*it * dim], gc.data(), scale, dim);
+                        accumulateFloat(&grad[l - 1][(size_t)i * dim], gc.data() + dim, 1.0f, dim);
+                    }
+                    if (l == 1)
+                        break;
+                    float *halo = haloTable(l - 1);
+                    copy(&grad[l - 1][(size_t)owned * dim], &grad[l - 1][(size_t)rows * dim], halo + halo_offset[p] * dim);
+                    if (!barrier->wait())
+                        return false;
+                    for (int q = 0; q < num_partitions; q++)
+                    {
+                        for (auto &[j, i] : imports[p][q])
+                            accumulateFloat(&grad[l - 1][(size_t)i * dim], halo + (halo_offset[q] + j) * dim, 1.0f, dim);
+                    }
+                }
+
+                // Weight gradients summed in worker order, the same in every worker
+                copy(gradient.begin(), gradient.end(), shared_gradients + (size_t)p * num_parameters);
+                if (!barrier->wait())
+                    return false;
+                copy(shared_gradients, shared_gradients + num_parameters, gradient.begin());
+                for (int q = 1; q < num_partitions; q++)
+                    accumulateFloat(gradient.data(), shared_gradients + (size_t)q * num_parameters, 1.0f, num_parameters);
+                trainer.applyGradient(gradient, pool);
+            }
+            shared_stats[((size_t)p * num_epochs + epoch) * 2] = loss;
+            shared_stats[((size_t)p * num_epochs + epoch) * 2 + 1] = scored;
+        }
+        if (p == 0)
+        {
+            copy(trainer.parameters.begin(), trainer.parameters.end(), result);
+            copy(model.optimizer_state.begin(), model.optimizer_state.end(), result + num_parameters);
+            *result_step = model.optimizer_step;
+        }
+        return true;
+    };
+
+    cout.flush();
+    vector<pid_t> children;
+    for (int p = 0; p < num_partitions; p++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            _exit(worker(p) ? 0 : 1);
+        }
+        if (pid < 0)
+        {
+            cout << "Error starting worker process" << endl;
+            barrier->failed.store(1);
+            break;
+        }
+        children.push_back(pid);
+    }
+    bool ok = (int)children.size() == num_partitions;
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            barrier->failed.store(1);
+            ok = false;
+        }
+    }
+
+    if (ok)
+    {
+        for (int l = 0; l < num_layers; l++)
+        {
+            for (int o = 0; o < dim; o++)
+            {
+                const float *row = result + l * layer_size + (size_t)o * width;
+                copy(row, row + width, layers[l]->weights[o].begin());
+            }
+        }
+        model.optimizer_state.assign(result + num_parameters, result + num_parameters + state_size);
+        model.optimizer_step = *result_step;
+        for (int epoch = 0; epoch < num_epochs; epoch++)
+        {
+            double loss = 0.0, scored = 0.0;
+            for (int p = 0; p < num_partitions; p++)
+            {
+                loss += shared_stats[((size_t)p * num_epochs + epoch) * 2];
+                scored += shared_stats[((size_t)p * num_epochs + epoch) * 2 + 1];
+            }
+            losses.push_back(loss / max(1.0, scored));
+            if (options.verbose)
+                cout << "Epoch: " << epoch + 1 << " / " << num_epochs << "  loss " << losses.back() << "  (" << num_partitions << " workers)" << endl;
+        }
+    }
+    else
+    {
+        cout << "Error: partitioned worker failed" << endl;
+    }
+    barrier->~ProcessBarrier();
+    munmap(mapped, shared_bytes);
+    return losses;
+}
+
+#endif
+
+#endif
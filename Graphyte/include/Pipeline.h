@@ -0,0 +1,363 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include "Graph.h"
+#include "Random.h"
+using namespace std;
+
+// Mini-batch loading as a three-stage pipeline: sampler threads draw the
+// targets and neighbor samples of a batch, gather threads copy the feature
+// rows it touches into one contiguous block, and compute threads consume the
+// finished batches. Stages hand batches over through bounded queues, so a
+// slow stage blocks the ones upstream of it instead of letting batches pile
+// up in memory.
+
+// Fixed-capacity blocking queue. close() wakes everyone: push() then fails
+// and pop() drains what is left before failing.
+template <class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(max<size_t>(1, capacity)) {}
+
+    bool push(T item)
+    {
+        unique_lock<mutex> lock(queue_mutex);
+        not_full.wait(lock, [&]
+                      { return closed || items.size() < capacity; });
+        if (closed)
+        {
+            return false;
+        }
+        items.push_back(move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        unique_lock<mutex> lock(queue_mutex);
+        not_empty.wait(lock, [&]
+                       { return closed || !items.empty(); });
+        if (items.empty())
+        {
+            return false;
+        }
+        item = move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            closed = true;
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    deque<T> items;
+    bool closed = false;
+    mutex queue_mutex;
+    condition_variable not_full;
+    condition_variable not_empty;
+};
+
+// One sampled mini-batch. After the gather stage `features` holds the rows of
+// `targets` followed by the rows of `neighbors`, in that order.
+struct LoaderBatch
+{
+    int64_t index = 0; // position in the epoch; batches may reach compute out of order
+    vector<int> targets;
+    vector<int64_t> offsets; // neighbors of targets[i]: [offsets[i], offsets[i + 1])
+    vector<int> neighbors;
+    vector<float> features;
+
+    const float *targetRow(size_t i, int dim) const { return &features[i * dim]; }
+    const float *neighborRow(int64_t j, int dim) const { return &features[(targets.size() + j) * dim]; }
+};
+
+struct PipelineOptions
+{
+    int batch_size = 512;
+    int fanout = 10; // neighbors sampled per target, without replacement
+    int sampler_threads = 1;
+    int gather_threads = 2;
+    int compute_threads = 1;
+    int queue_capacity = 4; // batches waiting between two stages
+    uint64_t seed = 0;
+};
+
+// Time each stage's threads spent working, waiting for input and blocked on
+// a full output queue, summed over the stage's threads
+struct PipelineStageStats
+{
+    const char *name = "";
+    int threads = 0;
+    size_t batches = 0;
+    double busy_ms = 0.0;
+    double input_wait_ms = 0.0;
+    double output_wait_ms = 0.0;
+
+    // Share of the stage's thread time spent working
+    double utilization(double wall_ms) const { return wall_ms > 0 ? busy_ms / (wall_ms * threads) : 0.0; }
+};
+
+struct PipelineStats
+{
+    double wall_ms = 0.0;
+    size_t batches = 0;
+    PipelineStageStats stages[3]; // sample, gather, compute
+};
+
+class PipelinedLoader
+{
+public:
+    PipelineOptions options;
+
+    // Adjacency comes from `g`; `feature_row(r)` returns the `dim` features of
+    // row r and must be safe to call from several threads (a FeatureMatrix, a
+    // memory-mapped OutOfCoreGraph, or a cache in front of either)
+    PipelinedLoader(const CSRGraph &g, int dim, function<const float *(int64_t)> feature_row,
+                    PipelineOptions options = PipelineOptions())
+        : options(options), g(g), dim(dim)
+    {
+        copy_row = [this, feature_row](int64_t r, float *out)
+        {
+            const float *row = feature_row(r);
+            copy(row, row + this->dim, out);
+        };
+    }
+
+    // For stores that copy rows out themselves, such as a FeatureCache
+    PipelinedLoader(const CSRGraph &g, int dim, function<void(int64_t, float *)> copy_row,
+                    PipelineOptions options = PipelineOptions())
+        : options(options), g(g), dim(dim), copy_row(move(copy_row))
+    {
+    }
+
+    int64_t numBatches() const { return (g.numNodes() + options.batch_size - 1) / options.batch_size; }
+
+    // Sampling stage for batch `index` of `epoch`: targets from the epoch's
+    // shuffled row order, neighbors drawn from a counter stream keyed by the batch,
+    // so the batches do not depend on how many sampler threads there are
+    void sample(int epoch, int64_t index, LoaderBatch &batch)
+    {
+        prepareOrder(epoch);
+        CounterRandom random(options.seed, ((uint64_t)epoch << 40) + index + 1);
+        uint64_t draw = 0;
+        int64_t first = index * options.batch_size;
+        int64_t last = min<int64_t>(g.numNodes(), first + options.batch_size);
+        batch.index = index;
+        batch.targets.assign(order.begin() + first, order.begin() + last);
+        batch.offsets.assign(1, 0);
+        batch.neighbors.clear();
+        for (int r : batch.targets)
+        {
+            const int *begin = g.neighborsBegin(r);
+            int degree = g.degree(r);
+            if (degree <= options.fanout)
+            {
+                batch.neighbors.insert(batch.neighbors.end(), begin, begin + degree);
+            }
+            else
+            {
+                // Partial Floyd sample of positions, as in OutOfCoreSampler
+                size_t start = batch.neighbors.size();
+                for (int k = degree - options.fanout; k < degree; k++)
+                {
+                    int neighbor = begin[random.below(draw++, k + 1)];
+                    if (find(batch.neighbors.begin() + start, batch.neighbors.end(), neighbor) != batch.neighbors.end())
+                        neighbor = begin[k];
+                    batch.neighbors.push_back(neighbor);
+                }
+            }
+            batch.offsets.push_back(batch.neighbors.size());
+        }
+    }
+
+    // Gather stage: copies the target rows, then the neighbor rows
+    void gather(LoaderBatch &batch)
+    {
+        batch.features.resize((batch.targets.size() + batch.neighbors.size()) * dim);
+        float *out = batch.features.data();
+        for (int r : batch.targets)
+        {
+            copy_row(r, out);
+            out += dim;
+        }
+        for (int r : batch.neighbors)
+        {
+            copy_row(r, out);
+            out += dim;
+        }
+    }
+
+    // Runs one epoch through the pipeline. `compute(batch, thread)` is called
+    // once per batch from one of the compute threads (0 .. compute_threads - 1).
+    PipelineStats runEpoch(int epoch, const function<void(const LoaderBatch &, int)> &compute)
+    {
+        typedef unique_ptr<LoaderBatch> BatchPtr;
+        using clock = chrono::steady_clock;
+        auto ms = [](clock::time_point a, clock::time_point b)
+        { return chrono::duration<double, milli>(b - a).count(); };
+
+        const int64_t batches = numBatches();
+        const int thread_counts[3] = {max(1, options.sampler_threads), max(1, options.gather_threads),
+                                      max(1, options.compute_threads)};
+        BoundedQueue<BatchPtr> sampled(options.queue_capacity), gathered(options.queue_capacity);
+        // Emptied batches go back to the samplers, so buffers are reused
+        // instead of reallocated; its capacity bounds the batches in flight
+        const int in_flight = 2 * options.queue_capacity + thread_counts[0] + thread_counts[1] + thread_counts[2];
+        BoundedQueue<BatchPtr> free_batches(in_flight);
+        for (int i = 0; i < in_flight; i++)
+            free_batches.push(BatchPtr(new LoaderBatch()));
+        atomic<int64_t> next_batch{0};
+        atomic<int> samplers_left{thread_counts[0]}, gatherers_left{thread_counts[1]};
+
+        vector<vector<PipelineStageStats>> thread_stats(3);
+        for (int s = 0; s < 3; s++)
+            thread_stats[s].resize(thread_counts[s]);
+        prepareOrder(epoch);
+
+        auto sampler = [&](PipelineStageStats &stats)
+        {
+            BatchPtr batch;
+            int64_t index;
+            while ((index = next_batch.fetch_add(1)) < batches)
+            {
+                auto t0 = clock::now();
+                if (!free_batches.pop(batch))
+                    break;
+                auto t1 = clock::now();
+                sample(epoch, index, *batch);
+                auto t2 = clock::now();
+                bool pushed = sampled.push(move(batch));
+                auto t3 = clock::now();
+                stats.input_wait_ms += ms(t0, t1);
+                stats.busy_ms += ms(t1, t2);
+                stats.output_wait_ms += ms(t2, t3);
+                stats.batches++;
+                if (!pushed)
+                    break;
+            }
+            if (--samplers_left == 0)
+                sampled.close();
+        };
+        auto gatherer = [&](PipelineStageStats &stats)
+        {
+            BatchPtr batch;
+            while (true)
+            {
+                auto t0 = clock::now();
+                if (!sampled.pop(batch))
+                    break;
+                auto t1 = clock::now();
+                gather(*batch);
+                auto t2 = clock::now();
+                gathered.push(move(batch));
+                auto t3 = clock::now();
+                stats.input_wait_ms += ms(t0, t1);
+                stats.busy_ms += ms(t1, t2);
+                stats.output_wait_ms += ms(t2, t3);
+                stats.batches++;
+            }
+            if (--gatherers_left == 0)
+                gathered.close();
+        };
+        auto computer = [&](PipelineStageStats &stats, int thread_index)
+        {
+            BatchPtr batch;
+            while (true)
+            {
+                auto t0 = clock::now();
+                if (!gathered.pop(batch))
+                    break;
+                auto t1 = clock::now();
+                compute(*batch, thread_index);
+                auto t2 = clock::now();
+                free_batches.push(move(batch));
+                stats.input_wait_ms += ms(t0, t1);
+                stats.busy_ms += ms(t1, t2);
+                stats.batches++;
+            }
+        };
+
+        auto start = clock::now();
+        vector<thread> threads;
+        for (int i = 0; i < thread_counts[0]; i++)
+            threads.emplace_back(sampler, ref(thread_stats[0][i]));
+        for (int i = 0; i < thread_counts[1]; i++)
+            threads.emplace_back(gatherer, ref(thread_stats[1][i]));
+        for (int i = 1; i < thread_counts[2]; i++)
+            threads.emplace_back(computer, ref(thread_stats[2][i]), i);
+        computer(thread_stats[2][0], 0);
+        for (thread &t : threads)
+            t.join();
+
+        PipelineStats result;
+        result.wall_ms = ms(start, clock::now());
+        const char *names[3] = {"sample", "gather", "compute"};
+        for (int s = 0; s < 3; s++)
+        {
+            PipelineStageStats &stage = result.stages[s];
+            stage.name = names[s];
+            stage.threads = thread_counts[s];
+            for (const PipelineStageStats &t : thread_stats[s])
+            {
+                stage.batches += t.batches;
+                stage.busy_ms += t.busy_ms;
+                stage.input_wait_ms += t.input_wait_ms;
+                stage.output_wait_ms += t.output_wait_ms;
+            }
+        }
+        result.batches = result.stages[2].batches;
+        return result;
+    }
+
+private:
+    const CSRGraph &g;
+    const int dim;
+    function<void(int64_t, float *)> copy_row;
+    mutex order_mutex;
+    vector<int> order;
+    atomic<int> order_epoch{-1};
+
+    // Shuffled row order of `epoch`, built once by whichever thread needs it
+    // first. It takes stream epoch << 40; batch i samples from the i + 1st after it.
+    void prepareOrder(int epoch)
+    {
+        if (epoch == order_epoch)
+        {
+            return;
+        }
+        lock_guard<mutex> lock(order_mutex);
+        if (epoch != order_epoch)
+        {
+            order.resize(g.numNodes());
+            for (int r = 0; r < g.numNodes(); r++)
+                order[r] = r;
+            counterShuffle(order, CounterRandom(options.seed, (uint64_t)epoch << 40));
+            order_epoch = epoch;
+        }
+    }
+};
+
+#endif
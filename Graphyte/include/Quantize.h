@@ -0,0 +1,609 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "ThreadPool.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+// Post-training quantization for inference. Kernels use AVX2 when the build
+// enables it (-mavx2 -mfma) and fall back to plain loops otherwise.
+
+enum Precision
+{
+    PRECISION_FP32,
+    PRECISION_BF16, // upper half of a float32: same range, 8-bit mantissa
+    PRECISION_INT8, // symmetric, one scale per row
+};
+
+const char *precisionName(Precision precision)
+{
+    switch (precision)
+    {
+    case PRECISION_BF16:
+        return "bf16";
+    case PRECISION_INT8:
+        return "int8";
+    default:
+        return "fp32";
+    }
+}
+
+// Round to nearest even on the dropped half
+uint16_t floatToBF16(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000)
+    {
+        return (bits >> 16) | 0x40; // keep NaN a NaN
+    }
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return bits >> 16;
+}
+
+float bf16ToFloat(uint16_t x)
+{
+    uint32_t bits = (uint32_t)x << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+#if defined(__AVX2__)
+float horizontalSum(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+__m256 multiplyAdd(__m256 a, __m256 b, __m256 c)
+{
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+float dotFloat(const float *a, const float *b, int n)
+{
+    int i = 0;
+    float sum = 0.0f;
+#if defined(__AVX2__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = multiplyAdd(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = multiplyAdd(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+#endif
+    for (; i < n; i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// bf16 weights against float activations, accumulated in float
+float dotBF16(const uint16_t *a, const float *b, int n)
+{
+    int i = 0;
+    float sum = 0.0f;
+#if defined(__AVX2__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256 x = _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+        acc = multiplyAdd(x, _mm256_loadu_ps(b + i), acc);
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < n; i++)
+    {
+        sum += bf16ToFloat(a[i]) * b[i];
+    }
+    return sum;
+}
+
+// int8 x int8 with int32 accumulation
+int32_t dotInt8(const int8_t *a, const int8_t *b, int n)
+{
+    int i = 0;
+    int32_t sum = 0;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i y = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(x, y));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+    sum = _mm_cvtsi128_si32(half);
+#endif
+    for (; i < n; i++)
+    {
+        sum += (int32_t)a[i] * b[i];
+    }
+    return sum;
+}
+
+// The same weight row against four activation vectors at once, so each
+// weight is loaded (and widened) once per four nodes
+void dotFloat4(const float *w, const float *const x[4], int n, float out[4])
+{
+    int i = 0;
+    for (int v = 0; v < 4; v++)
+        out[v] = 0.0f;
+#if defined(__AVX2__)
+    __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 wv = _mm256_loadu_ps(w + i);
+        for (int v = 0; v < 4; v++)
+            acc[v] = multiplyAdd(wv, _mm256_loadu_ps(x[v] + i), acc[v]);
+    }
+    for (int v = 0; v < 4; v++)
+        out[v] = horizontalSum(acc[v]);
+#endif
+    for (; i < n; i++)
+    {
+        for (int v = 0; v < 4; v++)
+            out[v] += w[i] * x[v][i];
+    }
+}
+
+void dotBF16x4(const uint16_t *w, const float *const x[4], int n, float out[4])
+{
+    int i = 0;
+    for (int v = 0; v < 4; v++)
+        out[v] = 0.0f;
+#if defined(__AVX2__)
+    __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(w + i)));
+        __m256 wv = _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+        for (int v = 0; v < 4; v++)
+            acc[v] = multiplyAdd(wv, _mm256_loadu_ps(x[v] + i), acc[v]);
+    }
+    for (int v = 0; v < 4; v++)
+        out[v] = horizontalSum(acc[v]);
+#endif
+    for (; i < n; i++)
+    {
+        float wi = bf16ToFloat(w[i]);
+        for (int v = 0; v < 4; v++)
+            out[v] += wi * x[v][i];
+    }
+}
+
+// Activations are int8 values already widened to int16, so only the weights
+// are widened inside the loop
+void dotInt8x4(const int8_t *w, const int16_t *const x[4], int n, int32_t out[4])
+{
+    int i = 0;
+    for (int v = 0; v < 4; v++)
+        out[v] = 0;
+#if defined(__AVX2__)
+    __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i wv = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(w + i)));
+        for (int v = 0; v < 4; v++)
+            acc[v] = _mm256_add_epi32(acc[v], _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *)(x[v] + i))));
+    }
+    for (int v = 0; v < 4; v++)
+    {
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc[v]), _mm256_extracti128_si256(acc[v], 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+        out[v] = _mm_cvtsi128_si32(half);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        for (int v = 0; v < 4; v++)
+            out[v] += (int32_t)w[i] * x[v][i];
+    }
+}
+
+// dst += scale * src, for aggregating quantized neighbor rows
+void accumulateInt8(float *dst, const int8_t *src, float scale, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(src + i))));
+        _mm256_storeu_ps(dst + i, multiplyAdd(x, s, _mm256_loadu_ps(dst + i)));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        dst[i] += scale * src[i];
+    }
+}
+
+void accumulateBF16(float *dst, const uint16_t *src, float scale, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+        __m256 x = _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+        _mm256_storeu_ps(dst + i, multiplyAdd(x, s, _mm256_loadu_ps(dst + i)));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        dst[i] += scale * bf16ToFloat(src[i]);
+    }
+}
+
+void accumulateFloat(float *dst, const float *src, float scale, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, multiplyAdd(_mm256_loadu_ps(src + i), s, _mm256_loadu_ps(dst + i)));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        dst[i] += scale * src[i];
+    }
+}
+
+// Symmetric int8 of one vector; returns the scale (0 for an all-zero vector)
+float quantizeInt8(const float *src, int8_t *dst, int n)
+{
+    float max_abs = 0.0f;
+    for (int i = 0; i < n; i++)
+    {
+        max_abs = max(max_abs, fabs(src[i]));
+    }
+    float scale = max_abs / 127.0f;
+    float inverse = scale > 0 ? 1.0f / scale : 0.0f;
+    for (int i = 0; i < n; i++)
+    {
+        dst[i] = (int8_t)lrintf(src[i] * inverse);
+    }
+    return scale;
+}
+
+// Affine uint8 of one vector, x ~ scale * (code - zero_point), spanning the
+// vector's own range
+void quantizeUInt8(const float *src, uint8_t *dst, int n, float &scale, int &zero_point)
+{
+    float low = 0.0f, high = 0.0f; // the range always includes 0
+    for (int i = 0; i < n; i++)
+    {
+        low = min(low, src[i]);
+        high = max(high, src[i]);
+    }
+    scale = (high - low) / 255.0f;
+    zero_point = scale > 0 ? (int)lrintf(-low / scale) : 0;
+    float inverse = scale > 0 ? 1.0f / scale : 0.0f;
+    for (int i = 0; i < n; i++)
+    {
+        long code = lrintf(src[i] * inverse) + zero_point;
+        dst[i] = (uint8_t)max(0L, min(255L, code));
+    }
+}
+
+// uint8 x uint8 with int32 accumulation; exact for vectors up to 33000 long
+int32_t dotUInt8(const uint8_t *a, const uint8_t *b, int n)
+{
+    int i = 0;
+    int32_t sum = 0;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(x, y));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+    sum = _mm_cvtsi128_si32(half);
+#endif
+    for (; i < n; i++)
+    {
+        sum += (int32_t)a[i] * b[i];
+    }
+    return sum;
+}
+
+// IEEE half precision, round to nearest even
+uint16_t floatToHalf(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+    if (magnitude >= 0x7f800000)
+    {
+        return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0); // inf, NaN
+    }
+    if (magnitude >= 0x477ff000)
+    {
+        return sign | 0x7c00; // rounds past 65504
+    }
+    if (magnitude < 0x38800000)
+    {
+        // Subnormal: count units of 2^-24
+        float value;
+        memcpy(&value, &magnitude, sizeof(value));
+        return sign | (uint16_t)lrintf(value * 16777216.0f);
+    }
+    magnitude += 0xfff + ((magnitude >> 13) & 1);
+    return sign | ((magnitude - 0x38000000) >> 13);
+}
+
+float halfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    if (exponent == 0)
+    {
+        float value = mantissa * 5.9604645e-8f; // 2^-24
+        return sign ? -value : value;
+    }
+    uint32_t bits = sign | (exponent == 31 ? 0x7f800000 : (exponent + 112) << 23) | (mantissa << 13);
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// fp16 x fp16 accumulated in float; the vector path needs F16C (-mf16c)
+float dotHalf(const uint16_t *a, const uint16_t *b, int n)
+{
+    int i = 0;
+    float sum = 0.0f;
+#if defined(__AVX2__) && defined(__F16C__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = multiplyAdd(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(a + i))),
+                           _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(b + i))), acc0);
+        acc1 = multiplyAdd(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(a + i + 8))),
+                           _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(b + i + 8))), acc1);
+    }
+    sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+#endif
+    for (; i < n; i++)
+    {
+        sum += halfToFloat(a[i]) * halfToFloat(b[i]);
+    }
+    return sum;
+}
+
+// Row-major matrix held at one precision. Used both for layer weights (rows
+// are output channels, so int8 scales are per channel) and for node
+// activations (rows are nodes).
+class QuantizedMatrix
+{
+public:
+    Precision precision = PRECISION_FP32;
+    int rows = 0;
+    int cols = 0;
+    vector<float> fp32;
+    vector<uint16_t> bf16;
+    vector<int8_t> int8;
+    vector<float> scales; // int8 only, one per row
+
+    QuantizedMatrix() {}
+
+    QuantizedMatrix(const FeatureMatrix &m, Precision precision)
+        : precision(precision), rows(m.rows), cols(m.dim)
+    {
+        switch (precision)
+        {
+        case PRECISION_FP32:
+            fp32 = m.data;
+            break;
+        case PRECISION_BF16:
+            bf16.resize(m.data.size());
+            for (size_t i = 0; i < m.data.size(); i++)
+            {
+                bf16[i] = floatToBF16(m.data[i]);
+            }
+            break;
+        case PRECISION_INT8:
+            int8.resize(m.data.size());
+            scales.resize(rows);
+            for (int r = 0; r < rows; r++)
+            {
+                scales[r] = quantizeInt8(m.row(r), &int8[(size_t)r * cols], cols);
+            }
+            break;
+        }
+    }
+
+    // From SAGELayer::weights
+    static QuantizedMatrix fromWeights(const vector<vector<float>> &weights, Precision precision)
+    {
+        FeatureMatrix m(weights.size(), weights.empty() ? 0 : weights[0].size());
+        for (int r = 0; r < m.rows; r++)
+        {
+            copy(weights[r].begin(), weights[r].end(), m.row(r));
+        }
+        return QuantizedMatrix(m, precision);
+    }
+
+    size_t bytes() const
+    {
+        return fp32.size() * sizeof(float) + bf16.size() * sizeof(uint16_t) + int8.size() + scales.size() * sizeof(float);
+    }
+
+    // dst += weight * row r
+    void accumulateRow(int r, float *dst, float weight) const
+    {
+        size_t offset = (size_t)r * cols;
+        switch (precision)
+        {
+        case PRECISION_FP32:
+            accumulateFloat(dst, &fp32[offset], weight, cols);
+            break;
+        case PRECISION_BF16:
+            accumulateBF16(dst, &bf16[offset], weight, cols);
+            break;
+        case PRECISION_INT8:
+            accumulateInt8(dst, &int8[offset], weight * scales[r], cols);
+            break;
+        }
+    }
+
+    FeatureMatrix dequantize() const
+    {
+        FeatureMatrix m(rows, cols);
+        for (int r = 0; r < rows; r++)
+        {
+            accumulateRow(r, m.row(r), 1.0f);
+        }
+        return m;
+    }
+};
+
+// Inference-only SAGE layer over CSR rows: the mean of the neighbor rows is
+// concatenated with the node's own row, multiplied by the weights (output x
+// 2 * input) and passed through a sigmoid and L2 normalization. Activations
+// come in at the layer's precision; int8 layers also quantize the combined
+// vector so the transform runs entirely in int32.
+class QuantizedSAGELayer
+{
+public:
+    QuantizedMatrix weights;
+
+    QuantizedSAGELayer() {}
+
+    QuantizedSAGELayer(const vector<vector<float>> &weights, Precision precision)
+        : weights(QuantizedMatrix::fromWeights(weights, precision)) {}
+
+    Precision precision() const { return weights.precision; }
+
+    void forward(const CSRGraph &g, const QuantizedMatrix &in, FeatureMatrix &out, ThreadPool &pool = defaultThreadPool()) const
+    {
+        const int dim = in.cols;
+        const int width = 2 * dim;
+        const int outputs = weights.rows;
+        out = FeatureMatrix(g.numNodes(), outputs);
+        // Nodes go through the transform four at a time, sharing weight loads
+        const int64_t num_groups = (g.numNodes() + 3) / 4;
+        pool.parallelFor(0, num_groups, [&](int64_t first, int64_t last)
+                         {
+                             vector<float> combined(4 * width);
+                             vector<int8_t> combined_int8(width);
+                             vector<int16_t> combined_int16(4 * width);
+                             float combined_scale[4];
+                             for (int64_t group = first; group < last; group++)
+                             {
+                                 int64_t r0 = group * 4;
+                                 int count = min<int64_t>(4, g.numNodes() - r0);
+                                 // Aggregate straight from the stored precision; padding
+                                 // slots of a short group stay zero
+                                 fill(combined.begin(), combined.end(), 0.0f);
+                                 for (int v = 0; v < count; v++)
+                                 {
+                                     int64_t r = r0 + v;
+                                     float *x = &combined[v * width];
+                                     int degree = g.degree(r);
+                                     for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                                         in.accumulateRow(*it, x, 1.0f / degree);
+                                     in.accumulateRow(r, x + dim, 1.0f);
+                                 }
+
+                                 float y[4];
+                                 int32_t y_int[4];
+                                 const float *x_float[4];
+                                 const int16_t *x_int16[4];
+                                 for (int v = 0; v < 4; v++)
+                                 {
+                                     x_float[v] = &combined[v * width];
+                                     x_int16[v] = &combined_int16[v * width];
+                                     if (weights.precision == PRECISION_INT8)
+                                     {
+                                         combined_scale[v] = quantizeInt8(x_float[v], combined_int8.data(), width);
+                                         copy(combined_int8.begin(), combined_int8.end(), &combined_int16[v * width]);
+                                     }
+                                 }
+                                 for (int o = 0; o < outputs; o++)
+                                 {
+                                     size_t offset = (size_t)o * weights.cols;
+                                     if (weights.precision == PRECISION_INT8)
+                                     {
+                                         dotInt8x4(&weights.int8[offset], x_int16, width, y_int);
+                                         for (int v = 0; v < 4; v++)
+                                             y[v] = y_int[v] * (weights.scales[o] * combined_scale[v]);
+                                     }
+                                     else if (weights.precision == PRECISION_BF16)
+                                     {
+                                         dotBF16x4(&weights.bf16[offset], x_float, width, y);
+                                     }
+                                     else
+                                     {
+                                         dotFloat4(&weights.fp32[offset], x_float, width, y);
+                                     }
+                                     for (int v = 0; v < count; v++)
+                                         out.row(r0 + v)[o] = y[v];
+                                 }
+
+                                 for (int v = 0; v < count; v++)
+                                 {
+                                     float *row = out.row(r0 + v);
+                                     float norm = 0.0f;
+                                     for (int o = 0; o < outputs; o++)
+                                     {
+                                         row[o] = 1.0f / (1.0f + exp(-row[o]));
+                                         norm += row[o] * row[o];
+                                     }
+                                     norm = sqrt(norm);
+                                     for (int o = 0; o < outputs; o++)
+                                         row[o] /= norm;
+                                 }
+                             } },
+                         16);
+    }
+};
+
+// Runs the layers in order, storing the activations between layers at each
+// layer's precision, and returns the float output of the last layer
+FeatureMatrix quantizedInference(const CSRGraph &g, const FeatureMatrix &features, const vector<QuantizedSAGELayer> &layers,
+                                 ThreadPool &pool = defaultThreadPool())
+{
+    FeatureMatrix activations = features;
+    for (const QuantizedSAGELayer &layer : layers)
+    {
+        FeatureMatrix next;
+        layer.forward(g, QuantizedMatrix(activations, layer.precision()), next, pool);
+        activations = move(next);
+    }
+    return activations;
+}
+
+#endif
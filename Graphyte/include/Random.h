@@ -0,0 +1,182 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "Quantize.h"
+#include "ThreadPool.h"
+using namespace std;
+
+// Counter-based random numbers: Philox4x32-10 (Salmon et al., "Parallel
+// random numbers: as easy as 1, 2, 3", SC 2011). Output i of a (seed, stream)
+// pair is a pure function of i, so any thread can produce any part of a
+// sequence without shared state, and a tensor filled in parallel comes out
+// the same for every thread count. Streams separate independent uses of one
+// seed (a layer, an epoch, a query).
+
+const uint32_t PHILOX_M0 = 0xD2511F53u, PHILOX_M1 = 0xCD9E8D57u;
+const uint32_t PHILOX_W0 = 0x9E3779B9u, PHILOX_W1 = 0xBB67AE85u;
+
+// Maps 32 random bits to [lo, hi) through the top 24. Fused when the build has
+// FMA, as the AVX2 path is, so both give the same floats.
+float uniformFromBits(uint32_t bits, float lo, float hi)
+{
+    float u = (bits >> 8) * (1.0f / 16777216.0f);
+#if defined(__FMA__)
+    return fmaf(u, hi - lo, lo);
+#else
+    return lo + u * (hi - lo);
+#endif
+}
+
+// Ten rounds over one 128-bit counter, in place
+void philox4x32(uint32_t ctr[4], uint32_t k0, uint32_t k1)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * ctr[0];
+        uint64_t p1 = (uint64_t)PHILOX_M1 * ctr[2];
+        uint32_t c0 = (uint32_t)(p1 >> 32) ^ ctr[1] ^ k0;
+        uint32_t c2 = (uint32_t)(p0 >> 32) ^ ctr[3] ^ k1;
+        ctr[1] = (uint32_t)p1;
+        ctr[3] = (uint32_t)p0;
+        ctr[0] = c0;
+        ctr[2] = c2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+class CounterRandom
+{
+public:
+    CounterRandom(uint64_t seed = 0, uint64_t stream = 0) : seed(seed), stream(stream) {}
+
+    // The four 32-bit outputs 4 * block .. 4 * block + 3
+    void block(uint64_t index, uint32_t out[4]) const
+    {
+        out[0] = (uint32_t)index;
+        out[1] = (uint32_t)(index >> 32);
+        out[2] = (uint32_t)stream;
+        out[3] = (uint32_t)(stream >> 32);
+        philox4x32(out, (uint32_t)seed, (uint32_t)(seed >> 32));
+    }
+
+    uint32_t bits(uint64_t index) const
+    {
+        uint32_t out[4];
+        block(index / 4, out);
+        return out[index % 4];
+    }
+
+    float uniform(uint64_t index, float lo = 0.0f, float hi = 1.0f) const { return uniformFromBits(bits(index), lo, hi); }
+
+    // Uniform integer in [0, n) by multiply-shift; the bias is below n / 2^32
+    uint32_t below(uint64_t index, uint32_t n) const { return (uint32_t)(((uint64_t)bits(index) * n) >> 32); }
+
+    // out[i] = uniform(first + i, lo, hi) for i < n. Whole blocks are generated
+    // eight at a time with AVX2 when the build enables it.
+    void fillUniform(float *out, size_t n, float lo, float hi, uint64_t first = 0) const
+    {
+        size_t i = 0;
+        // Up to the next block boundary
+        for (; i < n && (first + i) % 4 != 0; i++)
+            out[i] = uniform(first + i, lo, hi);
+        uint64_t next_block = (first + i) / 4;
+#if defined(__AVX2__)
+        for (; i + 32 <= n; i += 32, next_block += 8)
+            fillBlocks8(next_block, out + i, lo, hi);
+#endif
+        for (; i + 4 <= n; i += 4, next_block++)
+        {
+            uint32_t words[4];
+            block(next_block, words);
+            for (int w = 0; w < 4; w++)
+                out[i + w] = uniformFromBits(words[w], lo, hi);
+        }
+        for (; i < n; i++)
+            out[i] = uniform(first + i, lo, hi);
+    }
+
+private:
+    uint64_t seed;
+    uint64_t stream;
+
+#if defined(__AVX2__)
+    // 32 bits-per-lane products: low and high halves of a * m for 8 lanes
+    static void mulhilo(__m256i a, __m256i m, __m256i &lo, __m256i &hi)
+    {
+        __m256i even = _mm256_mul_epu32(a, m);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+        lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+        hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+    }
+
+    // Blocks first .. first + 7 as 32 floats, in the same order as block()
+    void fillBlocks8(uint64_t first, float *out, float lo, float hi) const
+    {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        // Counter low word, with the carry into the high word for blocks
+        // that cross a 2^32 boundary
+        __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((uint32_t)first), lanes);
+        __m256i carry = _mm256_cmpgt_epi32(_mm256_xor_si256(_mm256_set1_epi32((uint32_t)first), _mm256_set1_epi32(INT32_MIN)),
+                                           _mm256_xor_si256(c0, _mm256_set1_epi32(INT32_MIN)));
+        __m256i c1 = _mm256_sub_epi32(_mm256_set1_epi32((uint32_t)(first >> 32)), carry);
+        __m256i c2 = _mm256_set1_epi32((uint32_t)stream);
+        __m256i c3 = _mm256_set1_epi32((uint32_t)(stream >> 32));
+        uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+        const __m256i m0 = _mm256_set1_epi32(PHILOX_M0), m1 = _mm256_set1_epi32(PHILOX_M1);
+        for (int round = 0; round < 10; round++)
+        {
+            __m256i lo0, hi0, lo1, hi1;
+            mulhilo(c0, m0, lo0, hi0);
+            mulhilo(c2, m1, lo1, hi1);
+            c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(k0));
+            c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(k1));
+            c1 = lo1;
+            c3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        const __m256 unit = _mm256_set1_ps(1.0f / 16777216.0f);
+        const __m256 range = _mm256_set1_ps(hi - lo), offset = _mm256_set1_ps(lo);
+        alignas(32) float words[4][8];
+        __m256i c[4] = {c0, c1, c2, c3};
+        for (int w = 0; w < 4; w++)
+        {
+            __m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c[w], 8)), unit);
+            _mm256_store_ps(words[w], multiplyAdd(u, range, offset));
+        }
+        for (int b = 0; b < 8; b++)
+            for (int w = 0; w < 4; w++)
+                out[4 * b + w] = words[w][b];
+    }
+#endif
+};
+
+// fillUniform() split over the pool in block-aligned chunks; the result does
+// not depend on the number of threads
+void parallelFillUniform(float *out, size_t n, float lo, float hi, const CounterRandom &random,
+                         ThreadPool &pool = defaultThreadPool())
+{
+    const int64_t blocks = (n + 3) / 4;
+    pool.parallelFor(0, blocks, [&](int64_t first, int64_t last)
+                     { random.fillUniform(out + first * 4, min(n, (size_t)last * 4) - first * 4, lo, hi, first * 4); },
+                     4096);
+}
+
+// Fisher-Yates shuffle drawing from `random`
+template <class T>
+void counterShuffle(vector<T> &items, const CounterRandom &random)
+{
+    for (size_t i = items.size(); i > 1; i--)
+    {
+        swap(items[i - 1], items[random.below(items.size() - i, i)]);
+    }
+}
+
+#endif
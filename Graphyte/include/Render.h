@@ -0,0 +1,275 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <utility>
+#include "raylib.h"
+#include "Layout.h"
+using namespace std;
+
+// The few rlgl calls (raylib's immediate-mode batching layer, compiled into
+// libraylib) used below; rlgl.h itself is not bundled with the repo
+extern "C"
+{
+    void rlBegin(int mode);
+    void rlEnd(void);
+    void rlVertex2f(float x, float y);
+    void rlColor4ub(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+    bool rlCheckRenderBatchLimit(int vCount);
+}
+#ifndef RL_TRIANGLES
+#define RL_TRIANGLES 0x0004
+#endif
+
+// Pan/zoom state of the graph panel. World coordinates are the layout's
+// screen coordinates, so zoom 1 with no panning shows the layout as laid out.
+class GraphView
+{
+public:
+    Camera2D camera;
+    Rectangle viewport;
+    float min_zoom = 0.05f;
+    float max_zoom = 20.0f;
+
+    GraphView(Rectangle viewport) : viewport(viewport) { reset(); }
+
+    void reset()
+    {
+        camera.offset = {viewport.x + viewport.width / 2, viewport.y + viewport.height / 2};
+        camera.target = camera.offset;
+        camera.rotation = 0.0f;
+        camera.zoom = 1.0f;
+    }
+
+    // Wheel zooms around the cursor, right or middle drag pans
+    void handleInput()
+    {
+        Vector2 mouse = GetMousePosition();
+        if (!CheckCollisionPointRec(mouse, viewport))
+        {
+            return;
+        }
+        float wheel = GetMouseWheelMove();
+        if (wheel != 0)
+        {
+            Vector2 anchor = GetScreenToWorld2D(mouse, camera);
+            camera.zoom = Clamp(camera.zoom * powf(1.15f, wheel), min_zoom, max_zoom);
+            camera.offset = mouse;
+            camera.target = anchor;
+        }
+        if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) || IsMouseButtonDown(MOUSE_BUTTON_MIDDLE))
+        {
+            Vector2 delta = GetMouseDelta();
+            camera.target.x -= delta.x / camera.zoom;
+            camera.target.y -= delta.y / camera.zoom;
+        }
+        if (IsKeyPressed(KEY_HOME))
+        {
+            reset();
+        }
+    }
+
+    // Visible part of the world
+    Rectangle worldBounds() const
+    {
+        Vector2 top_left = GetScreenToWorld2D({viewport.x, viewport.y}, camera);
+        Vector2 bottom_right = GetScreenToWorld2D({viewport.x + viewport.width, viewport.y + viewport.height}, camera);
+        return {top_left.x, top_left.y, bottom_right.x - top_left.x, bottom_right.y - top_left.y};
+    }
+};
+
+struct EdgeBatch
+{
+    vector<pair<int, int>> edges; // node indices
+    float width;                  // on screen, in pixels
+    Color color;
+};
+
+// Draws a node-link diagram as a handful of batched triangle submissions
+// instead of one raylib call per shape: off-screen nodes and edges are culled,
+// circles get fewer segments as they shrink on screen, and labels are drawn
+// only once nodes are large enough to hold them.
+class GraphRenderer
+{
+public:
+    float label_min_radius = 12.0f; // on-screen radius at which labels appear
+    int label_font_size = 20;
+
+    // Labels are cached per node so each frame costs no formatting
+    void setNodes(const vector<Node> &nodes)
+    {
+        labels.resize(nodes.size());
+        label_widths.assign(nodes.size(), -1);
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            labels[i] = to_string(nodes[i].id);
+        }
+    }
+
+    size_t visibleNodes() const { return visible_nodes; }
+
+    void draw(const GraphView &view, const vector<Node> &nodes, const vector<Vector2> &positions, const vector<EdgeBatch> &edge_batches)
+    {
+        if (labels.size() != nodes.size())
+        {
+            setNodes(nodes);
+        }
+        Rectangle world = view.worldBounds();
+        float zoom = view.camera.zoom;
+
+        BeginScissorMode(view.viewport.x, view.viewport.y, view.viewport.width, view.viewport.height);
+        BeginMode2D(view.camera);
+
+        // Edges: one quad per edge, all in one batch per style
+        for (const EdgeBatch &batch : edge_batches)
+        {
+            float half_width = batch.width / zoom / 2;
+            rlBegin(RL_TRIANGLES);
+            rlColor4ub(batch.color.r, batch.color.g, batch.color.b, batch.color.a);
+            for (auto &[a, b] : batch.edges)
+            {
+                if (!segmentVisible(positions[a], positions[b], world))
+                {
+                    continue;
+                }
+                emitQuad(positions[a], positions[b], half_width);
+            }
+            rlEnd();
+        }
+
+        // Node fills, then outlines, each in a single batch
+        visible_nodes = 0;
+        visible.clear();
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            float r = nodes[i].radius;
+            const Vector2 &p = positions[i];
+            if (p.x + r >= world.x && p.x - r <= world.x + world.width &&
+                p.y + r >= world.y && p.y - r <= world.y + world.height)
+            {
+                visible.push_back(i);
+            }
+        }
+        visible_nodes = visible.size();
+
+        rlBegin(RL_TRIANGLES);
+        for (int i : visible)
+        {
+            Color color = nodes[i].isTestNode ? RED : GREEN;
+            rlColor4ub(color.r, color.g, color.b, color.a);
+            emitDisc(positions[i], nodes[i].radius, segmentsFor(nodes[i].radius * zoom));
+        }
+        rlEnd();
+
+        rlBegin(RL_TRIANGLES);
+        rlColor4ub(BLACK.r, BLACK.g, BLACK.b, BLACK.a);
+        for (int i : visible)
+        {
+            if (nodes[i].radius * zoom >= 3.0f)
+            {
+                emitRing(positions[i], nodes[i].radius, 1.0f / zoom, segmentsFor(nodes[i].radius * zoom));
+            }
+        }
+        rlEnd();
+
+        EndMode2D();
+
+        // Labels in screen space, so text stays crisp at any zoom
+        for (int i : visible)
+        {
+            if (nodes[i].radius * zoom < label_min_radius)
+            {
+                continue;
+            }
+            if (label_widths[i] < 0)
+            {
+                label_widths[i] = MeasureText(labels[i].c_str(), label_font_size);
+            }
+            Vector2 screen = GetWorldToScreen2D(positions[i], view.camera);
+            DrawText(labels[i].c_str(), screen.x - label_widths[i] / 2, screen.y - label_font_size / 2, label_font_size, WHITE);
+        }
+        EndScissorMode();
+    }
+
+private:
+    vector<string> labels;
+    vector<int> label_widths;
+    vector<int> visible;
+    size_t visible_nodes = 0;
+
+    static bool segmentVisible(Vector2 a, Vector2 b, Rectangle world)
+    {
+        return !(max(a.x, b.x) < world.x || min(a.x, b.x) > world.x + world.width ||
+                 max(a.y, b.y) < world.y || min(a.y, b.y) > world.y + world.height);
+    }
+
+    // Circle detail by on-screen radius: tiny nodes are drawn as squares
+    static int segmentsFor(float screen_radius)
+    {
+        if (screen_radius < 2.0f)
+            return 4;
+        if (screen_radius < 6.0f)
+            return 8;
+        if (screen_radius < 15.0f)
+            return 16;
+        return 32;
+    }
+
+    // The emitters below wind every triangle like DrawTriangle() expects;
+    // rlgl culls back faces, so the other winding would not be drawn at all
+    static void emitQuad(Vector2 a, Vector2 b, float half_width)
+    {
+        float dx = b.x - a.x, dy = b.y - a.y;
+        float length = sqrtf(dx * dx + dy * dy);
+        if (length < 1e-6f)
+        {
+            return;
+        }
+        float nx = -dy / length * half_width, ny = dx / length * half_width;
+        rlCheckRenderBatchLimit(6);
+        rlVertex2f(a.x + nx, a.y + ny);
+        rlVertex2f(b.x + nx, b.y + ny);
+        rlVertex2f(a.x - nx, a.y - ny);
+        rlVertex2f(b.x + nx, b.y + ny);
+        rlVertex2f(b.x - nx, b.y - ny);
+        rlVertex2f(a.x - nx, a.y - ny);
+    }
+
+    static void emitDisc(Vector2 c, float r, int segments)
+    {
+        rlCheckRenderBatchLimit(3 * segments);
+        float step = 2 * PI / segments;
+        for (int s = 0; s < segments; s++)
+        {
+            float a0 = s * step, a1 = (s + 1) * step;
+            rlVertex2f(c.x, c.y);
+            rlVertex2f(c.x + sinf(a0) * r, c.y + cosf(a0) * r);
+            rlVertex2f(c.x + sinf(a1) * r, c.y + cosf(a1) * r);
+        }
+    }
+
+    static void emitRing(Vector2 c, float r, float thickness, int segments)
+    {
+        rlCheckRenderBatchLimit(6 * segments);
+        float step = 2 * PI / segments;
+        float inner = r - thickness;
+        for (int s = 0; s < segments; s++)
+        {
+            float a0 = s * step, a1 = (s + 1) * step;
+            Vector2 o0 = {c.x + sinf(a0) * r, c.y + cosf(a0) * r};
+            Vector2 o1 = {c.x + sinf(a1) * r, c.y + cosf(a1) * r};
+            Vector2 i0 = {c.x + sinf(a0) * inner, c.y + cosf(a0) * inner};
+            Vector2 i1 = {c.x + sinf(a1) * inner, c.y + cosf(a1) * inner};
+            rlVertex2f(o0.x, o0.y);
+            rlVertex2f(o1.x, o1.y);
+            rlVertex2f(i0.x, i0.y);
+            rlVertex2f(o1.x, o1.y);
+            rlVertex2f(i1.x, i1.y);
+            rlVertex2f(i0.x, i0.y);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+using namespace std;
+
+// Node orderings for cache locality. Each returns new_to_old: the old row
+// placed at every new row. Permuting with it keeps node_ids pointing at the
+// original ids, so results can always be reported in the input numbering.
+
+vector<int> identityOrder(const CSRGraph &g)
+{
+    vector<int> order(g.numNodes());
+    iota(order.begin(), order.end(), 0);
+    return order;
+}
+
+// Highest degree first: hub rows, which most neighbor lists reference, end up
+// packed together at the front of the feature matrix
+vector<int> degreeOrder(const CSRGraph &g)
+{
+    vector<int> order = identityOrder(g);
+    stable_sort(order.begin(), order.end(), [&](int a, int b)
+                { return g.degree(a) > g.degree(b); });
+    return order;
+}
+
+// Reverse Cuthill-McKee: BFS from a minimum-degree node of each component,
+// visiting neighbors by increasing degree, then reversed. Keeps neighbors at
+// nearby rows, i.e. reduces the bandwidth of the adjacency matrix.
+vector<int> rcmOrder(const CSRGraph &g)
+{
+    const int n = g.numNodes();
+    vector<int> order;
+    order.reserve(n);
+    vector<char> visited(n, 0);
+    vector<int> by_degree = identityOrder(g);
+    stable_sort(by_degree.begin(), by_degree.end(), [&](int a, int b)
+                { return g.degree(a) < g.degree(b); });
+
+    vector<int> frontier;
+    for (int start : by_degree)
+    {
+        if (visited[start])
+        {
+            continue;
+        }
+        visited[start] = 1;
+        size_t head = order.size();
+        order.push_back(start);
+        while (head < order.size())
+        {
+            int u = order[head++];
+            frontier.clear();
+            for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+            {
+                if (!visited[*it])
+                {
+                    visited[*it] = 1;
+                    frontier.push_back(*it);
+                }
+            }
+            stable_sort(frontier.begin(), frontier.end(), [&](int a, int b)
+                        { return g.degree(a) < g.degree(b); });
+            order.insert(order.end(), frontier.begin(), frontier.end());
+        }
+    }
+    reverse(order.begin(), order.end());
+    return order;
+}
+
+// Community-based order in the spirit of Rabbit order: label propagation
+// finds dense communities, which are laid out contiguously (largest first),
+// with each community's rows in BFS order from its highest-degree member.
+vector<int> communityOrder(const CSRGraph &g, int iterations = 10)
+{
+    const int n = g.numNodes();
+    vector<int> label = identityOrder(g);
+    unordered_map<int, int> counts;
+    for (int iter = 0; iter < iterations; iter++)
+    {
+        bool changed = false;
+        for (int u = 0; u < n; u++)
+        {
+            if (g.degree(u) == 0)
+            {
+                continue;
+            }
+            counts.clear();
+            int best = label[u];
+            int best_count = 0;
+            for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+            {
+                int c = ++counts[label[*it]];
+                if (c > best_count || (c == best_count && label[*it] < best))
+                {
+                    best = label[*it];
+                    best_count = c;
+                }
+            }
+            if (best != label[u])
+            {
+                label[u] = best;
+                changed = true;
+            }
+        }
+        if (!changed)
+        {
+            break;
+        }
+    }
+
+    vector<int> community_size(n, 0);
+    for (int u = 0; u < n; u++)
+    {
+        community_size[label[u]]++;
+    }
+    vector<int> seeds = identityOrder(g);
+    stable_sort(seeds.begin(), seeds.end(), [&](int a, int b)
+                {
+                    if (community_size[label[a]] != community_size[label[b]])
+                        return community_size[label[a]] > community_size[label[b]];
+                    if (label[a] != label[b])
+                        return label[a] < label[b];
+                    return g.degree(a) > g.degree(b); });
+
+    // BFS restricted to the seed's community; seeds arrive community by
+    // community, highest degree first, so each community stays contiguous
+    vector<int> order;
+    order.reserve(n);
+    vector<char> visited(n, 0);
+    for (int start : seeds)
+    {
+        if (visited[start])
+        {
+            continue;
+        }
+        visited[start] = 1;
+        size_t head = order.size();
+        order.push_back(start);
+        while (head < order.size())
+        {
+            int u = order[head++];
+            for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+            {
+                if (!visited[*it] && label[*it] == label[start])
+                {
+                    visited[*it] = 1;
+                    order.push_back(*it);
+                }
+            }
+        }
+    }
+    return order;
+}
+
+vector<int> invertOrder(const vector<int> &new_to_old)
+{
+    vector<int> old_to_new(new_to_old.size());
+    for (size_t r = 0; r < new_to_old.size(); r++)
+    {
+        old_to_new[new_to_old[r]] = r;
+    }
+    return old_to_new;
+}
+
+CSRGraph permuteGraph(const CSRGraph &g, const vector<int> &new_to_old)
+{
+    const int n = g.numNodes();
+    vector<int> old_to_new = invertOrder(new_to_old);
+    CSRGraph p;
+    p.node_ids.resize(n);
+    p.offsets.assign(n + 1, 0);
+    p.neighbors.resize(g.numEdges());
+    for (int r = 0; r < n; r++)
+    {
+        int old = new_to_old[r];
+        p.node_ids[r] = g.node_ids[old];
+        p.offsets[r + 1] = p.offsets[r] + g.degree(old);
+        int *dst = p.neighbors.data() + p.offsets[r];
+        for (const int *it = g.neighborsBegin(old); it != g.neighborsEnd(old); it++)
+        {
+            *dst++ = old_to_new[*it];
+        }
+        sort(p.neighbors.begin() + p.offsets[r], p.neighbors.begin() + p.offsets[r + 1]);
+    }
+    p.id_order = identityOrder(p);
+    sort(p.id_order.begin(), p.id_order.end(), [&](int a, int b)
+         { return p.node_ids[a] < p.node_ids[b]; });
+    return p;
+}
+
+FeatureMatrix permuteFeatures(const FeatureMatrix &m, const vector<int> &new_to_old)
+{
+    FeatureMatrix p(m.rows, m.dim);
+    for (int r = 0; r < m.rows; r++)
+    {
+        copy(m.row(new_to_old[r]), m.row(new_to_old[r]) + m.dim, p.row(r));
+    }
+    return p;
+}
+
+#endif
@@ -0,0 +1,717 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <iostream>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <list>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <algorithm>
+#include "Checkpoint.h"
+#include "Incremental.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#endif
+
+using namespace std;
+
+// Wire protocol, native endianness, one request/response pair at a time per connection:
+//   request:  RecommendationRequest, then num_exclude int32 node ids
+//   response: RecommendationResponse, then count x RecommendationEntry ordered by score
+//   edge update (live servers only): EdgeUpdateRequest, answered by a
+//   RecommendationResponse with count 0
+const uint32_t SERVER_REQUEST_MAGIC = 0x47525251;     // "GRRQ"
+const uint32_t SERVER_EDGE_UPDATE_MAGIC = 0x47524555; // "GREU"
+const uint32_t SERVER_MAX_K = 10000;
+const uint32_t SERVER_MAX_EXCLUDE = 100000;
+
+enum RecommendationStatus : uint32_t
+{
+    RECOMMENDATION_OK = 0,
+    RECOMMENDATION_UNKNOWN_NODE = 1,
+    RECOMMENDATION_BAD_REQUEST = 2,
+    RECOMMENDATION_READ_ONLY = 3,     // edge update sent to a checkpoint server
+    RECOMMENDATION_EDGE_UNCHANGED = 4 // inserted edge already existed, or removed edge did not
+};
+
+enum EdgeUpdateOp : uint32_t
+{
+    EDGE_INSERT = 0,
+    EDGE_REMOVE = 1
+};
+
+struct RecommendationRequest
+{
+    uint32_t magic;
+    int32_t node_id;
+    uint32_t k;
+    uint32_t num_exclude;
+};
+
+struct EdgeUpdateRequest
+{
+    uint32_t magic;
+    uint32_t op;
+    int32_t u;
+    int32_t v;
+};
+
+struct RecommendationResponse
+{
+    uint32_t status;
+    uint32_t count;
+};
+
+struct RecommendationEntry
+{
+    int32_t node_id;
+    float score;
+};
+
+#ifndef _WIN32
+
+bool readFully(int fd, void *buffer, size_t bytes)
+{
+    char *p = (char *)buffer;
+    while (bytes > 0)
+    {
+        ssize_t n = ::read(fd, p, bytes);
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+// Writing to a socket the peer has closed must fail with EPIPE rather than
+// kill the process with SIGPIPE. Linux takes a flag per send(); macOS and
+// the BSDs have no such flag and take a socket option instead.
+#ifdef MSG_NOSIGNAL
+const int SOCKET_SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SOCKET_SEND_FLAGS = 0;
+#endif
+
+void suppressSigpipe(int fd)
+{
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+    (void)fd;
+#endif
+}
+
+bool writeFully(int fd, const void *buffer, size_t bytes)
+{
+    const char *p = (const char *)buffer;
+    while (bytes > 0)
+    {
+        ssize_t n = ::send(fd, p, bytes, SOCKET_SEND_FLAGS);
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+// A checkpoint's fp32 embedding table scored in place, with the same
+// interface as EmbeddingStore. Row norms are computed once when it is opened.
+class MappedEmbeddings
+{
+public:
+    const int *node_ids = nullptr;
+
+    void open(const CheckpointView &checkpoint)
+    {
+        node_ids = checkpoint.node_ids;
+        rows = checkpoint.embeddings;
+        dim = checkpoint.dim();
+        count = checkpoint.numNodes();
+        norms.resize(count);
+        for (size_t r = 0; r < count; r++)
+        {
+            const float *v = rows + r * dim;
+            norms[r] = sqrt(max(0.0f, dotFloat(v, v, dim)));
+        }
+    }
+
+    size_t size() const { return count; }
+
+    int rowOf(int node_id) const
+    {
+        const int *end = node_ids + count;
+        const int *it = lower_bound(node_ids, end, node_id);
+        return (it != end && *it == node_id) ? it - node_ids : -1;
+    }
+
+    float cosineRows(int a, int b) const
+    {
+        float denominator = norms[a] * norms[b];
+        return denominator == 0 ? 0.0f : dotFloat(rows + (size_t)a * dim, rows + (size_t)b * dim, dim) / denominator;
+    }
+
+private:
+    const float *rows = nullptr;
+    int dim = 0;
+    size_t count = 0;
+    vector<float> norms;
+};
+
+// Serves top-K cosine recommendations from a checkpoint. In fp32 the table is
+// scored straight from the memory mapping; fp16 and int8 copy it into an
+// EmbeddingStore and unmap the file, so only the compact table stays resident.
+// A live server scores a model's embedding store instead and accepts edge
+// updates, which IncrementalSAGE folds into the embeddings of the nodes they
+// reach. Connection threads only parse and enqueue; a single scorer thread
+// drains everything queued so far, applies the batch's edge updates and then
+// scores its queries in one pass over the embedding table, so concurrent
+// clients share the memory traffic.
+class RecommendationServer
+{
+public:
+    RecommendationServer() {}
+    RecommendationServer(const RecommendationServer &) = delete;
+    RecommendationServer &operator=(const RecommendationServer &) = delete;
+    ~RecommendationServer() { stop(); }
+
+    bool start(const char *checkpoint_path, const char *socket_path, EmbeddingFormat format = EMBEDDING_FP32)
+    {
+        if (!checkpoint.open(checkpoint_path))
+        {
+            return false;
+        }
+        if (format == EMBEDDING_FP32)
+        {
+            mapped.open(checkpoint);
+        }
+        else
+        {
+            store = EmbeddingStore(checkpoint.node_ids, checkpoint.embeddings, checkpoint.numNodes(), checkpoint.dim(), format);
+            checkpoint.close();
+        }
+        return listenOn(socket_path);
+    }
+
+    // Serves `model`, which must stay alive until stop(). Its final embeddings
+    // are recomputed from its input features and moved into a `format` store.
+    bool startLive(SAGEModel &model, const char *socket_path, EmbeddingFormat format = EMBEDDING_FP32)
+    {
+        live_model = &model;
+        incremental = make_unique<IncrementalSAGE>(model);
+        incremental->recomputeAll();
+        model.quantizeEmbeddings(format, true);
+        return listenOn(socket_path);
+    }
+
+    // Blocks until stop() is called from another thread
+    void wait()
+    {
+        unique_lock<mutex> lock(connections_mutex);
+        connections_cv.wait(lock, [&]
+                            { return !running; });
+    }
+
+    void stop()
+    {
+        if (!running.exchange(false))
+        {
+            return;
+        }
+        shutdown(listen_fd, SHUT_RDWR);
+        if (acceptor.joinable())
+            acceptor.join();
+        ::close(listen_fd);
+        listen_fd = -1;
+        {
+            // Taking the lock orders the flag change before the scorer's next wait
+            lock_guard<mutex> lock(queue_mutex);
+        }
+        queue_cv.notify_all();
+        if (scorer.joinable())
+            scorer.join();
+        {
+            lock_guard<mutex> lock(connections_mutex);
+            for (int fd : connections)
+            {
+                shutdown(fd, SHUT_RDWR);
+            }
+            connections_cv.notify_all();
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+        unlink(socket_path.c_str());
+    }
+
+    uint64_t batchesScored() const { return batches; }
+
+    uint64_t requestsScored() const { return requests; }
+
+    uint64_t edgesUpdated() const { return edge_updates; }
+
+private:
+    struct PendingQuery
+    {
+        int node_id;
+        uint32_t k;
+        vector<int> exclude; // sorted
+        // Edge updates carry the edge instead of a query
+        bool is_update = false;
+        EdgeUpdateOp op = EDGE_INSERT;
+        int u = 0, v = 0;
+        // Set by the scorer before `result`
+        uint32_t status = RECOMMENDATION_OK;
+        promise<vector<RecommendationEntry>> result;
+    };
+
+    CheckpointView checkpoint;
+    MappedEmbeddings mapped;
+    EmbeddingStore store; // empty when scoring from the mapping
+    SAGEModel *live_model = nullptr;
+    unique_ptr<IncrementalSAGE> incremental;
+    string socket_path;
+    int listen_fd = -1;
+    atomic<bool> running{false};
+    thread acceptor;
+    thread scorer;
+    mutex connections_mutex;
+    condition_variable connections_cv;
+    vector<int> connections;
+    list<thread> workers;
+    vector<thread::id> finished_workers;
+
+    mutex queue_mutex;
+    condition_variable queue_cv;
+    vector<PendingQuery *> pending;
+    atomic<uint64_t> batches{0};
+    atomic<uint64_t> requests{0};
+    atomic<uint64_t> edge_updates{0};
+
+    bool listenOn(const char *socket_path)
+    {
+        this->socket_path = socket_path;
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(socket_path) >= sizeof(addr.sun_path))
+        {
+            cout << "Error: socket path too long" << endl;
+            return false;
+        }
+        strcpy(addr.sun_path, socket_path);
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path);
+        if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0)
+        {
+            cout << "Error binding socket " << socket_path << endl;
+            if (listen_fd >= 0)
+                ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+
+        running = true;
+        scorer = thread(&RecommendationServer::scoreLoop, this);
+        acceptor = thread(&RecommendationServer::acceptLoop, this);
+        return true;
+    }
+
+    void acceptLoop()
+    {
+        // Out of descriptors or memory, accept() keeps failing while the
+        // connection stays queued, so back off instead of spinning
+        chrono::milliseconds backoff(0);
+        while (running)
+        {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0)
+            {
+                if (!running || errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                if (backoff.count() == 0)
+                {
+                    cout << "Error accepting connection: " << strerror(errno) << endl;
+                }
+                backoff = min(max(2 * backoff, chrono::milliseconds(1)), chrono::milliseconds(100));
+                this_thread::sleep_for(backoff);
+                continue;
+            }
+            backoff = chrono::milliseconds(0);
+            suppressSigpipe(fd);
+            lock_guard<mutex> lock(connections_mutex);
+            reapWorkers();
+            connections.push_back(fd);
+            workers.emplace_back(&RecommendationServer::serveConnection, this, fd);
+        }
+    }
+
+    // Reads the rest of a message whose leading magic was already read
+    template <class Message>
+    static bool readAfterMagic(int fd, uint32_t magic, Message &message)
+    {
+        message.magic = magic;
+        return readFully(fd, (char *)&message + sizeof(magic), sizeof(message) - sizeof(magic));
+    }
+
+    void serveConnection(int fd)
+    {
+        uint32_t magic;
+        while (running && readFully(fd, &magic, sizeof(magic)))
+        {
+            RecommendationResponse response = {RECOMMENDATION_OK, 0};
+            vector<RecommendationEntry> entries;
+            PendingQuery query;
+            bool valid = false;
+
+            if (magic == SERVER_REQUEST_MAGIC)
+            {
+                RecommendationRequest request;
+                if (!readAfterMagic(fd, magic, request))
+                {
+                    break;
+                }
+                valid = request.k <= SERVER_MAX_K && request.num_exclude <= SERVER_MAX_EXCLUDE;
+                query.node_id = request.node_id;
+                query.k = request.k;
+                query.exclude.resize(valid ? request.num_exclude : 0);
+                if (valid && !readFully(fd, query.exclude.data(), query.exclude.size() * sizeof(int)))
+                {
+                    break;
+                }
+                sort(query.exclude.begin(), query.exclude.end());
+            }
+            else if (magic == SERVER_EDGE_UPDATE_MAGIC)
+            {
+                EdgeUpdateRequest update;
+                if (!readAfterMagic(fd, magic, update))
+                {
+                    break;
+                }
+                valid = (update.op == EDGE_INSERT || update.op == EDGE_REMOVE) && update.u != update.v;
+                query.is_update = true;
+                query.op = (EdgeUpdateOp)update.op;
+                query.u = update.u;
+                query.v = update.v;
+            }
+
+            if (!valid)
+            {
+                response.status = RECOMMENDATION_BAD_REQUEST;
+            }
+            else if (query.is_update && !live_model)
+            {
+                response.status = RECOMMENDATION_READ_ONLY;
+            }
+            else
+            {
+                future<vector<RecommendationEntry>> result = query.result.get_future();
+                {
+                    // The scorer only exits once stopped with an empty queue, so
+                    // nothing may be enqueued after stop()
+                    lock_guard<mutex> lock(queue_mutex);
+                    if (!running)
+                    {
+                        break;
+                    }
+                    pending.push_back(&query);
+                }
+                queue_cv.notify_one();
+                entries = result.get();
+                response.status = query.status;
+                response.count = entries.size();
+            }
+
+            if (!writeFully(fd, &response, sizeof(response)) ||
+                !writeFully(fd, entries.data(), entries.size() * sizeof(RecommendationEntry)))
+            {
+                break;
+            }
+            if (!valid)
+            {
+                break;
+            }
+        }
+
+        lock_guard<mutex> lock(connections_mutex);
+        connections.erase(find(connections.begin(), connections.end(), fd));
+        ::close(fd);
+        finished_workers.push_back(this_thread::get_id());
+    }
+
+    // Joins connection threads that have already returned; caller holds connections_mutex
+    void reapWorkers()
+    {
+        for (thread::id id : finished_workers)
+        {
+            auto it = find_if(workers.begin(), workers.end(), [&](const thread &t)
+                              { return t.get_id() == id; });
+            if (it != workers.end())
+            {
+                it->join();
+                workers.erase(it);
+            }
+        }
+        finished_workers.clear();
+    }
+
+    void scoreLoop()
+    {
+        vector<PendingQuery *> batch;
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(queue_mutex);
+                queue_cv.wait(lock, [&]
+                              { return !pending.empty() || !running; });
+                if (pending.empty())
+                {
+                    return;
+                }
+                batch.swap(pending);
+            }
+            applyUpdates(batch);
+            if (checkpoint.isOpen())
+                scoreBatch(batch, mapped);
+            else
+                scoreBatch(batch, live_model ? live_model->embedding_store : store);
+            batches++;
+            batch.clear();
+        }
+    }
+
+    // Applies the batch's edge updates, answers them and drops them from the
+    // batch. The affected embeddings are refreshed once for all of them.
+    void applyUpdates(vector<PendingQuery *> &batch)
+    {
+        auto first_update = stable_partition(batch.begin(), batch.end(), [](const PendingQuery *query)
+                                             { return !query->is_update; });
+        bool changed = false;
+        for (auto it = first_update; it != batch.end(); it++)
+        {
+            PendingQuery &update = **it;
+            bool applied = update.op == EDGE_INSERT ? incremental->insertEdge(update.u, update.v)
+                                                    : incremental->removeEdge(update.u, update.v);
+            update.status = applied ? RECOMMENDATION_OK : RECOMMENDATION_EDGE_UNCHANGED;
+            changed = changed || applied;
+            edge_updates += applied;
+        }
+        if (changed)
+        {
+            incremental->refresh();
+        }
+        for (auto it = first_update; it != batch.end(); it++)
+        {
+            (*it)->result.set_value(vector<RecommendationEntry>());
+        }
+        batch.erase(first_update, batch.end());
+    }
+
+    // One sweep over the table: each row is loaded once and scored against every
+    // query in the batch; each query keeps a min-heap of its current top k
+    template <class Table>
+    void scoreBatch(vector<PendingQuery *> &batch, const Table &table)
+    {
+        typedef pair<float, int> Scored;
+        // Higher score first, ties broken by the smaller node id
+        auto better = [](const Scored &a, const Scored &b)
+        { return a.first > b.first || (a.first == b.first && a.second < b.second); };
+
+        const size_t q = batch.size();
+        vector<int> query_rows(q);
+        vector<vector<Scored>> heaps(q);
+        for (size_t j = 0; j < q; j++)
+        {
+            query_rows[j] = table.rowOf(batch[j]->node_id);
+            if (query_rows[j] < 0)
+            {
+                batch[j]->status = RECOMMENDATION_UNKNOWN_NODE;
+                batch[j]->k = 0;
+            }
+            heaps[j].reserve(batch[j]->k + 1);
+        }
+        requests += q;
+
+        for (size_t row = 0; row < table.size(); row++)
+        {
+            const int candidate = table.node_ids[row];
+            for (size_t j = 0; j < q; j++)
+            {
+                PendingQuery &query = *batch[j];
+                if (query.k == 0 || candidate == query.node_id ||
+                    binary_search(query.exclude.begin(), query.exclude.end(), candidate))
+                {
+                    continue;
+                }
+                Scored scored(table.cosineRows(query_rows[j], row), candidate);
+
+                vector<Scored> &heap = heaps[j];
+                if (heap.size() < query.k)
+                {
+                    heap.push_back(scored);
+                    push_heap(heap.begin(), heap.end(), better);
+                }
+                else if (better(scored, heap.front()))
+                {
+                    pop_heap(heap.begin(), heap.end(), better);
+                    heap.back() = scored;
+                    push_heap(heap.begin(), heap.end(), better);
+                }
+            }
+        }
+
+        for (size_t j = 0; j < q; j++)
+        {
+            sort_heap(heaps[j].begin(), heaps[j].end(), better);
+            vector<RecommendationEntry> entries;
+            entries.reserve(heaps[j].size());
+            for (auto &[score, node_id] : heaps[j])
+            {
+                entries.push_back({node_id, score});
+            }
+            batch[j]->result.set_value(move(entries));
+        }
+    }
+};
+
+// Blocks SIGINT and SIGTERM in the calling thread and in every thread it
+// starts from now on, so that only the sigwait() in runServer() sees them.
+// Call it before any other thread exists.
+sigset_t blockServerSignals()
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    return signals;
+}
+
+// Runs a started server until SIGINT/SIGTERM, then drains in-flight requests
+int runServer(RecommendationServer &server, const sigset_t &signals)
+{
+    int signal_number = 0;
+    sigwait(&signals, &signal_number);
+    server.stop();
+    cout << "Served " << server.requestsScored() << " requests in " << server.batchesScored() << " batches";
+    if (server.edgesUpdated() > 0)
+        cout << ", " << server.edgesUpdated() << " edges updated";
+    cout << endl;
+    return 0;
+}
+
+// Serving mode entry point for a checkpoint
+int serveRecommendations(const char *checkpoint_path, const char *socket_path, EmbeddingFormat format = EMBEDDING_FP32)
+{
+    sigset_t signals = blockServerSignals();
+    RecommendationServer server;
+    if (!server.start(checkpoint_path, socket_path, format))
+    {
+        return 1;
+    }
+    cout << "Serving " << embeddingFormatName(format) << " recommendations on " << socket_path << endl;
+    return runServer(server, signals);
+}
+
+// Live serving mode entry point; the caller should have called
+// blockServerSignals() before building the model
+int serveLiveRecommendations(SAGEModel &model, const char *socket_path, EmbeddingFormat format = EMBEDDING_FP32)
+{
+    sigset_t signals = blockServerSignals();
+    RecommendationServer server;
+    if (!server.startLive(model, socket_path, format))
+    {
+        return 1;
+    }
+    cout << "Serving live " << embeddingFormatName(format) << " recommendations on " << socket_path << endl;
+    return runServer(server, signals);
+}
+
+// Minimal blocking client, mostly useful for testing the server from C++
+bool queryRecommendations(const char *socket_path, int node_id, uint32_t k, const vector<int> &exclude,
+                          vector<RecommendationEntry> &result, uint32_t *status = nullptr)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    suppressSigpipe(fd);
+
+    RecommendationRequest request = {SERVER_REQUEST_MAGIC, node_id, k, (uint32_t)exclude.size()};
+    RecommendationResponse response;
+    bool ok = writeFully(fd, &request, sizeof(request)) &&
+              writeFully(fd, exclude.data(), exclude.size() * sizeof(int)) &&
+              readFully(fd, &response, sizeof(response));
+    if (ok)
+    {
+        result.resize(response.count);
+        ok = readFully(fd, result.data(), result.size() * sizeof(RecommendationEntry));
+        if (status)
+            *status = response.status;
+    }
+    ::close(fd);
+    return ok;
+}
+
+// Sends one edge update to a live server; `status` tells whether it changed the graph
+bool updateServerEdge(const char *socket_path, EdgeUpdateOp op, int u, int v, uint32_t *status = nullptr)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    suppressSigpipe(fd);
+
+    EdgeUpdateRequest request = {SERVER_EDGE_UPDATE_MAGIC, op, u, v};
+    RecommendationResponse response;
+    bool ok = writeFully(fd, &request, sizeof(request)) && readFully(fd, &response, sizeof(response));
+    if (ok && status)
+        *status = response.status;
+    ::close(fd);
+    return ok;
+}
+
+#endif
+
+#endif
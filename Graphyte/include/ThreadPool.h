@@ -0,0 +1,199 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+using namespace std;
+
+// Fixed-size pool of worker threads shared by the parallel kernels
+class ThreadPool
+{
+public:
+    // `on_start(i)` runs first thing on worker i, e.g. to pin it to a CPU
+    explicit ThreadPool(size_t num_threads = max(1u, thread::hardware_concurrency()),
+                        function<void(size_t)> on_start = nullptr)
+    {
+        for (size_t i = 0; i < num_threads; i++)
+        {
+            workers.emplace_back([this, i, on_start]
+                                 {
+                                     if (on_start)
+                                         on_start(i);
+                                     run(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            running = false;
+        }
+        tasks_cv.notify_all();
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    size_t size() const { return workers.size(); }
+
+    template <class F>
+    future<void> submit(F &&task)
+    {
+        auto packaged = make_shared<packaged_task<void()>>(forward<F>(task));
+        future<void> result = packaged->get_future();
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            tasks.push_back([packaged]
+                            { (*packaged)(); });
+        }
+        tasks_cv.notify_one();
+        return result;
+    }
+
+    // Runs fn(chunk_begin, chunk_end) over [begin, end) in chunks of at least
+    // `min_chunk`. The calling thread works too and only waits for chunks that
+    // were actually started, so nested calls from pool threads cannot deadlock.
+    void parallelFor(int64_t begin, int64_t end, const function<void(int64_t, int64_t)> &fn, int64_t min_chunk = 1)
+    {
+        if (end <= begin)
+        {
+            return;
+        }
+        int64_t total = end - begin;
+        int64_t chunk = max(min_chunk, (total + (int64_t)size() * 4 - 1) / ((int64_t)size() * 4));
+        int64_t num_chunks = (total + chunk - 1) / chunk;
+        if (num_chunks == 1)
+        {
+            fn(begin, end);
+            return;
+        }
+
+        struct Shared
+        {
+            function<void(int64_t, int64_t)> fn;
+            atomic<int64_t> next{0};
+            atomic<int64_t> done{0};
+            mutex done_mutex;
+            condition_variable done_cv;
+        };
+        auto shared = make_shared<Shared>();
+        shared->fn = fn;
+
+        auto work = [shared, begin, end, chunk, num_chunks]
+        {
+            int64_t c;
+            while ((c = shared->next.fetch_add(1)) < num_chunks)
+            {
+                int64_t chunk_begin = begin + c * chunk;
+                shared->fn(chunk_begin, min(end, chunk_begin + chunk));
+                if (shared->done.fetch_add(1) + 1 == num_chunks)
+                {
+                    lock_guard<mutex> lock(shared->done_mutex);
+                    shared->done_cv.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = min((size_t)num_chunks - 1, size());
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            for (size_t i = 0; i < helpers; i++)
+            {
+                tasks.push_back(work);
+            }
+        }
+        tasks_cv.notify_all();
+
+        work();
+        unique_lock<mutex> lock(shared->done_mutex);
+        shared->done_cv.wait(lock, [&]
+                             { return shared->done.load() == num_chunks; });
+    }
+
+private:
+    vector<thread> workers;
+    deque<function<void()>> tasks;
+    mutex tasks_mutex;
+    condition_variable tasks_cv;
+    bool running = true;
+
+    void run()
+    {
+        while (true)
+        {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(tasks_mutex);
+                tasks_cv.wait(lock, [&]
+                              { return !tasks.empty() || !running; });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// Process-wide pool sized to the machine
+ThreadPool &defaultThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// Sorts chunks in parallel, then merges neighboring runs pairwise in parallel
+template <class T, class Compare>
+void parallelSort(vector<T> &values, Compare compare, ThreadPool &pool = defaultThreadPool())
+{
+    const int64_t n = values.size();
+    const int64_t runs = min<int64_t>(pool.size() * 2, max<int64_t>(1, n / 4096));
+    if (runs <= 1)
+    {
+        sort(values.begin(), values.end(), compare);
+        return;
+    }
+
+    vector<int64_t> bounds(runs + 1);
+    for (int64_t r = 0; r <= runs; r++)
+    {
+        bounds[r] = n * r / runs;
+    }
+    pool.parallelFor(0, runs, [&](int64_t first, int64_t last)
+                     {
+                         for (int64_t r = first; r < last; r++)
+                             sort(values.begin() + bounds[r], values.begin() + bounds[r + 1], compare); });
+
+    for (int64_t width = 1; width < runs; width *= 2)
+    {
+        int64_t merges = (runs + 2 * width - 1) / (2 * width);
+        pool.parallelFor(0, merges, [&](int64_t first, int64_t last)
+                         {
+                             for (int64_t m = first; m < last; m++)
+                             {
+                                 int64_t lo = m * 2 * width;
+                                 int64_t mid = min(runs, lo + width);
+                                 int64_t hi = min(runs, lo + 2 * width);
+                                 if (mid < hi)
+                                     inplace_merge(values.begin() + bounds[lo], values.begin() + bounds[mid], values.begin() + bounds[hi], compare);
+                             } });
+    }
+}
+
+#endif
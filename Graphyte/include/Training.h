@@ -0,0 +1,697 @@
+#ifndef TRAINING_H
+#define TRAINING_H
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <functional>
+#include "Graph.h"
+#include "FeatureMatrix.h"
+#include "Layer.h"
+#include "Quantize.h"
+#include "ThreadPool.h"
+#include "Random.h"
+using namespace std;
+
+// Mini-batch training of stacked SAGE layers (mean or sum aggregator) for
+// link prediction. Each step scores a batch of edges with the unsupervised
+// GraphSAGE loss, -log sigmoid(z_u . z_v) for positive edges and
+// -log sigmoid(-z_u . z_n) for negatives, where z are the L2-normalized
+// outputs of the last layer.
+//
+// Steps are data parallel within a batch: the batch's row sets are built
+// once, every row of a level is computed forward once (shared by all the
+// pairs that read it), and the backward pass is cut into a fixed number of
+// shards by row, each adding to its own weight gradient. The shard gradients
+// are summed by a pairwise tree in shard order before one Adam update. The
+// shard count, not the thread count, decides the arithmetic, so any number of
+// threads gives bit-identical weights for the same seed.
+//
+// With `asynchronous` set, epochs run Hogwild-style instead: threads train
+// on whole batches independently and update the shared weights in place
+// without waiting for each other (see runAsynchronous). This avoids the
+// per-step barriers, but the result depends on thread timing.
+//
+// With `historical_embeddings` set, synchronous epochs keep a table of every
+// row's lower-layer outputs. A batch then recomputes a lower layer only for
+// the rows of the layer above; their other neighbors are read from the table
+// (no gradient flows into it) unless their entry is older than
+// `history_max_age` steps. This cuts each batch's receptive field to one hop.
+// Batches write their fresh rows back, and the whole table is recomputed
+// every `history_refresh_epochs` epochs.
+
+struct TrainingOptions
+{
+    int batch_size = 256;     // edges per optimizer step
+    int num_negatives = 5;    // random negatives drawn for every positive edge
+    float negative_weight = 1.0f;
+    float learning_rate = 0.01f;
+    int gradient_shards = 16; // backward slices, independent of the thread count
+    uint64_t seed = 0;
+    bool asynchronous = false; // lock-free updates without barriers
+    bool historical_embeddings = false;
+    int history_max_age = 64;       // steps
+    int history_refresh_epochs = 1;
+    bool verbose = true;
+};
+
+struct EpochStats
+{
+    double loss = 0.0; // mean over the epoch's scored pairs
+    double ms = 0.0;
+    int steps = 0;
+    // Asynchronous epochs only: updates made by other threads between a
+    // batch reading the weights and applying its own update
+    double mean_staleness = 0.0;
+    uint64_t max_staleness = 0;
+    // Historical embeddings only
+    double history_ms = 0.0;       // recomputing the whole table
+    size_t fresh_rows = 0;         // lower-layer rows computed by the batches
+    size_t history_reads = 0;      // lower-layer rows read from the table instead
+    size_t stale_recomputes = 0;   // rows recomputed for exceeding the age bound
+    double mean_history_age = 0.0; // steps since the rows read were computed
+    int64_t max_history_age = 0;
+};
+
+// Training edges of `g` as row pairs, u < v
+vector<pair<int, int>> trainingEdges(const CSRGraph &g)
+{
+    vector<pair<int, int>> edges;
+    for (int u = 0; u < g.numNodes(); u++)
+    {
+        for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+        {
+            if (u < *it)
+                edges.push_back({u, *it});
+        }
+    }
+    return edges;
+}
+
+// Training edges in the order `epoch` batches them. Even streams shuffle an
+// epoch, odd ones draw its negatives.
+vector<pair<int, int>> epochOrder(const vector<pair<int, int>> &edges, const TrainingOptions &options, int epoch)
+{
+    vector<pair<int, int>> order = edges;
+    counterShuffle(order, CounterRandom(options.seed, (uint64_t)epoch << 1));
+    return order;
+}
+
+// Pairs scored for the edges order[first, last): each edge followed by its
+// negatives among `num_nodes` rows. Negative k of the edge at position e is
+// draw e * num_negatives + k of the epoch's stream, so any slice of a batch
+// can be drawn on its own.
+void trainingPairs(const vector<pair<int, int>> &order, size_t first, size_t last, int num_nodes, const TrainingOptions &options,
+                   int epoch, vector<pair<pair<int, int>, bool>> &pairs)
+{
+    CounterRandom negatives(options.seed, ((uint64_t)epoch << 1) | 1);
+    pairs.clear();
+    for (size_t e = first; e < last; e++)
+    {
+        pairs.push_back({order[e], true});
+        for (int k = 0; k < options.num_negatives; k++)
+        {
+            int node = negatives.below((uint64_t)e * options.num_negatives + k, num_nodes);
+            pairs.push_back({{order[e].first, node}, false});
+        }
+    }
+}
+
+// Loss of a pair with score z_u . z_v, and in `g_score` its derivative with
+// respect to the score
+float pairLoss(float score, bool positive, const TrainingOptions &options, float &g_score)
+{
+    float p = 1.0f / (1.0f + exp(-score));
+    float weight = positive ? 1.0f : options.negative_weight;
+    g_score = weight * (positive ? p - 1.0f : p);
+    return weight * -log(max(positive ? p : 1.0f - p, 1e-7f));
+}
+
+class SAGETrainer
+{
+public:
+    TrainingOptions options;
+    vector<float> parameters; // weights of every layer, each out x 2 * in, row-major
+
+    // `inputs` holds the layer-0 row of every row of `g`. The optimizer moments
+    // are kept in `optimizer_state` ([m, v]) and the number of updates made in
+    // `optimizer_step`, so training can resume from a checkpoint. Both are
+    // reset when the moments do not match the layers.
+    SAGETrainer(const CSRGraph &g, const FeatureMatrix &inputs, const vector<SAGELayer *> &layers,
+                vector<float> &optimizer_state, uint64_t &optimizer_step, TrainingOptions options = TrainingOptions())
+        : options(options), g(g), inputs(inputs), layers(layers), optimizer_state(optimizer_state), optimizer_step(optimizer_step)
+    {
+        dim = inputs.dim;
+        layer_size = (size_t)dim * 2 * dim;
+        parameters.resize(layers.size() * layer_size);
+        for (size_t l = 0; l < layers.size(); l++)
+        {
+            for (int o = 0; o < dim; o++)
+            {
+                copy(layers[l]->weights[o].begin(), layers[l]->weights[o].begin() + 2 * dim, &parameters[l * layer_size + (size_t)o * 2 * dim]);
+            }
+        }
+        if (optimizer_state.size() != 2 * parameters.size())
+        {
+            optimizer_state.assign(2 * parameters.size(), 0.0f);
+            optimizer_step = 0;
+        }
+        edges = trainingEdges(g);
+    }
+
+    // Writes the trained weights back into the layers
+    void store() const
+    {
+        for (size_t l = 0; l < layers.size(); l++)
+        {
+            for (int o = 0; o < dim; o++)
+            {
+                const float *row = &parameters[l * layer_size + (size_t)o * 2 * dim];
+                copy(row, row + 2 * dim, layers[l]->weights[o].begin());
+            }
+        }
+    }
+
+    EpochStats runEpoch(int epoch, ThreadPool &pool = defaultThreadPool())
+    {
+        auto start = chrono::steady_clock::now();
+        vector<pair<int, int>> order = epochOrder(edges, options, epoch);
+        EpochStats stats = options.asynchronous ? runAsynchronous(order, epoch, pool) : runSynchronous(order, epoch, pool);
+        stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+    // Weight of each neighbor in the aggregate of `row` at `layer`
+    float aggregateScale(int layer, int row) const
+    {
+        int degree = g.degree(row);
+        return (layers[layer - 1]->aggregator == AGGREGATE_MEAN && degree > 0) ? 1.0f / degree : 1.0f;
+    }
+
+    // Layer-`layer` output of `row` into `y`, reading layer inputs through
+    // `input(row)`. Leaves [aggregate | self] in `c` and returns the norm of
+    // the sigmoid before normalization.
+    template <class Input>
+    float forwardRow(const float *W, int layer, int row, const Input &input, float *c, float *y) const
+    {
+        const int width = 2 * dim;
+        fill(c, c + width, 0.0f);
+        float scale = aggregateScale(layer, row);
+        for (const int *it = g.neighborsBegin(row); it != g.neighborsEnd(row); it++)
+            accumulateFloat(c, input(*it), scale, dim);
+        copy(input(row), input(row) + dim, c + dim);
+
+        float norm = 0.0f;
+        for (int o = 0; o < dim; o++)
+        {
+            y[o] = sigmoid(dotFloat(W + (size_t)o * width, c, width));
+            norm += y[o] * y[o];
+        }
+        norm = sqrt(norm);
+        for (int o = 0; o < dim; o++)
+            y[o] /= norm;
+        return norm;
+    }
+
+    // Backward through one row of a layer with weights `W`, given the row's
+    // [aggregate | self] `c`, output `y`, norm and d loss / d output `gy`.
+    // Adds to the weight gradient `dW` and, unless `gc` is null, leaves
+    // d loss / d [aggregate | self] in it; `g_pre` is dim floats of scratch.
+    // Returns false, touching neither, when no gradient reaches the row.
+    bool backwardRow(const float *W, const float *c, const float *y, float norm, const float *gy, float *dW, float *g_pre, float *gc) const
+    {
+        const int width = 2 * dim;
+        // y = s / |s|, s = sigmoid(W c)
+        float projection = dot(y, gy);
+        bool any = false;
+        for (int o = 0; o < dim; o++)
+        {
+            float s = y[o] * norm;
+            g_pre[o] = (gy[o] - y[o] * projection) / norm * s * (1.0f - s);
+            any = any || g_pre[o] != 0.0f;
+        }
+        if (!any)
+            return false;
+        for (int o = 0; o < dim; o++)
+            accumulateFloat(dW + (size_t)o * width, c, g_pre[o], width);
+        if (gc)
+        {
+            fill(gc, gc + width, 0.0f);
+            for (int o = 0; o < dim; o++)
+                accumulateFloat(gc, W + (size_t)o * width, g_pre[o], width);
+        }
+        return true;
+    }
+
+    // One Adam update of the parameters with `gradient`
+    void applyGradient(const vector<float> &gradient, ThreadPool &pool = defaultThreadPool())
+    {
+        const size_t n = parameters.size();
+        const float step = ++optimizer_step;
+        const float correction1 = 1.0f - pow(beta1, step);
+        const float correction2 = 1.0f - pow(beta2, step);
+        pool.parallelFor(0, n, [&](int64_t first, int64_t last)
+                         {
+                             for (int64_t i = first; i < last; i++)
+                                 adam(gradient[i], parameters[i], optimizer_state[i], optimizer_state[n + i], correction1, correction2); },
+                         8192);
+    }
+
+private:
+    const CSRGraph &g;
+    const FeatureMatrix &inputs;
+    vector<SAGELayer *> layers;
+    vector<float> &optimizer_state;
+    uint64_t &optimizer_step;
+    vector<pair<int, int>> edges; // training edges as row pairs, u < v
+    int dim = 0;
+    size_t layer_size = 0;
+
+    static constexpr float beta1 = 0.9f, beta2 = 0.999f, epsilon = 1e-8f;
+
+    // Historical embeddings: history[l] holds the layer-l output of every row
+    // for 0 < l < layers, history_step[l] the step it was computed at (-1 for
+    // never)
+    bool use_history = false;
+    vector<vector<float>> history;
+    vector<vector<int64_t>> history_step;
+    int64_t current_step = 0;
+
+    int64_t historyAge(int level, int row) const
+    {
+        int64_t step = history_step[level][row];
+        return step < 0 ? numeric_limits<int64_t>::max() : current_step - step;
+    }
+
+    // Recomputes every row of every table level with the current weights
+    void refreshHistory(ThreadPool &pool)
+    {
+        const int num_layers = layers.size();
+        history.resize(num_layers);
+        history_step.resize(num_layers);
+        for (int l = 1; l < num_layers; l++)
+        {
+            history[l].resize((size_t)g.numNodes() * dim);
+            history_step[l].assign(g.numNodes(), current_step);
+            const float *below = l == 1 ? inputs.data.data() : history[l - 1].data();
+            pool.parallelFor(0, g.numNodes(), [&](int64_t first, int64_t last)
+                             {
+                                 vector<float> combined(2 * dim);
+                                 for (int64_t r = first; r < last; r++)
+                                     forwardRow(parameters.data() + (l - 1) * layer_size, l, r, [&](int row)
+                                                { return below + (size_t)row * dim; },
+                                                combined.data(), &history[l][(size_t)r * dim]); },
+                             64);
+        }
+    }
+
+    EpochStats runSynchronous(const vector<pair<int, int>> &order, int epoch, ThreadPool &pool)
+    {
+        EpochStats stats;
+        current_step = optimizer_step;
+        use_history = options.historical_embeddings && layers.size() > 1;
+        if (use_history && (history.empty() || epoch % max(1, options.history_refresh_epochs) == 0))
+        {
+            auto start = chrono::steady_clock::now();
+            refreshHistory(pool);
+            stats.history_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        }
+        double loss_sum = 0.0, age_sum = 0.0;
+        size_t pairs = 0;
+        Arena &arena = batch_arena;
+        arena.gradients.resize(max(1, options.gradient_shards));
+        for (size_t first = 0; first < order.size(); first += options.batch_size)
+        {
+            size_t last = min(order.size(), first + (size_t)options.batch_size);
+            current_step = optimizer_step;
+            computeBatch(arena, parameters.data(), order, first, last, epoch, &pool);
+            allReduce(arena.gradients, pool);
+            applyGradient(arena.gradients[0], pool);
+            loss_sum += arena.loss;
+            pairs += arena.pairs;
+            stats.steps++;
+            if (!use_history)
+                continue;
+            for (size_t l = 1; l < layers.size(); l++)
+            {
+                const Level &level = arena.levels[l];
+                for (size_t i = 0; i < level.rows.size(); i++)
+                {
+                    copy(&level.output[i * dim], &level.output[(i + 1) * dim], &history[l][(size_t)level.rows[i] * dim]);
+                    history_step[l][level.rows[i]] = current_step;
+                }
+                stats.fresh_rows += level.rows.size();
+            }
+            stats.history_reads += arena.history_reads;
+            stats.stale_recomputes += arena.stale_recomputes;
+            age_sum += arena.history_age;
+            stats.max_history_age = max(stats.max_history_age, arena.max_history_age);
+        }
+        stats.loss = loss_sum / max<size_t>(1, pairs);
+        stats.mean_history_age = age_sum / max<size_t>(1, stats.history_reads);
+        return stats;
+    }
+
+    // Hogwild epoch: every thread takes whole batches off a shared cursor,
+    // computes their gradient against its own copy of the weights and applies
+    // Adam to the shared weights in place. Weights and moments are relaxed
+    // atomics with no lock around an update, so concurrent updates of the same
+    // weight may overwrite each other; with dense updates and small steps this
+    // costs little accuracy.
+    EpochStats runAsynchronous(const vector<pair<int, int>> &order, int epoch, ThreadPool &pool)
+    {
+        use_history = false;
+        const size_t n = parameters.size();
+        vector<atomic<float>> shared(3 * n); // weights, first and second moments
+        for (size_t i = 0; i < n; i++)
+        {
+            shared[i].store(parameters[i], memory_order_relaxed);
+            shared[n + i].store(optimizer_state[i], memory_order_relaxed);
+            shared[2 * n + i].store(optimizer_state[n + i], memory_order_relaxed);
+        }
+        atomic<uint64_t> step{optimizer_step};
+        atomic<size_t> next_batch{0};
+        const size_t batch_size = options.batch_size;
+        const size_t batches = (order.size() + batch_size - 1) / batch_size;
+        const int workers = pool.size();
+        if ((int)worker_arenas.size() < workers)
+        {
+            worker_arenas.resize(workers);
+        }
+
+        struct WorkerStats
+        {
+            double loss = 0.0;
+            size_t pairs = 0;
+            uint64_t staleness = 0;
+            uint64_t max_staleness = 0;
+        };
+        vector<WorkerStats> worker_stats(workers);
+        pool.parallelFor(0, workers, [&](int64_t first_worker, int64_t last_worker)
+                         {
+                             for (int64_t w = first_worker; w < last_worker; w++)
+                             {
+                                 Arena &arena = worker_arenas[w];
+                                 WorkerStats &stats = worker_stats[w];
+                                 arena.gradients.resize(1);
+                                 arena.snapshot.resize(n);
+                                 for (size_t b; (b = next_batch.fetch_add(1)) < batches;)
+                                 {
+                                     uint64_t read_at = step.load();
+                                     for (size_t i = 0; i < n; i++)
+                                         arena.snapshot[i] = shared[i].load(memory_order_relaxed);
+                                     size_t first = b * batch_size, last = min(order.size(), first + batch_size);
+                                     computeBatch(arena, arena.snapshot.data(), order, first, last, epoch, nullptr);
+
+                                     uint64_t t = step.fetch_add(1) + 1;
+                                     uint64_t staleness = t - 1 - read_at;
+                                     stats.staleness += staleness;
+                                     stats.max_staleness = max(stats.max_staleness, staleness);
+                                     stats.loss += arena.loss;
+                                     stats.pairs += arena.pairs;
+                                     const float correction1 = 1.0f - pow(beta1, (float)t);
+                                     const float correction2 = 1.0f - pow(beta2, (float)t);
+                                     for (size_t i = 0; i < n; i++)
+                                     {
+                                         float weight = shared[i].load(memory_order_relaxed);
+                                         float m = shared[n + i].load(memory_order_relaxed);
+                                         float v = shared[2 * n + i].load(memory_order_relaxed);
+                                         adam(arena.gradients[0][i], weight, m, v, correction1, correction2);
+                                         shared[i].store(weight, memory_order_relaxed);
+                                         shared[n + i].store(m, memory_order_relaxed);
+                                         shared[2 * n + i].store(v, memory_order_relaxed);
+                                     }
+                                 }
+                             } },
+                         1);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            parameters[i] = shared[i].load(memory_order_relaxed);
+            optimizer_state[i] = shared[n + i].load(memory_order_relaxed);
+            optimizer_state[n + i] = shared[2 * n + i].load(memory_order_relaxed);
+        }
+        optimizer_step = step.load();
+
+        EpochStats stats;
+        size_t pairs = 0;
+        for (const WorkerStats &worker : worker_stats)
+        {
+            stats.loss += worker.loss;
+            pairs += worker.pairs;
+            stats.mean_staleness += worker.staleness;
+            stats.max_staleness = max(stats.max_staleness, worker.max_staleness);
+        }
+        stats.loss /= max<size_t>(1, pairs);
+        stats.steps = batches;
+        stats.mean_staleness /= max<size_t>(1, batches);
+        return stats;
+    }
+
+    void adam(float gradient, float &weight, float &m, float &v, float correction1, float correction2) const
+    {
+        m = beta1 * m + (1.0f - beta1) * gradient;
+        v = beta2 * v + (1.0f - beta2) * gradient * gradient;
+        weight -= options.learning_rate * (m / correction1) / (sqrt(v / correction2) + epsilon);
+    }
+
+    // Scratch of one batch, reused across steps. Level l holds the rows whose
+    // layer-l output the batch computes: the scored rows at the top level, and
+    // below that every row of the level above plus its neighbors (only the
+    // stale ones with historical embeddings).
+    struct Level
+    {
+        vector<int> rows;
+        vector<float> combined;      // [aggregate | self] per row, 2 * dim
+        vector<float> output;        // normalized sigmoid, dim per row
+        vector<float> norms;         // of the sigmoid before normalization
+        vector<float> grad;          // d loss / d output
+        vector<float> combined_grad; // d loss / d [aggregate | self], above level 1
+        vector<char> reached;        // whether any gradient reached the row
+    };
+    struct Arena
+    {
+        vector<Level> levels;
+        vector<vector<int>> local;       // global row -> position in levels[l].rows, -1 if absent
+        vector<vector<float>> gradients; // weight gradient of each backward shard
+        vector<float> snapshot;          // asynchronous epochs: this worker's copy of the weights
+        vector<pair<pair<int, int>, bool>> pairs_scored;
+        double loss = 0.0;
+        size_t pairs = 0;
+        size_t history_reads = 0;
+        size_t stale_recomputes = 0;
+        double history_age = 0.0;
+        int64_t max_history_age = 0;
+    };
+    Arena batch_arena;           // synchronous epochs
+    vector<Arena> worker_arenas; // asynchronous epochs, one per thread
+
+    float sigmoid(float x) const { return 1.0f / (1.0f + exp(-x)); }
+
+    float dot(const float *a, const float *b) const { return dotFloat(a, b, dim); }
+
+    // Runs fn over [begin, end) on `pool`, or inline when there is none
+    void forRange(ThreadPool *pool, int64_t begin, int64_t end, const function<void(int64_t, int64_t)> &fn, int64_t min_chunk) const
+    {
+        if (pool)
+            pool->parallelFor(begin, end, fn, min_chunk);
+        else
+            fn(begin, end);
+    }
+
+    const float *levelRow(const Arena &arena, int level, int row) const
+    {
+        if (level == 0)
+        {
+            return inputs.row(row);
+        }
+        int i = arena.local[level][row];
+        return i >= 0 ? &arena.levels[level].output[(size_t)i * dim] : &history[level][(size_t)row * dim];
+    }
+
+    // Loss and weight gradient of the edges order[first, last) against
+    // `weights`, left in arena.gradients (one per shard, still to be summed).
+    // Every row of a level is computed once, with the level's rows spread over
+    // `pool` (inline when null). The backward pass gives each shard a fixed
+    // slice of every level's rows, so the sums do not depend on the threads.
+    void computeBatch(Arena &arena, const float *weights, const vector<pair<int, int>> &order, size_t first, size_t last, int epoch, ThreadPool *pool)
+    {
+        const int num_layers = layers.size();
+        const int width = 2 * dim;
+        const int shards = arena.gradients.size();
+        const int threads = pool ? pool->size() : 1;
+        arena.levels.resize(num_layers + 1);
+        arena.local.resize(num_layers + 1);
+        forRange(pool, 0, shards, [&](int64_t shard_begin, int64_t shard_end)
+                 {
+                     for (int64_t s = shard_begin; s < shard_end; s++)
+                         arena.gradients[s].assign(parameters.size(), 0.0f); },
+                 1);
+        arena.loss = 0.0;
+        arena.pairs = 0;
+        arena.history_reads = arena.stale_recomputes = 0;
+        arena.history_age = 0.0;
+        arena.max_history_age = 0;
+
+        vector<pair<pair<int, int>, bool>> &pairs = arena.pairs_scored;
+        trainingPairs(order, first, last, g.numNodes(), options, epoch, pairs);
+
+        // Row sets, top level down
+        for (int l = num_layers; l >= 1; l--)
+        {
+            // The index is allocated once; after that only the rows the
+            // previous step marked are cleared
+            vector<int> &rows = arena.levels[l].rows;
+            if (arena.local[l].size() != (size_t)g.numNodes())
+                arena.local[l].assign(g.numNodes(), -1);
+            else
+                for (int r : rows)
+                    arena.local[l][r] = -1;
+            rows.clear();
+            if (l == num_layers)
+            {
+                for (auto &[edge, positive] : pairs)
+                {
+                    rows.push_back(edge.first);
+                    rows.push_back(edge.second);
+                }
+            }
+            else
+            {
+                for (int r : arena.levels[l + 1].rows)
+                {
+                    rows.push_back(r);
+                    for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                    {
+                        if (!use_history || historyAge(l, *it) > options.history_max_age)
+                            rows.push_back(*it);
+                    }
+                }
+            }
+            sort(rows.begin(), rows.end());
+            rows.erase(unique(rows.begin(), rows.end()), rows.end());
+            if (use_history && l < num_layers)
+                arena.stale_recomputes += rows.size() - arena.levels[l + 1].rows.size();
+            for (size_t i = 0; i < rows.size(); i++)
+                arena.local[l][rows[i]] = i;
+        }
+        if (use_history)
+        {
+            // Neighbors left out of the level below are read from the table
+            for (int l = 2; l <= num_layers; l++)
+            {
+                for (int r : arena.levels[l].rows)
+                {
+                    for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                    {
+                        if (arena.local[l - 1][*it] >= 0)
+                            continue;
+                        int64_t age = historyAge(l - 1, *it);
+                        arena.history_reads++;
+                        arena.history_age += age;
+                        arena.max_history_age = max(arena.max_history_age, age);
+                    }
+                }
+            }
+        }
+
+        // Forward, bottom level up; the rows of a level are independent
+        for (int l = 1; l <= num_layers; l++)
+        {
+            Level &level = arena.levels[l];
+            const float *W = weights + (l - 1) * layer_size;
+            level.combined.resize(level.rows.size() * width);
+            level.output.resize(level.rows.size() * dim);
+            level.norms.resize(level.rows.size());
+            level.grad.assign(level.rows.size() * dim, 0.0f);
+            forRange(pool, 0, level.rows.size(), [&](int64_t row_begin, int64_t row_end)
+                     {
+                         for (int64_t i = row_begin; i < row_end; i++)
+                             level.norms[i] = forwardRow(W, l, level.rows[i], [&](int row)
+                                                         { return levelRow(arena, l - 1, row); },
+                                                         &level.combined[i * width], &level.output[i * dim]); },
+                     16);
+        }
+
+        // Loss and its gradient at the top level, averaged over the batch
+        Level &top = arena.levels[num_layers];
+        const float pair_scale = 1.0f / max<size_t>(1, last - first);
+        for (auto &[edge, positive] : pairs)
+        {
+            int a = arena.local[num_layers][edge.first], b = arena.local[num_layers][edge.second];
+            float *ya = &top.output[(size_t)a * dim], *yb = &top.output[(size_t)b * dim];
+            float g_score;
+            arena.loss += pairLoss(dot(ya, yb), positive, options, g_score);
+            arena.pairs++;
+            g_score *= pair_scale;
+            accumulateFloat(&top.grad[(size_t)a * dim], yb, g_score, dim);
+            accumulateFloat(&top.grad[(size_t)b * dim], ya, g_score, dim);
+        }
+
+        // Backward, top level down
+        for (int l = num_layers; l >= 1; l--)
+        {
+            Level &level = arena.levels[l];
+            const size_t n = level.rows.size();
+            const float *W = weights + (l - 1) * layer_size;
+            level.combined_grad.resize(l > 1 ? n * width : 0);
+            level.reached.assign(n, 0);
+            forRange(pool, 0, shards, [&](int64_t shard_begin, int64_t shard_end)
+                     {
+                         vector<float> g_pre(dim);
+                         for (int64_t s = shard_begin; s < shard_end; s++)
+                         {
+                             float *dW = &arena.gradients[s][(l - 1) * layer_size];
+                             for (size_t i = n * s / shards; i < n * (s + 1) / shards; i++)
+                                 level.reached[i] = backwardRow(W, &level.combined[i * width], &level.output[i * dim], level.norms[i], &level.grad[i * dim], dW,
+                                                                g_pre.data(), l > 1 ? &level.combined_grad[i * width] : nullptr);
+                         } },
+                     1);
+            if (l == 1)
+                continue;
+
+            // Into the level below: aggregate half to the neighbors, self half
+            // to the row. Each thread owns a slice of the rows below and adds
+            // to them in row order above, as one thread would.
+            Level &below = arena.levels[l - 1];
+            const vector<int> &local = arena.local[l - 1];
+            forRange(pool, 0, threads, [&](int64_t thread_begin, int64_t thread_end)
+                     {
+                         int64_t lo = below.rows.size() * thread_begin / threads, hi = below.rows.size() * thread_end / threads;
+                         for (size_t i = 0; i < n; i++)
+                         {
+                             if (!level.reached[i])
+                                 continue;
+                             int r = level.rows[i];
+                             const float *gc = &level.combined_grad[i * width];
+                             float scale = aggregateScale(l, r);
+                             // Rows read from the history table take no gradient
+                             for (const int *it = g.neighborsBegin(r); it != g.neighborsEnd(r); it++)
+                                 if (local[*it] >= lo && local[*it] < hi)
+                                     accumulateFloat(&below.grad[(size_t)local[*it] * dim], gc, scale, dim);
+                             if (local[r] >= lo && local[r] < hi)
+                                 accumulateFloat(&below.grad[(size_t)local[r] * dim], gc + dim, 1.0f, dim);
+                         } },
+                     1);
+        }
+    }
+
+    // Sums the shard gradients into gradients[0] with a pairwise tree over
+    // shard indices; threads take disjoint slices of the parameters
+    void allReduce(vector<vector<float>> &gradients, ThreadPool &pool)
+    {
+        const int shards = gradients.size();
+        pool.parallelFor(0, parameters.size(), [&](int64_t first, int64_t last)
+                         {
+                             for (int stride = 1; stride < shards; stride *= 2)
+                                 for (int s = 0; s + stride < shards; s += 2 * stride)
+                                     accumulateFloat(&gradients[s][first], &gradients[s + stride][first], 1.0f, last - first); },
+                         8192);
+    }
+};
+
+#endif
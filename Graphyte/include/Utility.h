@@ -6,6 +6,7 @@
 #include <fstream>
 #include <vector>
 #include <cmath>
+#include <cstdint>
 #include <string>
 #include <sstream>
 #include <algorithm>
@@ -63,23 +64,233 @@ void loadFeatures(const char *filename, unordered_map<int, vector<vector<float>>
     return;
 }
 
-void splitEdges(unordered_map<int, vector<int>> &edges, unordered_map<int, vector<int>> &train_edges, unordered_map<int, vector<int>> &test_edges, float TEST_RATIO = 0.3)
+// Train/validation/test partition of an edge set. All three graphs share the
+// input's rows, so a row index means the same node in each of them.
+struct EdgeSplit
 {
-    int test_size = ceil(edges.size() * TEST_RATIO);
-    int count = 0;
-    for (auto &[key, value] : edges)
+    CSRGraph train;
+    CSRGraph val;
+    CSRGraph test;
+};
+
+enum EdgeSet
+{
+    TRAIN_EDGE,
+    VAL_EDGE,
+    TEST_EDGE
+};
+
+// Uniform draw in [0, 1) for the undirected edge u-v. It depends only on the
+// seed and the node ids, so CSR and streamed splits agree regardless of order.
+double edgeUniform(uint64_t seed, int u, int v)
+{
+    if (u > v)
+    {
+        swap(u, v);
+    }
+    // SplitMix64 finalizer
+    uint64_t z = seed + (((uint64_t)(uint32_t)u << 32) | (uint32_t)v) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+EdgeSet assignEdge(double r, float val_ratio, float test_ratio)
+{
+    if (r < test_ratio)
+        return TEST_EDGE;
+    if (r < test_ratio + val_ratio)
+        return VAL_EDGE;
+    return TRAIN_EDGE;
+}
+
+EdgeSplit buildEdgeSplit(const vector<int> &node_ids, vector<pair<int, int>> (&buckets)[3])
+{
+    EdgeSplit split;
+    split.train = CSRGraph::fromRowEdges(node_ids, buckets[TRAIN_EDGE]);
+    split.val = CSRGraph::fromRowEdges(node_ids, buckets[VAL_EDGE]);
+    split.test = CSRGraph::fromRowEdges(node_ids, buckets[TEST_EDGE]);
+    return split;
+}
+
+EdgeSplit buildEdgeSplit(const CSRGraph &g, vector<pair<int, int>> (&buckets)[3])
+{
+    EdgeSplit split = buildEdgeSplit(g.node_ids, buckets);
+    split.train.id_order = split.val.id_order = split.test.id_order = g.id_order;
+    return split;
+}
+
+// Stratified assignment of unique undirected row edges (u < v). Each node's
+// quota of test and validation edges comes from its full degree. Edges are
+// then held out in the order of their seeded draw, first where both endpoints
+// still need edges of that set and then where either does, but never when
+// that would take the last training edge of an endpoint. No node loses its
+// last training edge, and a node with a quota of one or more gets held-out
+// edges unless all its neighbors are down to their last training edge.
+void stratifyEdges(const vector<int> &node_ids, const vector<pair<int, int>> &edges, float val_ratio, float test_ratio,
+                   uint64_t seed, vector<pair<int, int>> (&buckets)[3])
+{
+    const size_t n = node_ids.size();
+    vector<int> degree(n, 0), held_out(n, 0);
+    for (auto &[u, v] : edges)
+    {
+        degree[u]++;
+        degree[v]++;
+    }
+    vector<int> need[3];
+    need[VAL_EDGE].resize(n);
+    need[TEST_EDGE].resize(n);
+    for (size_t x = 0; x < n; x++)
+    {
+        need[TEST_EDGE][x] = llround(degree[x] * test_ratio);
+        need[VAL_EDGE][x] = llround(degree[x] * val_ratio);
+    }
+
+    // Draw order, ties broken by node ids so row numbering does not matter
+    vector<pair<double, size_t>> order(edges.size());
+    for (size_t e = 0; e < edges.size(); e++)
+    {
+        order[e] = {edgeUniform(seed, node_ids[edges[e].first], node_ids[edges[e].second]), e};
+    }
+    auto ids = [&](size_t e)
+    {
+        int a = node_ids[edges[e].first], b = node_ids[edges[e].second];
+        return make_pair(min(a, b), max(a, b));
+    };
+    sort(order.begin(), order.end(), [&](const pair<double, size_t> &a, const pair<double, size_t> &b)
+         { return a.first < b.first || (a.first == b.first && ids(a.second) < ids(b.second)); });
+
+    // First hold out edges both endpoints still need, then fill what is left
+    // of each quota from edges only one endpoint needs
+    vector<char> decided(edges.size(), 0);
+    for (int pass = 0; pass < 2; pass++)
     {
-        if (count == test_size)
+        for (auto &[r, e] : order)
         {
-            break;
+            auto [u, v] = edges[e];
+            if (decided[e] || held_out[u] + 1 >= degree[u] || held_out[v] + 1 >= degree[v])
+            {
+                continue;
+            }
+            for (EdgeSet set : {TEST_EDGE, VAL_EDGE})
+            {
+                bool wanted = pass == 0 ? need[set][u] > 0 && need[set][v] > 0 : need[set][u] > 0 || need[set][v] > 0;
+                if (wanted)
+                {
+                    need[set][u]--;
+                    need[set][v]--;
+                    held_out[u]++;
+                    held_out[v]++;
+                    decided[e] = 1;
+                    buckets[set].push_back(edges[e]);
+                    break;
+                }
+            }
         }
-        test_edges[key] = value;
-        count++;
     }
-    for (auto &[key, value] : edges)
+    for (size_t e = 0; e < edges.size(); e++)
     {
-        train_edges[key] = value;
+        if (!decided[e])
+        {
+            buckets[TRAIN_EDGE].push_back(edges[e]);
+        }
     }
+}
+
+// Edge-level split in a single pass over the CSR rows; every undirected edge
+// is visited once, from its lower row. With `stratified` the ratios apply to
+// each node's incident edges instead (see stratifyEdges).
+EdgeSplit splitEdgesCSR(const CSRGraph &g, float val_ratio, float test_ratio, uint64_t seed, bool stratified = false)
+{
+    vector<pair<int, int>> buckets[3];
+    vector<pair<int, int>> edges;
+    for (int u = 0; u < g.numNodes(); u++)
+    {
+        for (const int *it = g.neighborsBegin(u); it != g.neighborsEnd(u); it++)
+        {
+            int v = *it;
+            if (v <= u)
+            {
+                continue;
+            }
+            if (stratified)
+            {
+                edges.push_back({u, v});
+            }
+            else
+            {
+                buckets[assignEdge(edgeUniform(seed, g.node_ids[u], g.node_ids[v]), val_ratio, test_ratio)].push_back({u, v});
+            }
+        }
+    }
+    if (stratified)
+    {
+        edges.erase(unique(edges.begin(), edges.end()), edges.end());
+        stratifyEdges(g.node_ids, edges, val_ratio, test_ratio, seed, buckets);
+    }
+    return buildEdgeSplit(g, buckets);
+}
+
+// Same split straight from an edge-list file ("u v" per line), without first
+// building an adjacency structure. Both directions of an edge may appear.
+// The stratified split needs every node's degree, so it keeps the edges in
+// memory and assigns them after reading the file.
+EdgeSplit streamSplitEdges(const char *filename, float val_ratio, float test_ratio, uint64_t seed, bool stratified = false)
+{
+    vector<pair<int, int>> buckets[3];
+    vector<int> node_ids;
+    ifstream file(filename);
+    if (!file.is_open())
+    {
+        cout << "Error opening file" << endl;
+        return EdgeSplit();
+    }
+    int u, v;
+    while (file >> u >> v)
+    {
+        if (u == v)
+        {
+            continue;
+        }
+        if (u > v)
+        {
+            swap(u, v);
+        }
+        buckets[stratified ? TRAIN_EDGE : assignEdge(edgeUniform(seed, u, v), val_ratio, test_ratio)].push_back({u, v});
+        node_ids.push_back(u);
+        node_ids.push_back(v);
+    }
+    sort(node_ids.begin(), node_ids.end());
+    node_ids.erase(unique(node_ids.begin(), node_ids.end()), node_ids.end());
+
+    // Drop repeated edges and switch ids to rows
+    for (auto &bucket : buckets)
+    {
+        sort(bucket.begin(), bucket.end());
+        bucket.erase(unique(bucket.begin(), bucket.end()), bucket.end());
+        for (auto &[a, b] : bucket)
+        {
+            a = lower_bound(node_ids.begin(), node_ids.end(), a) - node_ids.begin();
+            b = lower_bound(node_ids.begin(), node_ids.end(), b) - node_ids.begin();
+        }
+    }
+    if (stratified)
+    {
+        vector<pair<int, int>> edges;
+        edges.swap(buckets[TRAIN_EDGE]);
+        stratifyEdges(node_ids, edges, val_ratio, test_ratio, seed, buckets);
+    }
+    return buildEdgeSplit(node_ids, buckets);
+}
+
+// Edge-level train/test split of an adjacency map. Every node stays in the
+// training graph, but each edge lands in exactly one of the two sets.
+void splitEdges(unordered_map<int, vector<int>> &edges, unordered_map<int, vector<int>> &train_edges, unordered_map<int, vector<int>> &test_edges, float TEST_RATIO = 0.3, uint64_t seed = 42)
+{
+    EdgeSplit split = splitEdgesCSR(CSRGraph::fromGraph(Graph(edges)), 0.0f, TEST_RATIO, seed);
+    train_edges = split.train.toAdjList(true);
+    test_edges = split.test.toAdjList(false);
     return;
 }
 
@@ -158,7 +369,12 @@ void loadDataAndFeatures(unordered_map<int, vector<int>>& edges, unordered_map<i
 void prepareTrainingData(unordered_map<int, vector<int>>& edges, unordered_map<int, vector<int>>& train_pos_edges, unordered_map<int, vector<int>>& test_pos_edges, unordered_map<int, vector<int>>& train_neg_edges, unordered_map<int, vector<int>>& test_neg_edges) {
     std::cout << "\n=== Preparing Training Data ===" << std::endl;
     splitEdges(edges, train_pos_edges, test_pos_edges, 0.3f);
-    std::cout << "Edge split - Training: " << train_pos_edges.size() << ", Testing: " << test_pos_edges.size() << std::endl;
+    auto countEdges = [](const unordered_map<int, vector<int>>& adj) {
+        size_t count = 0;
+        for (const auto& [node, neighbors] : adj) count += neighbors.size();
+        return count / 2;
+    };
+    std::cout << "Edge split - Training: " << countEdges(train_pos_edges) << " edges, Testing: " << countEdges(test_pos_edges) << " edges" << std::endl;
     getNegativeEdges(train_pos_edges, train_neg_edges);
     getNegativeEdges(test_pos_edges, test_neg_edges);
     std::cout << "Negative edges generated - Training: " << train_neg_edges.size() << ", Testing: " << test_neg_edges.size() << std::endl;
@@ -1,55 +1,27 @@
 #include <iomanip>
 #include <set>
 #include <cstring>
-#include <random>
+#include <cstdlib>
 #include <unordered_map>
 #include "include/raylib.h"
 #include "include/Graph.h"
 #include "include/Utility.h"
+#include "include/Random.h"
 #include "include/Layer.h"
 #include "include/Model.h"
+#include "include/Checkpoint.h"
+#include "include/Server.h"
+#include "include/Benchmark.h"
+#include "include/Layout.h"
+#include "include/Render.h"
+#include "include/AsyncRecommender.h"
 
 
-float Vector2Distance(Vector2 p1, Vector2 p2) {
-    return sqrt(((p1.x - p2.x) * (p1.x - p2.x)) + ((p1.y - p2.y) * (p1.y - p2.y)));
-}
-
-float Vector2Length(Vector2 p) {
-    return sqrt((p.x * p.x) + (p.y * p.y));
-}
-
-float Clamp(float val, float min, float max) {
-    return (val < min) ? min : (val > max) ? max : val;
-}
-
-struct Node {
-    Vector2 position;
-    bool isTestNode;
-    int id;
-    float radius = 20.0f;  // Larger nodes for better visibility
-    Vector2 velocity = {0, 0};
-};
-
-// Force-directed layout helper functions
-Vector2 calculateRepulsion(const Node& n1, const Node& n2) {
-    Vector2 diff = {n1.position.x - n2.position.x, n1.position.y - n2.position.y};
-    float dist = Vector2Length(diff);
-    if (dist < 0.01f) dist = 0.01f;
-    float force = 2000.0f / (dist * dist);  // Repulsion strength
-    return {(diff.x / dist) * force, (diff.y / dist) * force};
-}
-
-Vector2 calculateAttraction(const Node& n1, const Node& n2) {
-    Vector2 diff = {n2.position.x - n1.position.x, n2.position.y - n1.position.y};
-    float dist = Vector2Length(diff);
-    float force = (dist - 150.0f) * 0.05f;  // Spring constant
-    return {(diff.x / dist) * force, (diff.y / dist) * force};
-}
-
 // New function to sample random test edges
 std::vector<std::pair<int, int>> sampleRandomTestEdges(
     const std::vector<std::pair<int, int>>& test_edges,
-    size_t sample_size) {
+    size_t sample_size,
+    uint64_t seed = 0) {
     
     if (test_edges.size() <= sample_size) {
         return test_edges;
@@ -58,9 +30,7 @@ std::vector<std::pair<int, int>> sampleRandomTestEdges(
     std::vector<size_t> indices(test_edges.size());
     std::iota(indices.begin(), indices.end(), 0);
     
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::shuffle(indices.begin(), indices.end(), gen);
+    counterShuffle(indices, CounterRandom(seed));
     
     std::vector<std::pair<int, int>> sampled_edges;
     for (size_t i = 0; i < sample_size; ++i) {
@@ -143,7 +113,7 @@ void HandleTextInput(char* buffer, int maxSize, bool active) {
 }
 
 void DrawGraph(const unordered_map<int, vector<int>>& test_edges, 
-               const std::vector<std::pair<int, float>>& recommendations,
+               SAGEModel& model,
                int maxNodeIndex) {
     const int SCREEN_WIDTH = 1000;
     const int SCREEN_HEIGHT = 1000;
@@ -178,81 +148,95 @@ void DrawGraph(const unordered_map<int, vector<int>>& test_edges,
     float scrollOffset = 0;
     // const float MAX_VISIBLE_ROWS = (boundingBox.height - 100) / ROW_HEIGHT;
 
-    std::unordered_map<int, Node> nodes;
+    ForceLayout layout;
+    layout.bounds = boundingBox;
+    LayoutWorker layoutWorker;
+    const std::vector<Node>& nodes = layoutWorker.nodes;
+    GraphView graphView(boundingBox);
+    GraphRenderer renderer;
+    std::vector<EdgeBatch> edgeBatches;
     std::vector<std::pair<int, int>> filtered_edges;
     std::vector<std::pair<int, float>> filtered_recommendations;
     
-    // Random number generator for node positions
-    std::random_device rd;
-    std::mt19937 gen(rd());
-
-    auto initializeGraph = [&](int test_id) {
-        nodes.clear();
-        filtered_edges.clear();
-        filtered_recommendations.clear();
-
-        // Filter edges connected to the test_id
-    for (const auto& [node, adjacent_nodes] : test_edges) {
-        if (node == test_id) {
-            // Add edges where the test_id is the source node
-            for (int adjacent_node : adjacent_nodes) {
-                filtered_edges.push_back(std::make_pair(node, adjacent_node));
-            }
-        } else {
-            // Check if test_id is in the adjacency list of this node
-            auto it = std::find(adjacent_nodes.begin(), adjacent_nodes.end(), test_id);
-            if (it != adjacent_nodes.end()) {
-                // Add edge where the test_id is the destination node
-                filtered_edges.push_back(std::make_pair(node, test_id));
-            }
+    // Starting positions are drawn from a stream keyed by node id, so a node
+    // always appears in the same place
+    const CounterRandom nodePositions(0x6772617068ull);
+
+    // Recommendations are computed on demand by a background worker
+    AsyncRecommender recommender(model);
+    std::shared_future<Recommendations> pendingRecommendations;
+
+    auto initializeGraph = [&](int test_id, const Recommendations& recommendations) {
+        // Nodes that are already on screen keep their positions
+        std::unordered_map<int, Vector2> previousPositions;
+        const std::vector<Vector2>& currentPositions = layoutWorker.positions();
+        for (size_t i = 0; i < nodes.size() && i < currentPositions.size(); i++) {
+            previousPositions[nodes[i].id] = currentPositions[i];
         }
-    }
 
-        for (const auto& rec : recommendations) {
-            if (rec.first == test_id) {
-                filtered_recommendations.push_back(rec);
+        layout.clear();
+        filtered_edges.clear();
+        filtered_recommendations = recommendations;
+
+        // Edges connected to the test_id: the adjacency lists are symmetric,
+        // so its own list holds all of them
+        auto adjacent = test_edges.find(test_id);
+        if (adjacent != test_edges.end()) {
+            for (int adjacent_node : adjacent->second) {
+                filtered_edges.push_back(std::make_pair(test_id, adjacent_node));
             }
         }
-        std::sort(filtered_recommendations.begin(), filtered_recommendations.end(), [](const auto& a, const auto& b) {return a.second > b.second;});
         
         // Initialize nodes with positions within bounding box
-        std::uniform_real_distribution<float> disX(boundingBox.x + 50, boundingBox.x + boundingBox.width - 50);
-        std::uniform_real_distribution<float> disY(boundingBox.y + 50, boundingBox.y + boundingBox.height - 50);
+        auto addNode = [&](int id, bool isTestNode) {
+            auto previous = previousPositions.find(id);
+            Vector2 position = previous != previousPositions.end() ? previous->second : Vector2{
+                nodePositions.uniform(2 * (uint64_t)id, boundingBox.x + 50, boundingBox.x + boundingBox.width - 50),
+                nodePositions.uniform(2 * (uint64_t)id + 1, boundingBox.y + 50, boundingBox.y + boundingBox.height - 50)};
+            layout.addNode(Node{position, isTestNode, id});
+        };
         
         // Add test node
-        nodes[test_id] = Node{
-            Vector2{disX(gen), disY(gen)},
-            true,
-            test_id
-        };
+        addNode(test_id, true);
         
         // Add connected nodes from test edges
         for (const auto& edge : filtered_edges) {
-            int connected_id = (edge.first == test_id) ? edge.second : edge.first;
-            if (nodes.find(connected_id) == nodes.end()) {
-                nodes[connected_id] = Node{
-                    Vector2{disX(gen), disY(gen)},
-                    true,
-                    connected_id
-                };
-            }
+            addNode(edge.second, true);
         }
         
         // Add recommendations for the test node
         for (const auto& rec : recommendations) {
-            if (rec.first == test_id && nodes.find(rec.first) == nodes.end()) {
-                nodes[rec.first] = Node{
-                    Vector2{disX(gen), disY(gen)},
-                    false,
-                    rec.first
-                };
+            if (layout.indexOf(rec.first) < 0) {
+                addNode(rec.first, false);
             }
         }
-};
 
-    bool layoutStabilized = false;
-    int stabilityCounter = 0;
-    const int STABILITY_THRESHOLD = 100;
+        // Per-node adjacency index for the attraction forces
+        for (const auto& edge : filtered_edges) {
+            layout.addEdge(edge.first, edge.second);
+        }
+
+        // Test edges in red, recommendation edges faded green
+        edgeBatches.assign(2, EdgeBatch());
+        edgeBatches[0].width = 2.0f;
+        edgeBatches[0].color = RED;
+        edgeBatches[1].width = 1.0f;
+        edgeBatches[1].color = Fade(GREEN, 0.3f);
+        for (size_t i = 0; i < layout.adjacency.size(); i++) {
+            for (int j : layout.adjacency[i]) {
+                if ((size_t)j > i) {
+                    edgeBatches[0].edges.push_back({(int)i, j});
+                }
+            }
+        }
+        for (const auto& rec : recommendations) {
+            edgeBatches[1].edges.push_back({layout.indexOf(rec.first), layout.indexOf(test_id)});
+        }
+
+        // The simulation runs on the worker thread from here on
+        layoutWorker.start(layout);
+        renderer.setNodes(layout.nodes);
+};
 
     while (!WindowShouldClose()) {
         if (isListViewActive && selected_test_id != -1) {
@@ -272,9 +256,10 @@ void DrawGraph(const unordered_map<int, vector<int>>& test_edges,
             int new_test_id = atoi(testIdBuffer);
             if (new_test_id != selected_test_id && new_test_id > 0) {
                 selected_test_id = new_test_id;
-                initializeGraph(selected_test_id);
-                layoutStabilized = false;
-                stabilityCounter = 0;
+                // Show the known edges right away; recommendations follow when ready
+                pendingRecommendations = recommender.request(selected_test_id);
+                initializeGraph(selected_test_id, Recommendations());
+                graphView.reset();
                 scrollOffset = 0; // Reset scroll when new ID is selected
             }
         }
@@ -298,64 +283,19 @@ void DrawGraph(const unordered_map<int, vector<int>>& test_edges,
             isListViewActive = true;
         }
 
-        // Update node positions using force-directed layout
-        if (!layoutStabilized && selected_test_id != -1) {
-            bool stable = true;
-            
-            for (auto& [id1, node1] : nodes) {
-                Vector2 totalForce = {0, 0};
-                
-                // Repulsion between all nodes
-                for (const auto& [id2, node2] : nodes) {
-                    if (id1 != id2) {
-                        Vector2 force = calculateRepulsion(node1, node2);
-                        totalForce.x += force.x;
-                        totalForce.y += force.y;
-                    }
-                }
-                
-                // Attraction along edges
-                for (const auto& edge : filtered_edges) {
-                    if (edge.first == id1 && nodes.count(edge.second)) {
-                        Vector2 force = calculateAttraction(node1, nodes[edge.second]);
-                        totalForce.x += force.x;
-                        totalForce.y += force.y;
-                    }
-                    if (edge.second == id1 && nodes.count(edge.first)) {
-                        Vector2 force = calculateAttraction(node1, nodes[edge.first]);
-                        totalForce.x += force.x;
-                        totalForce.y += force.y;
-                    }
-                }
-                
-                // Update velocity and position
-                node1.velocity.x = (node1.velocity.x + totalForce.x) * 0.9f;
-                node1.velocity.y = (node1.velocity.y + totalForce.y) * 0.9f;
-                
-                // Update position and constrain to bounding box
-                node1.position.x += node1.velocity.x;
-                node1.position.y += node1.velocity.y;
-                
-                node1.position.x = Clamp(node1.position.x, 
-                                       boundingBox.x + node1.radius,
-                                       boundingBox.x + boundingBox.width - node1.radius);
-                node1.position.y = Clamp(node1.position.y,
-                                       boundingBox.y + node1.radius,
-                                       boundingBox.y + boundingBox.height - node1.radius);
-                
-                if (fabs(node1.velocity.x) > 0.1f || fabs(node1.velocity.y) > 0.1f) {
-                    stable = false;
-                }
-            }
-            
-            if (stable) stabilityCounter++;
-            else stabilityCounter = 0;
-            
-            if (stabilityCounter >= STABILITY_THRESHOLD) {
-                layoutStabilized = true;
-            }
+        if (pendingRecommendations.valid() &&
+            pendingRecommendations.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            initializeGraph(selected_test_id, pendingRecommendations.get());
+            pendingRecommendations = std::shared_future<Recommendations>();
         }
 
+        if (isGraphViewActive && selected_test_id != -1) {
+            graphView.handleInput();
+        }
+
+        // Latest node positions from the layout thread
+        const std::vector<Vector2>& positions = layoutWorker.positions();
+
         BeginDrawing();
         ClearBackground(RAYWHITE);
         
@@ -441,33 +381,13 @@ void DrawGraph(const unordered_map<int, vector<int>>& test_edges,
             DrawText("GRAPH VIEW", SCREEN_WIDTH / 2 - 100, 100, 32, BLACK);
             
             if (selected_test_id != -1) {
-                // Draw edges
-                for (const auto& edge : filtered_edges) {
-                    if (nodes.find(edge.first) != nodes.end() && nodes.find(edge.second) != nodes.end()) {
-                        DrawLineEx(nodes[edge.first].position, nodes[edge.second].position, 2.0f, RED);
-                    }
-                }
-
-                // Draw recommendation edges
-                for (const auto& rec : recommendations) {
-                    if (rec.first == selected_test_id && nodes.find(rec.first) != nodes.end()) {
-                        DrawLineEx(nodes[rec.first].position, nodes[selected_test_id].position, 1.0f, Fade(GREEN, 0.3f));
-                    }
-                }
-
-                // Draw nodes
-                for (const auto& [id, node] : nodes) {
-                    Color nodeColor = node.isTestNode ? RED : GREEN;
-                    DrawCircleV(node.position, node.radius, nodeColor);
-                    DrawCircleLines(node.position.x, node.position.y, node.radius, BLACK);
-                    
-                    char idText[10];
-                    sprintf(idText, "%d", node.id);
-                    Vector2 textPosition = {
-                        node.position.x - MeasureText(idText, 20) / 2,
-                        node.position.y - 10
-                    };
-                    DrawText(idText, textPosition.x, textPosition.y, 20, WHITE);
+                // Edges, nodes and labels in a few batched submissions
+                renderer.draw(graphView, nodes, positions, edgeBatches);
+                DrawText(TextFormat("%d / %d nodes visible  (wheel: zoom, right drag: pan, Home: reset)",
+                                    (int)renderer.visibleNodes(), (int)nodes.size()),
+                         boundingBox.x, boundingBox.y + boundingBox.height + 10, 20, DARKGRAY);
+                if (pendingRecommendations.valid()) {
+                    DrawText("Computing recommendations...", boundingBox.x + 10, boundingBox.y + 10, 20, DARKGRAY);
                 }
 
                 // Draw legend
@@ -484,49 +404,142 @@ void DrawGraph(const unordered_map<int, vector<int>>& test_edges,
         EndDrawing();
     }
 
+    layoutWorker.stop();
     CloseWindow();
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        const char* checkpoint_path = "checkpoint.bin";
+        const char* serve_socket = nullptr;
+        bool resume = false;
+        bool bench = false;
+        bool live = false;
+        int train_epochs = 0;
+        int train_partitions = 1;
+        const char* embedding_format = nullptr;
+        const char* inference_precision = nullptr;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+                checkpoint_path = argv[++i];
+            } else if (strcmp(argv[i], "--resume") == 0) {
+                resume = true;
+            } else if (strcmp(argv[i], "--bench") == 0) {
+                bench = true;
+            } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+                serve_socket = argv[++i];
+            } else if (strcmp(argv[i], "--live") == 0) {
+                live = true;
+            } else if (strcmp(argv[i], "--embeddings") == 0 && i + 1 < argc) {
+                embedding_format = argv[++i];
+            } else if (strcmp(argv[i], "--inference") == 0 && i + 1 < argc) {
+                inference_precision = argv[++i];
+            } else if (strcmp(argv[i], "--train") == 0 && i + 1 < argc) {
+                train_epochs = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) {
+                train_partitions = atoi(argv[++i]);
+            }
+        }
+
+        EmbeddingFormat format = EMBEDDING_FP32;
+        if (embedding_format) {
+            if (strcmp(embedding_format, "fp16") == 0) {
+                format = EMBEDDING_FP16;
+            } else if (strcmp(embedding_format, "int8") == 0) {
+                format = EMBEDDING_INT8;
+            } else {
+                std::cerr << "Error: unknown embedding format " << embedding_format << " (expected fp16 or int8)" << std::endl;
+                return 1;
+            }
+        }
+
+        // Serving mode only needs the checkpoint: no data loading, training or window.
+        // Live serving also rebuilds the model from the data to apply edge updates.
+        if (serve_socket) {
+#ifdef _WIN32
+            std::cerr << "Serving mode requires Unix domain sockets" << std::endl;
+            return 1;
+#else
+            if (!live) {
+                return serveRecommendations(checkpoint_path, serve_socket, format);
+            }
+            blockServerSignals();
+#endif
+        }
+
         unordered_map<int, vector<int>> edges;
         unordered_map<int, vector<int>> train_pos_edges, test_pos_edges;
         unordered_map<int, vector<int>> train_neg_edges, test_neg_edges;
         unordered_map<int, vector<vector<float>>> Features;
     
         loadDataAndFeatures(edges, Features);
+        if (bench) {
+            runBenchmarks(edges, Features);
+            return 0;
+        }
         prepareTrainingData(edges, train_pos_edges, test_pos_edges, train_neg_edges, test_neg_edges);
         
         SAGEModel model(train_pos_edges, train_neg_edges, Features);
+#ifndef _WIN32
+        if (serve_socket) {
+            if (!loadCheckpoint(checkpoint_path, model)) {
+                return 1;
+            }
+            return serveLiveRecommendations(model, serve_socket, format);
+        }
+#endif
+        if (resume && loadCheckpoint(checkpoint_path, model)) {
+            std::cout << "Resumed from checkpoint " << checkpoint_path << std::endl;
+        }
+        if (inference_precision) {
+            if (strcmp(inference_precision, "bf16") == 0) {
+                model.inference_precision = PRECISION_BF16;
+            } else if (strcmp(inference_precision, "int8") == 0) {
+                model.inference_precision = PRECISION_INT8;
+            } else if (strcmp(inference_precision, "fp32") != 0) {
+                std::cerr << "Error: unknown inference precision " << inference_precision << " (expected fp32, bf16 or int8)" << std::endl;
+                return 1;
+            }
+        }
+        if (train_epochs > 0) {
+            std::cout << "\n=== Training Model ===" << std::endl;
+#ifndef _WIN32
+            if (train_partitions > 1) {
+                trainPartitioned(model, train_partitions, train_epochs);
+            } else {
+                model.train(train_epochs);
+            }
+#else
+            model.train(train_epochs);
+#endif
+            model.computeEmbeddings();
+        }
+        // The compact table replaces the float embeddings, so the checkpoint
+        // is written first and keeps them at full precision
+        bool saved = false;
+        if (embedding_format) {
+            saved = saveCheckpoint(checkpoint_path, model);
+            model.quantizeEmbeddings(format, true);
+            std::cout << "Scoring with " << embeddingFormatName(model.embedding_store.format) << " embeddings ("
+                      << model.embedding_store.bytes() / 1024 << " KB)" << std::endl;
+        }
         
         std::cout << "\n=== Evaluating Model ===" << std::endl;
         float auc = model.evaluate(test_pos_edges, test_neg_edges);
         cout << "AUC Score: " << auc << endl;
+        RankingMetrics ranking = model.evaluateRanking(test_pos_edges);
+        cout << "Hits@" << ranking.k << ": " << ranking.hits_at_k << ", MRR: " << ranking.mrr
+             << ", NDCG@" << ranking.k << ": " << ranking.ndcg_at_k << endl;
 
-        // Get recommendations for visualization
-        std::vector<std::pair<int, float>> all_recommendations;
-        // Get recommendations for each test node
-        for (const auto& test_edge : test_pos_edges) {
-            auto recommendations = model.getPrediction(test_edge.first);
-            all_recommendations.insert(all_recommendations.end(), recommendations.begin(), recommendations.end());
+        if (!embedding_format) {
+            saved = saveCheckpoint(checkpoint_path, model);
         }
-
-        // Filter and sort the recommendations
-        std::unordered_map<int, float> filtered_recommendations;
-        for (const auto& rec : all_recommendations) {
-            if (filtered_recommendations.find(rec.first) == filtered_recommendations.end() || rec.second > filtered_recommendations[rec.first]) {
-                filtered_recommendations[rec.first] = rec.second;
-            }
+        if (saved) {
+            std::cout << "Checkpoint saved to " << checkpoint_path << std::endl;
         }
 
-        std::vector<std::pair<int, float>> sorted_recommendations;
-        for (const auto& [node_id, score] : filtered_recommendations) {
-            sorted_recommendations.emplace_back(node_id, score);
-        }
-        std::sort(sorted_recommendations.begin(), sorted_recommendations.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
-        
         // Visualize the graph
-        DrawGraph(test_pos_edges, all_recommendations, findMaxNodeIndex(edges));
+        DrawGraph(test_pos_edges, model, findMaxNodeIndex(edges));
         
         std::cout << "\n=== Processing Complete ===" << std::endl;
         return 0;